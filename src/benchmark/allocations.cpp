@@ -0,0 +1,75 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+	
+	std::atomic<uint64_t> allocationCount(0);
+	
+	void *allocate(std::size_t size) {
+		allocationCount++;
+		if (size == 0) size = 1;
+		// As the operator new it replaces, the new handler may free memory for a retry
+		while (true) {
+			void *ptr = std::malloc(size);
+			if (ptr != NULL) return ptr;
+			std::new_handler handler = std::get_new_handler();
+			if (handler == NULL) throw std::bad_alloc();
+			handler();
+		}
+	}
+	
+}
+
+
+namespace allocations {
+	
+	uint64_t getCount() {
+		return allocationCount.load();
+	}
+	
+}
+
+
+void *operator new(std::size_t size) {
+	return allocate(size);
+}
+
+void *operator new[](std::size_t size) {
+	return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
@@ -0,0 +1,296 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Animation.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+
+namespace {
+	
+	const char magic[4] = { 'G', '8', '1', 'A' };
+	const uint8_t version = 1;
+	const uint16_t loopFlag = 0x0001;
+	
+	uint16_t read16(const uint8_t *data) {
+		return data[0] | data[1] << 8;
+	}
+	
+	uint32_t read32(const uint8_t *data) {
+		return read16(data) | static_cast<uint32_t>(read16(data + 2)) << 16;
+	}
+	
+	void write16(vector<uint8_t> &data, uint16_t value) {
+		data.push_back(value & 0xff);
+		data.push_back(value >> 8);
+	}
+	
+	void write32(vector<uint8_t> &data, uint32_t value) {
+		write16(data, value & 0xffff);
+		write16(data, value >> 16);
+	}
+	
+	bool isSameColor(const LedKeyboard::Color &a, const LedKeyboard::Color &b) {
+		return a.red == b.red && a.green == b.green && a.blue == b.blue;
+	}
+	
+}
+
+
+Animation::Animation() {}
+
+Animation::~Animation() {
+	close();
+}
+
+
+bool Animation::open(const string &path) {
+	close();
+	
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	struct stat status;
+	if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(headerSize)) {
+		::close(fd);
+		errno = EINVAL;
+		return false;
+	}
+	void *data = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd); // The mapping keeps the file
+	if (data == MAP_FAILED) return false;
+	m_data = static_cast<const uint8_t*>(data);
+	m_size = status.st_size;
+	
+	// Only the chain of keyframes is walked here, so that playing never reads
+	// past the mapping. Each keyframe takes at least 4 bytes, which bounds the
+	// count before anything is sized from it.
+	const uint8_t *header = m_data;
+	uint32_t keyframeCount = read32(header + 12);
+	if (memcmp(header, magic, sizeof(magic)) != 0 || header[4] != version ||
+	    read16(header + 6) != LedKeyboard::keyCount || read16(header + 8) == 0 || keyframeCount == 0 ||
+	    keyframeCount > (m_size - headerSize) / 4 ||
+	    header[5] > static_cast<uint8_t>(LedKeyboard::KeyboardModel::gpro)) {
+		close();
+		errno = EINVAL;
+		return false;
+	}
+	m_model = static_cast<LedKeyboard::KeyboardModel>(header[5]);
+	m_frameRate = read16(header + 8);
+	m_isLooping = read16(header + 10) & loopFlag;
+	
+	size_t offset = headerSize;
+	uint64_t tick = 0;
+	m_offsets.reserve(keyframeCount);
+	m_starts.reserve(static_cast<size_t>(keyframeCount) + 1);
+	for (uint32_t i = 0; i < keyframeCount; i++) {
+		if (offset + 4 > m_size) break;
+		const uint8_t *keyframe = m_data + offset;
+		uint16_t ticks = read16(keyframe);
+		uint8_t count = keyframe[3];
+		if (ticks == 0 || keyframe[2] > static_cast<uint8_t>(Interpolation::linear) ||
+		    offset + 4 + 4 * count > m_size) break;
+		for (uint8_t j = 0; j < count; j++) {
+			uint8_t index = keyframe[4 + 4 * j];
+			if (index >= LedKeyboard::keyCount) count = 0;
+			else if (i == 0) m_isDriven[index] = true;
+			else if (! m_isDriven[index]) count = 0;
+		}
+		if (count != keyframe[3]) break;
+		m_offsets.push_back(offset);
+		m_starts.push_back(tick);
+		offset += 4 + 4 * count;
+		tick += ticks;
+	}
+	if (m_offsets.size() != keyframeCount || offset != m_size) {
+		close();
+		errno = EINVAL;
+		return false;
+	}
+	m_starts.push_back(tick);
+	
+	madvise(data, m_size, MADV_WILLNEED);
+	rewind();
+	return true;
+}
+
+void Animation::close() {
+	if (m_data != NULL) munmap(const_cast<uint8_t*>(m_data), m_size);
+	m_data = NULL;
+	m_size = 0;
+	m_offsets.clear();
+	m_starts.clear();
+	fill(m_isDriven, m_isDriven + LedKeyboard::keyCount, false);
+}
+
+
+LedKeyboard::KeyboardModel Animation::getModel() {
+	return m_model;
+}
+
+uint16_t Animation::getFrameRate() {
+	return m_frameRate;
+}
+
+bool Animation::isLooping() {
+	return m_isLooping;
+}
+
+size_t Animation::getKeyframeCount() {
+	return m_offsets.size();
+}
+
+chrono::nanoseconds Animation::getDuration() {
+	if (m_starts.empty()) return chrono::nanoseconds::zero();
+	return chrono::nanoseconds(m_starts.back() * 1000000000 / m_frameRate);
+}
+
+bool Animation::isDriven(uint8_t index) {
+	return index < LedKeyboard::keyCount && m_isDriven[index];
+}
+
+
+bool Animation::render(chrono::nanoseconds time, LedKeyboard::Color *colors) {
+	if (m_data == NULL) return false;
+	
+	uint64_t total = m_starts.back();
+	double position = time.count() * 1e-9 * m_frameRate;
+	bool isPlaying = true;
+	if (position < 0) position = 0;
+	if (position >= total) {
+		if (m_isLooping) position = fmod(position, total);
+		else {
+			position = total;
+			isPlaying = false;
+		}
+	}
+	
+	// Frames mostly move forward within a keyframe or to the next one
+	if (position < m_starts[m_index]) rewind();
+	while (m_index + 1 < m_offsets.size() && position >= m_starts[m_index + 1]) {
+		if (m_isNextReady) m_current = m_next;
+		else applyChanges(m_index + 1, m_current);
+		m_index++;
+		m_isNextReady = false;
+	}
+	
+	const uint8_t *keyframe = m_data + m_offsets[m_index];
+	bool isLast = m_index + 1 == m_offsets.size();
+	if (! isPlaying || static_cast<Interpolation>(keyframe[2]) == Interpolation::step || (isLast && ! m_isLooping)) {
+		kernels::fromFrame(m_current, colors);
+		return isPlaying;
+	}
+	
+	if (! m_isNextReady) {
+		// The first keyframe holds every key, so the state after the last is that one
+		m_next = m_current;
+		applyChanges(isLast ? 0 : m_index + 1, m_next);
+		m_isNextReady = true;
+	}
+	double amount = (position - m_starts[m_index]) / read16(keyframe);
+	kernels::lerp(m_current, m_next, static_cast<uint8_t>(amount * 255.0 + 0.5), m_blend);
+	kernels::fromFrame(m_blend, colors);
+	return true;
+}
+
+
+void Animation::applyChanges(size_t index, kernels::Frame &frame) {
+	const uint8_t *keyframe = m_data + m_offsets[index];
+	const uint8_t *change = keyframe + 4;
+	for (uint8_t i = 0; i < keyframe[3]; i++, change += 4) {
+		frame.red[change[0]] = change[1];
+		frame.green[change[0]] = change[2];
+		frame.blue[change[0]] = change[3];
+	}
+}
+
+void Animation::rewind() {
+	memset(&m_current, 0, sizeof(m_current));
+	applyChanges(0, m_current);
+	m_index = 0;
+	m_isNextReady = false;
+}
+
+
+bool Animation::save(const string &path, LedKeyboard::KeyboardModel model, uint16_t frameRate, bool isLooping,
+		     const vector<Keyframe> &keyframes) {
+	if (keyframes.empty() || frameRate == 0) {
+		errno = EINVAL;
+		return false;
+	}
+	
+	vector<uint8_t> data(magic, magic + sizeof(magic));
+	data.push_back(version);
+	data.push_back(static_cast<uint8_t>(model));
+	write16(data, LedKeyboard::keyCount);
+	write16(data, frameRate);
+	write16(data, isLooping ? loopFlag : 0);
+	write32(data, keyframes.size());
+	
+	// Keys are set for good once set, so the last keyframe knows them all
+	const bool *isDriven = keyframes.back().isSet;
+	for (size_t i = 0; i < keyframes.size(); i++) {
+		const Keyframe &keyframe = keyframes[i];
+		if (keyframe.ticks == 0) {
+			errno = EINVAL;
+			return false;
+		}
+		write16(data, keyframe.ticks);
+		data.push_back(static_cast<uint8_t>(keyframe.interpolation));
+		size_t countOffset = data.size();
+		data.push_back(0);
+		uint8_t count = 0;
+		for (uint8_t index = 0; index < LedKeyboard::keyCount; index++) {
+			if (! isDriven[index]) continue;
+			// Keys not set yet are black until they are
+			LedKeyboard::Color color = keyframe.isSet[index] ? keyframe.colors[index] : LedKeyboard::Color({ 0, 0, 0 });
+			if (i > 0) {
+				const Keyframe &previous = keyframes[i - 1];
+				LedKeyboard::Color before = previous.isSet[index] ? previous.colors[index] : LedKeyboard::Color({ 0, 0, 0 });
+				if (isSameColor(color, before)) continue;
+			}
+			data.push_back(index);
+			data.push_back(color.red);
+			data.push_back(color.green);
+			data.push_back(color.blue);
+			count++;
+		}
+		data[countOffset] = count;
+	}
+	
+	// As the other caches, replaced in one rename
+	string tmpPath = path + "." + to_string(getpid());
+	ofstream file(tmpPath, ios::binary | ios::trunc);
+	if (! file.is_open()) return false;
+	file.write(reinterpret_cast<const char*>(data.data()), data.size());
+	file.close();
+	if (file.fail() || rename(tmpPath.c_str(), path.c_str()) != 0) {
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,108 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANIMATION_CLASS
+#define ANIMATION_CLASS
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ColorKernels.h"
+#include "Keyboard.h"
+
+
+// Keyframe animations in the .g810a format, played straight from a read-only
+// mapping of the file. All fields are little endian:
+//
+//   header    "G81A", version (uint8, 1), model (uint8, KeyboardModel, 0 for
+//             any), key count (uint16, 128), frame rate (uint16, ticks per
+//             second), flags (uint16, 1 loops), keyframe count (uint32)
+//   keyframe  ticks until the next one (uint16, at least 1), interpolation
+//             (uint8, 0 holds, 1 fades to the next), change count (uint8),
+//             then index, red, green, blue for each key that changed
+//
+// The first keyframe lists every key the animation drives, the others only
+// what changed since the one before. Key indexes are the ones of -ps.
+class Animation {
+
+
+	public:
+
+		enum class Interpolation : uint8_t {
+			step,
+			linear
+		};
+
+		// Colors of every key, as the compiler builds them
+		struct Keyframe {
+			uint16_t ticks = 1;
+			Interpolation interpolation = Interpolation::step;
+			LedKeyboard::Color colors[LedKeyboard::keyCount] = {};
+			bool isSet[LedKeyboard::keyCount] = {}; // Set by this or an earlier keyframe
+		};
+
+
+		Animation();
+		~Animation();
+		Animation(const Animation&) = delete;
+		Animation &operator=(const Animation&) = delete;
+
+		bool open(const std::string &path);
+		void close();
+
+		LedKeyboard::KeyboardModel getModel();
+		uint16_t getFrameRate();
+		bool isLooping();
+		size_t getKeyframeCount();
+		std::chrono::nanoseconds getDuration(); // Of one pass
+		bool isDriven(uint8_t index);
+
+		// Colors at a time since the start, false once an animation that does
+		// not loop is over (colors then hold its last keyframe)
+		bool render(std::chrono::nanoseconds time, LedKeyboard::Color *colors);
+
+		static bool save(const std::string &path, LedKeyboard::KeyboardModel model, uint16_t frameRate,
+				 bool isLooping, const std::vector<Keyframe> &keyframes);
+
+
+	private:
+
+		static const size_t headerSize = 16;
+
+		const uint8_t *m_data = NULL;
+		size_t m_size = 0;
+		LedKeyboard::KeyboardModel m_model = LedKeyboard::KeyboardModel::unknown;
+		uint16_t m_frameRate = 0;
+		bool m_isLooping = false;
+		std::vector<uint32_t> m_offsets; // Of each keyframe in the file
+		std::vector<uint64_t> m_starts; // Tick each keyframe starts at, then the total
+		bool m_isDriven[LedKeyboard::keyCount] = {};
+
+		// State of keyframe m_index, and of the one after it once m_isNextReady
+		size_t m_index = 0;
+		kernels::Frame m_current;
+		kernels::Frame m_next;
+		kernels::Frame m_blend;
+		bool m_isNextReady = false;
+
+		void applyChanges(size_t index, kernels::Frame &frame);
+		void rewind();
+
+};
+
+#endif
@@ -0,0 +1,229 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Calibration.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+
+using namespace std;
+
+
+
+namespace {
+	
+	typedef LedKeyboard::KeyboardModel KeyboardModel;
+	
+	const char cacheMagic[8] = { 'g', '8', '1', '0', 'l', 'u', 't', 0x01 };
+	
+	// Names of the model lines, indexed like KeyboardModel
+	const char *modelNames[] = {
+		"all", "g213", "g410", "g413", "g512", "g513", "g610", "g810", "g815", "g910", "g915", "gpro"
+	};
+	
+	// One gamma or gain line, for every model or a single one
+	struct Line {
+		size_t model; // 0 for every model
+		bool isGamma;
+		double values[3];
+	};
+	
+	void applyLine(const Line &line, Calibration::Settings &settings) {
+		Calibration::Channel *channels[] = { &settings.red, &settings.green, &settings.blue };
+		for (int i = 0; i < 3; i++) {
+			if (line.isGamma) channels[i]->gamma = line.values[i];
+			else channels[i]->gain = line.values[i];
+		}
+	}
+	
+	void buildTable(const Calibration::Channel &channel, uint8_t *table) {
+		for (int i = 0; i < 256; i++) {
+			double value = 255.0 * channel.gain * pow(i / 255.0, channel.gamma) + 0.5;
+			table[i] = value > 255.0 ? 255 : static_cast<uint8_t>(value);
+		}
+	}
+	
+}
+
+
+Calibration::Calibration() : Calibration(Settings()) {}
+
+Calibration::Calibration(const Settings &settings) {
+	for (size_t i = 0; i < modelCount; i++) build(settings, m_tables[i]);
+}
+
+
+string Calibration::getDefaultCachePath() {
+	const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+	if (runtimeDir != NULL && runtimeDir[0] != '\0') return string(runtimeDir) + "/g810-led.lut";
+	return "/run/g810-led.lut";
+}
+
+
+bool Calibration::load(const string &path, const string &cachePath) {
+	m_errorLine = 0;
+	string key = getCacheKey(path);
+	if (key.empty()) return false;
+	if (loadCache(cachePath, key)) return true;
+	
+	ifstream file(path);
+	if (! file.is_open()) return false;
+	if (! parse(file)) return false;
+	saveCache(cachePath, key); // Only slower next time when it fails
+	return true;
+}
+
+bool Calibration::parse(istream &stream) {
+	// Lines before the first model line are for every model, a model
+	// section then only changes what it sets
+	vector<Line> lines;
+	size_t model = 0;
+	string text;
+	m_errorLine = 0;
+	while (getline(stream, text)) {
+		m_errorLine++;
+		size_t comment = text.find('#');
+		if (comment != string::npos) text.erase(comment);
+		
+		istringstream words(text);
+		string command;
+		if (! (words>>command)) continue;
+		
+		if (command == "model") {
+			string name, extra;
+			if (! (words>>name) || (words>>extra)) break;
+			for (model = 0; model < modelCount && name != modelNames[model]; model++);
+			if (model == modelCount) break;
+			continue;
+		}
+		
+		Line line = { model, command == "gamma", {} };
+		if (! line.isGamma && command != "gain") break;
+		size_t count = 0;
+		string value;
+		while (count < 4 && words>>value) {
+			char *end;
+			double number = strtod(value.c_str(), &end);
+			if (*end != '\0' || count == 3) { count = 4; break; }
+			// A gain above 1 would only clip the top of the range
+			if (line.isGamma ? ! (number > 0.0 && number <= 10.0) : ! (number >= 0.0 && number <= 1.0)) {
+				count = 4;
+				break;
+			}
+			line.values[count++] = number;
+		}
+		if (count == 1) line.values[1] = line.values[2] = line.values[0];
+		else if (count != 3) break;
+		lines.push_back(line);
+	}
+	if (! stream.eof()) {
+		errno = EINVAL;
+		return false;
+	}
+	m_errorLine = 0;
+	
+	Settings settings[modelCount];
+	for (size_t i = 0; i < lines.size(); i++)
+		if (lines[i].model == 0)
+			for (size_t j = 0; j < modelCount; j++) applyLine(lines[i], settings[j]);
+	for (size_t i = 0; i < lines.size(); i++)
+		if (lines[i].model != 0) applyLine(lines[i], settings[lines[i].model]);
+	for (size_t i = 0; i < modelCount; i++) build(settings[i], m_tables[i]);
+	return true;
+}
+
+size_t Calibration::getErrorLine() {
+	return m_errorLine;
+}
+
+
+const LedKeyboard::ColorTables &Calibration::getTables(KeyboardModel model) const {
+	size_t index = static_cast<size_t>(model);
+	return m_tables[index < modelCount ? index : 0];
+}
+
+void Calibration::build(const Settings &settings, LedKeyboard::ColorTables &tables) {
+	buildTable(settings.red, tables.red);
+	buildTable(settings.green, tables.green);
+	buildTable(settings.blue, tables.blue);
+}
+
+
+// The file as it is now, any edit changes its size or modification time
+string Calibration::getCacheKey(const string &path) {
+	struct stat status;
+	if (stat(path.c_str(), &status) != 0) return "";
+	char *realPath = realpath(path.c_str(), NULL);
+	if (realPath == NULL) return "";
+	ostringstream key;
+	key<<realPath<<'\n'<<status.st_dev<<' '<<status.st_ino<<' '<<status.st_size<<' '
+	   <<status.st_mtim.tv_sec<<' '<<status.st_mtim.tv_nsec;
+	free(realPath);
+	return key.str();
+}
+
+// magic, key size (uint32), key, model count (uint32), tables
+bool Calibration::loadCache(const string &cachePath, const string &key) {
+	ifstream file(cachePath, ios::binary);
+	if (! file.is_open()) return false;
+	
+	char magic[sizeof(cacheMagic)];
+	uint32_t keySize = 0, count = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&keySize), sizeof(keySize));
+	if (! file || memcmp(magic, cacheMagic, sizeof(magic)) != 0 || keySize != key.size()) return false;
+	
+	string storedKey(keySize, '\0');
+	file.read(&storedKey[0], keySize);
+	file.read(reinterpret_cast<char*>(&count), sizeof(count));
+	if (! file || storedKey != key || count != modelCount) return false;
+	
+	LedKeyboard::ColorTables tables[modelCount];
+	file.read(reinterpret_cast<char*>(tables), sizeof(tables));
+	if (! file) return false;
+	memcpy(m_tables, tables, sizeof(tables));
+	return true;
+}
+
+bool Calibration::saveCache(const string &cachePath, const string &key) {
+	// Write a new file and rename it over the old one, as the device cache does
+	string tmpPath = cachePath + "." + to_string(getpid());
+	ofstream file(tmpPath, ios::binary | ios::trunc);
+	if (! file.is_open()) return false;
+	
+	uint32_t keySize = key.size(), count = modelCount;
+	file.write(cacheMagic, sizeof(cacheMagic));
+	file.write(reinterpret_cast<const char*>(&keySize), sizeof(keySize));
+	file.write(key.data(), keySize);
+	file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+	file.write(reinterpret_cast<const char*>(m_tables), sizeof(m_tables));
+	file.close();
+	
+	if (file.fail() || rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
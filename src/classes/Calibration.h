@@ -0,0 +1,78 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CALIBRATION_CLASS
+#define CALIBRATION_CLASS
+
+#include <cstdint>
+#include <istream>
+#include <string>
+
+#include "Keyboard.h"
+
+
+// Gamma curve and white balance of the LEDs of each model, compiled into a
+// lookup table per channel. The tables of every model are kept in a binary
+// cache, so that a calibration file is only parsed again once it changed.
+class Calibration {
+
+
+	public:
+
+		// out = 255 * gain * (in / 255) ^ gamma
+		struct Channel {
+			double gamma = 1.0;
+			double gain = 1.0;
+		};
+		struct Settings {
+			Channel red;
+			Channel green;
+			Channel blue;
+		};
+
+
+		Calibration(); // Colors stay as they are
+		// The same settings for every model
+		Calibration(const Settings &settings);
+
+		// $XDG_RUNTIME_DIR/g810-led.lut, or /run/g810-led.lut without a session
+		static std::string getDefaultCachePath();
+
+		// Reads the tables from the cache when they were built from the file as
+		// it is now, parses the file and refreshes the cache otherwise
+		bool load(const std::string &path, const std::string &cachePath = getDefaultCachePath());
+		bool parse(std::istream &stream);
+		size_t getErrorLine(); // Line parse stopped at, 0 when the file could not be read
+
+		const LedKeyboard::ColorTables &getTables(LedKeyboard::KeyboardModel model) const;
+
+		static void build(const Settings &settings, LedKeyboard::ColorTables &tables);
+
+
+	private:
+
+		static const size_t modelCount = static_cast<size_t>(LedKeyboard::KeyboardModel::gpro) + 1;
+
+		LedKeyboard::ColorTables m_tables[modelCount];
+		size_t m_errorLine = 0;
+
+		std::string getCacheKey(const std::string &path);
+		bool loadCache(const std::string &cachePath, const std::string &key);
+		bool saveCache(const std::string &cachePath, const std::string &key);
+
+};
+
+#endif
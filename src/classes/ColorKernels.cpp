@@ -0,0 +1,361 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ColorKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <immintrin.h>
+	#define X86_KERNELS
+#endif
+
+
+namespace kernels {
+	
+	namespace {
+		
+		const size_t frameSize = 3 * LedKeyboard::keyCount;
+		const size_t keyCount = LedKeyboard::keyCount;
+		
+		// Each kernel works on byte runs of a size a multiple of 32
+		struct Kernels {
+			void (*scale)(uint8_t *data, size_t size, uint8_t factor);
+			void (*lerp)(const uint8_t *from, const uint8_t *to, uint8_t *out, size_t size, uint8_t amount);
+			void (*add)(uint8_t *data, const uint8_t *other, size_t size);
+			void (*blend)(uint8_t *data, const uint8_t *other, const uint8_t *alpha, size_t size);
+			void (*saturate)(uint8_t *red, uint8_t *green, uint8_t *blue, size_t size, uint16_t amount);
+		};
+		
+		// x / 255 rounded, exact for any product of two 8 bit values
+		inline uint16_t divide255(uint16_t x) {
+			x += 0x80;
+			return (x + (x >> 8)) >> 8;
+		}
+		
+		inline uint8_t clamp(int value) {
+			return value < 0 ? 0 : value > 0xff ? 0xff : value;
+		}
+		
+		
+		void scaleScalar(uint8_t *data, size_t size, uint8_t factor) {
+			for (size_t i = 0; i < size; i++) data[i] = divide255(data[i] * factor);
+		}
+		
+		void lerpScalar(const uint8_t *from, const uint8_t *to, uint8_t *out, size_t size, uint8_t amount) {
+			for (size_t i = 0; i < size; i++) out[i] = divide255(from[i] * (0xff - amount) + to[i] * amount);
+		}
+		
+		void addScalar(uint8_t *data, const uint8_t *other, size_t size) {
+			for (size_t i = 0; i < size; i++) data[i] = clamp(data[i] + other[i]);
+		}
+		
+		void blendScalar(uint8_t *data, const uint8_t *other, const uint8_t *alpha, size_t size) {
+			for (size_t i = 0; i < size; i++) data[i] = divide255(data[i] * (0xff - alpha[i]) + other[i] * alpha[i]);
+		}
+		
+		// Rounded the way the SIMD versions do, gray by the Rec. 601 weights
+		void saturateScalar(uint8_t *red, uint8_t *green, uint8_t *blue, size_t size, uint16_t amount) {
+			for (size_t i = 0; i < size; i++) {
+				int gray = (77 * red[i] + 150 * green[i] + 29 * blue[i] + 0x80) >> 8;
+				red[i] = clamp(gray + (((red[i] - gray) * amount) >> 8));
+				green[i] = clamp(gray + (((green[i] - gray) * amount) >> 8));
+				blue[i] = clamp(gray + (((blue[i] - gray) * amount) >> 8));
+			}
+		}
+		
+		const Kernels scalarKernels = { scaleScalar, lerpScalar, addScalar, blendScalar, saturateScalar };
+		
+		
+#ifdef X86_KERNELS
+		
+		// Same as divide255 on 16 bit lanes
+		__attribute__((target("sse2"))) inline __m128i divide255(__m128i x) {
+			x = _mm_add_epi16(x, _mm_set1_epi16(0x80));
+			return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+		}
+		
+		__attribute__((target("sse2"))) void scaleSse2(uint8_t *data, size_t size, uint8_t factor) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i factors = _mm_set1_epi16(factor);
+			for (size_t i = 0; i < size; i += 16) {
+				__m128i x = _mm_load_si128((const __m128i*)(data + i));
+				__m128i low = divide255(_mm_mullo_epi16(_mm_unpacklo_epi8(x, zero), factors));
+				__m128i high = divide255(_mm_mullo_epi16(_mm_unpackhi_epi8(x, zero), factors));
+				_mm_store_si128((__m128i*)(data + i), _mm_packus_epi16(low, high));
+			}
+		}
+		
+		// a * (255 - weight) + b * weight, divided by 255, on 16 bit lanes
+		__attribute__((target("sse2"))) inline __m128i mix(__m128i a, __m128i b, __m128i weight) {
+			__m128i inverse = _mm_sub_epi16(_mm_set1_epi16(0xff), weight);
+			return divide255(_mm_add_epi16(_mm_mullo_epi16(a, inverse), _mm_mullo_epi16(b, weight)));
+		}
+		
+		__attribute__((target("sse2"))) void lerpSse2(const uint8_t *from, const uint8_t *to, uint8_t *out, size_t size,
+							       uint8_t amount) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i weight = _mm_set1_epi16(amount);
+			for (size_t i = 0; i < size; i += 16) {
+				__m128i a = _mm_load_si128((const __m128i*)(from + i));
+				__m128i b = _mm_load_si128((const __m128i*)(to + i));
+				__m128i low = mix(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), weight);
+				__m128i high = mix(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), weight);
+				_mm_store_si128((__m128i*)(out + i), _mm_packus_epi16(low, high));
+			}
+		}
+		
+		__attribute__((target("sse2"))) void addSse2(uint8_t *data, const uint8_t *other, size_t size) {
+			for (size_t i = 0; i < size; i += 16) {
+				__m128i sum = _mm_adds_epu8(_mm_load_si128((const __m128i*)(data + i)),
+							    _mm_load_si128((const __m128i*)(other + i)));
+				_mm_store_si128((__m128i*)(data + i), sum);
+			}
+		}
+		
+		__attribute__((target("sse2"))) void blendSse2(uint8_t *data, const uint8_t *other, const uint8_t *alpha,
+								size_t size) {
+			const __m128i zero = _mm_setzero_si128();
+			for (size_t i = 0; i < size; i += 16) {
+				__m128i a = _mm_load_si128((const __m128i*)(data + i));
+				__m128i b = _mm_load_si128((const __m128i*)(other + i));
+				__m128i weight = _mm_load_si128((const __m128i*)(alpha + i));
+				__m128i low = mix(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(weight, zero));
+				__m128i high = mix(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(weight, zero));
+				_mm_store_si128((__m128i*)(data + i), _mm_packus_epi16(low, high));
+			}
+		}
+		
+		// gray + (c - gray) * amount / 256 on 16 bit lanes, through mulhi so that it fits
+		__attribute__((target("sse2"))) inline __m128i away(__m128i c, __m128i gray, __m128i amount) {
+			return _mm_add_epi16(gray, _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(c, gray), 7), amount));
+		}
+		
+		__attribute__((target("sse2"))) void saturateHalf(__m128i &r, __m128i &g, __m128i &b, __m128i amount) {
+			__m128i gray = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(77)),
+								   _mm_mullo_epi16(g, _mm_set1_epi16(150))),
+						     _mm_add_epi16(_mm_mullo_epi16(b, _mm_set1_epi16(29)), _mm_set1_epi16(0x80)));
+			gray = _mm_srli_epi16(gray, 8);
+			r = away(r, gray, amount);
+			g = away(g, gray, amount);
+			b = away(b, gray, amount);
+		}
+		
+		__attribute__((target("sse2"))) void saturateSse2(uint8_t *red, uint8_t *green, uint8_t *blue, size_t size,
+								   uint16_t amount) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i amounts = _mm_set1_epi16(amount << 1);
+			for (size_t i = 0; i < size; i += 16) {
+				__m128i r = _mm_load_si128((const __m128i*)(red + i));
+				__m128i g = _mm_load_si128((const __m128i*)(green + i));
+				__m128i b = _mm_load_si128((const __m128i*)(blue + i));
+				__m128i rLow = _mm_unpacklo_epi8(r, zero), rHigh = _mm_unpackhi_epi8(r, zero);
+				__m128i gLow = _mm_unpacklo_epi8(g, zero), gHigh = _mm_unpackhi_epi8(g, zero);
+				__m128i bLow = _mm_unpacklo_epi8(b, zero), bHigh = _mm_unpackhi_epi8(b, zero);
+				saturateHalf(rLow, gLow, bLow, amounts);
+				saturateHalf(rHigh, gHigh, bHigh, amounts);
+				_mm_store_si128((__m128i*)(red + i), _mm_packus_epi16(rLow, rHigh));
+				_mm_store_si128((__m128i*)(green + i), _mm_packus_epi16(gLow, gHigh));
+				_mm_store_si128((__m128i*)(blue + i), _mm_packus_epi16(bLow, bHigh));
+			}
+		}
+		
+		const Kernels sse2Kernels = { scaleSse2, lerpSse2, addSse2, blendSse2, saturateSse2 };
+		
+		
+		// The AVX2 versions unpack and pack within each 128 bit lane, which keeps the byte order
+		__attribute__((target("avx2"))) inline __m256i divide255(__m256i x) {
+			x = _mm256_add_epi16(x, _mm256_set1_epi16(0x80));
+			return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+		}
+		
+		__attribute__((target("avx2"))) void scaleAvx2(uint8_t *data, size_t size, uint8_t factor) {
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i factors = _mm256_set1_epi16(factor);
+			for (size_t i = 0; i < size; i += 32) {
+				__m256i x = _mm256_load_si256((const __m256i*)(data + i));
+				__m256i low = divide255(_mm256_mullo_epi16(_mm256_unpacklo_epi8(x, zero), factors));
+				__m256i high = divide255(_mm256_mullo_epi16(_mm256_unpackhi_epi8(x, zero), factors));
+				_mm256_store_si256((__m256i*)(data + i), _mm256_packus_epi16(low, high));
+			}
+		}
+		
+		__attribute__((target("avx2"))) inline __m256i mix(__m256i a, __m256i b, __m256i weight) {
+			__m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(0xff), weight);
+			return divide255(_mm256_add_epi16(_mm256_mullo_epi16(a, inverse), _mm256_mullo_epi16(b, weight)));
+		}
+		
+		__attribute__((target("avx2"))) void lerpAvx2(const uint8_t *from, const uint8_t *to, uint8_t *out, size_t size,
+							       uint8_t amount) {
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i weight = _mm256_set1_epi16(amount);
+			for (size_t i = 0; i < size; i += 32) {
+				__m256i a = _mm256_load_si256((const __m256i*)(from + i));
+				__m256i b = _mm256_load_si256((const __m256i*)(to + i));
+				__m256i low = mix(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), weight);
+				__m256i high = mix(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), weight);
+				_mm256_store_si256((__m256i*)(out + i), _mm256_packus_epi16(low, high));
+			}
+		}
+		
+		__attribute__((target("avx2"))) void addAvx2(uint8_t *data, const uint8_t *other, size_t size) {
+			for (size_t i = 0; i < size; i += 32) {
+				__m256i sum = _mm256_adds_epu8(_mm256_load_si256((const __m256i*)(data + i)),
+							       _mm256_load_si256((const __m256i*)(other + i)));
+				_mm256_store_si256((__m256i*)(data + i), sum);
+			}
+		}
+		
+		__attribute__((target("avx2"))) void blendAvx2(uint8_t *data, const uint8_t *other, const uint8_t *alpha,
+								size_t size) {
+			const __m256i zero = _mm256_setzero_si256();
+			for (size_t i = 0; i < size; i += 32) {
+				__m256i a = _mm256_load_si256((const __m256i*)(data + i));
+				__m256i b = _mm256_load_si256((const __m256i*)(other + i));
+				__m256i weight = _mm256_load_si256((const __m256i*)(alpha + i));
+				__m256i low = mix(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero),
+						  _mm256_unpacklo_epi8(weight, zero));
+				__m256i high = mix(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero),
+						   _mm256_unpackhi_epi8(weight, zero));
+				_mm256_store_si256((__m256i*)(data + i), _mm256_packus_epi16(low, high));
+			}
+		}
+		
+		__attribute__((target("avx2"))) inline __m256i away(__m256i c, __m256i gray, __m256i amount) {
+			return _mm256_add_epi16(gray, _mm256_mulhi_epi16(_mm256_slli_epi16(_mm256_sub_epi16(c, gray), 7), amount));
+		}
+		
+		__attribute__((target("avx2"))) void saturateHalf(__m256i &r, __m256i &g, __m256i &b, __m256i amount) {
+			__m256i gray = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(77)),
+									 _mm256_mullo_epi16(g, _mm256_set1_epi16(150))),
+							_mm256_add_epi16(_mm256_mullo_epi16(b, _mm256_set1_epi16(29)),
+									 _mm256_set1_epi16(0x80)));
+			gray = _mm256_srli_epi16(gray, 8);
+			r = away(r, gray, amount);
+			g = away(g, gray, amount);
+			b = away(b, gray, amount);
+		}
+		
+		__attribute__((target("avx2"))) void saturateAvx2(uint8_t *red, uint8_t *green, uint8_t *blue, size_t size,
+								   uint16_t amount) {
+			const __m256i zero = _mm256_setzero_si256();
+			const __m256i amounts = _mm256_set1_epi16(amount << 1);
+			for (size_t i = 0; i < size; i += 32) {
+				__m256i r = _mm256_load_si256((const __m256i*)(red + i));
+				__m256i g = _mm256_load_si256((const __m256i*)(green + i));
+				__m256i b = _mm256_load_si256((const __m256i*)(blue + i));
+				__m256i rLow = _mm256_unpacklo_epi8(r, zero), rHigh = _mm256_unpackhi_epi8(r, zero);
+				__m256i gLow = _mm256_unpacklo_epi8(g, zero), gHigh = _mm256_unpackhi_epi8(g, zero);
+				__m256i bLow = _mm256_unpacklo_epi8(b, zero), bHigh = _mm256_unpackhi_epi8(b, zero);
+				saturateHalf(rLow, gLow, bLow, amounts);
+				saturateHalf(rHigh, gHigh, bHigh, amounts);
+				_mm256_store_si256((__m256i*)(red + i), _mm256_packus_epi16(rLow, rHigh));
+				_mm256_store_si256((__m256i*)(green + i), _mm256_packus_epi16(gLow, gHigh));
+				_mm256_store_si256((__m256i*)(blue + i), _mm256_packus_epi16(bLow, bHigh));
+			}
+		}
+		
+		const Kernels avx2Kernels = { scaleAvx2, lerpAvx2, addAvx2, blendAvx2, saturateAvx2 };
+		
+#endif
+		
+		Isa getBestIsa() {
+#ifdef X86_KERNELS
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx2")) return Isa::avx2;
+			if (__builtin_cpu_supports("sse2")) return Isa::sse2;
+#endif
+			return Isa::scalar;
+		}
+		
+		const Isa bestIsa = getBestIsa();
+		Isa currentIsa = bestIsa;
+		
+		const Kernels &getKernels() {
+#ifdef X86_KERNELS
+			if (currentIsa == Isa::avx2) return avx2Kernels;
+			if (currentIsa == Isa::sse2) return sse2Kernels;
+#endif
+			return scalarKernels;
+		}
+		
+	}
+	
+	
+	Isa getIsa() {
+		return currentIsa;
+	}
+	
+	void setIsa(Isa isa) {
+		currentIsa = static_cast<uint8_t>(isa) <= static_cast<uint8_t>(bestIsa) ? isa : bestIsa;
+	}
+	
+	const char *getIsaName(Isa isa) {
+		switch (isa) {
+			case Isa::sse2: return "sse2";
+			case Isa::avx2: return "avx2";
+			default: return "scalar";
+		}
+	}
+	
+	
+	void toFrame(const LedKeyboard::Color *colors, Frame &frame) {
+		for (size_t i = 0; i < keyCount; i++) {
+			frame.red[i] = colors[i].red;
+			frame.green[i] = colors[i].green;
+			frame.blue[i] = colors[i].blue;
+		}
+	}
+	
+	void fromFrame(const Frame &frame, LedKeyboard::Color *colors) {
+		for (size_t i = 0; i < keyCount; i++) colors[i] = { frame.red[i], frame.green[i], frame.blue[i] };
+	}
+	
+	
+	void scale(Frame &frame, uint8_t factor) {
+		getKernels().scale(frame.red, frameSize, factor);
+	}
+	
+	void applyLut(Frame &frame, const uint8_t *redLut, const uint8_t *greenLut, const uint8_t *blueLut) {
+		for (size_t i = 0; i < keyCount; i++) {
+			frame.red[i] = redLut[frame.red[i]];
+			frame.green[i] = greenLut[frame.green[i]];
+			frame.blue[i] = blueLut[frame.blue[i]];
+		}
+	}
+	
+	void lerp(const Frame &from, const Frame &to, uint8_t amount, Frame &out) {
+		getKernels().lerp(from.red, to.red, out.red, frameSize, amount);
+	}
+	
+	void add(Frame &frame, const Frame &other) {
+		getKernels().add(frame.red, other.red, frameSize);
+	}
+	
+	void blend(Frame &frame, const Frame &other, const uint8_t *alpha) {
+		// Alpha is per key, the same for every channel
+		const Kernels &kernels = getKernels();
+		alignas(32) uint8_t alignedAlpha[keyCount];
+		for (size_t i = 0; i < keyCount; i++) alignedAlpha[i] = alpha[i];
+		kernels.blend(frame.red, other.red, alignedAlpha, keyCount);
+		kernels.blend(frame.green, other.green, alignedAlpha, keyCount);
+		kernels.blend(frame.blue, other.blue, alignedAlpha, keyCount);
+	}
+	
+	void saturate(Frame &frame, uint16_t amount) {
+		if (amount > 512) amount = 512;
+		getKernels().saturate(frame.red, frame.green, frame.blue, keyCount, amount);
+	}
+	
+}
@@ -0,0 +1,66 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COLORKERNELS_CLASS
+#define COLORKERNELS_CLASS
+
+#include <cstdint>
+
+#include "Keyboard.h"
+
+
+// Color math over whole frames, with SSE2 and AVX2 versions picked at run
+// time and a scalar one for other CPUs. Every version gives the same bytes.
+namespace kernels {
+	
+	// One array per channel indexed like the keys, the three of them in a row
+	// so that a kernel treating each byte alike runs over the whole frame at once
+	struct Frame {
+		alignas(32) uint8_t red[LedKeyboard::keyCount];
+		uint8_t green[LedKeyboard::keyCount];
+		uint8_t blue[LedKeyboard::keyCount];
+	};
+	
+	enum class Isa : uint8_t {
+		scalar,
+		sse2,
+		avx2
+	};
+	
+	Isa getIsa();
+	// For comparing the versions, falls back to the best one the CPU has
+	void setIsa(Isa isa);
+	const char *getIsaName(Isa isa);
+	
+	void toFrame(const LedKeyboard::Color *colors, Frame &frame);
+	void fromFrame(const Frame &frame, LedKeyboard::Color *colors);
+	
+	// x * factor / 255, rounded
+	void scale(Frame &frame, uint8_t factor);
+	// lut has 256 entries, lookups stay scalar since bytes can not be gathered
+	void applyLut(Frame &frame, const uint8_t *redLut, const uint8_t *greenLut, const uint8_t *blueLut);
+	// from at 0, to at 255
+	void lerp(const Frame &from, const Frame &to, uint8_t amount, Frame &out);
+	// Saturating
+	void add(Frame &frame, const Frame &other);
+	// other over frame, alpha indexed like the keys
+	void blend(Frame &frame, const Frame &other, const uint8_t *alpha);
+	// 0 is gray, 256 leaves the colors as they are and up to 512 makes them stronger
+	void saturate(Frame &frame, uint16_t amount);
+	
+}
+
+#endif
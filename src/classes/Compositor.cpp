@@ -0,0 +1,155 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Compositor.h"
+
+#include <algorithm>
+
+#include "ColorKernels.h"
+
+
+using namespace std;
+
+
+namespace {
+	
+	// The kernels load whole aligned rows, which a layer on the heap does not
+	// promise under C++14, so its colors go through a frame on the stack
+	void blend(kernels::Frame &frame, const Compositor::Layer &layer) {
+		kernels::Frame colors;
+		copy(layer.red, layer.red + LedKeyboard::keyCount, colors.red);
+		copy(layer.green, layer.green + LedKeyboard::keyCount, colors.green);
+		copy(layer.blue, layer.blue + LedKeyboard::keyCount, colors.blue);
+		kernels::blend(frame, colors, layer.alpha);
+	}
+	
+}
+
+
+Compositor::Compositor(LedKeyboard &keyboard) : m_keyboard(keyboard) {}
+
+
+Compositor::Layer *Compositor::getLayer(const string &name, uint8_t priority) {
+	map<string, Layer>::iterator layer = m_layers.find(name);
+	if (layer == m_layers.end()) {
+		layer = m_layers.emplace(name, Layer()).first;
+		layer->second.priority = priority;
+		sortLayers();
+	} else if (layer->second.priority != priority) {
+		layer->second.priority = priority;
+		sortLayers();
+	}
+	return &layer->second;
+}
+
+bool Compositor::removeLayer(const string &name) {
+	if (m_layers.erase(name) == 0) return false;
+	sortLayers();
+	return true;
+}
+
+size_t Compositor::getLayerCount() {
+	return m_layers.size();
+}
+
+void Compositor::sortLayers() {
+	m_order.clear();
+	for (map<string, Layer>::iterator layer = m_layers.begin(); layer != m_layers.end(); layer++)
+		m_order.push_back(&layer->second);
+	// Equal priorities stay in name order
+	stable_sort(m_order.begin(), m_order.end(), [](const Layer *a, const Layer *b) {
+		return a->priority < b->priority;
+	});
+}
+
+
+void Compositor::setKey(Layer &layer, LedKeyboard::Key key, LedKeyboard::Color color, uint8_t alpha) {
+	uint8_t index = LedKeyboard::getKeyIndex(key);
+	if (index >= LedKeyboard::keyCount) return;
+	layer.red[index] = color.red;
+	layer.green[index] = color.green;
+	layer.blue[index] = color.blue;
+	layer.alpha[index] = alpha;
+}
+
+void Compositor::setKeys(Layer &layer, const LedKeyboard::KeyArray &keys, LedKeyboard::Color color, uint8_t alpha) {
+	for (size_t i = 0; i < keys.size(); i++) setKey(layer, keys[i], color, alpha);
+}
+
+void Compositor::setAllKeys(Layer &layer, LedKeyboard::Color color, uint8_t alpha) {
+	fill(layer.red, layer.red + LedKeyboard::keyCount, color.red);
+	fill(layer.green, layer.green + LedKeyboard::keyCount, color.green);
+	fill(layer.blue, layer.blue + LedKeyboard::keyCount, color.blue);
+	fill(layer.alpha, layer.alpha + LedKeyboard::keyCount, alpha);
+}
+
+
+void Compositor::setBase(LedKeyboard::Key key, LedKeyboard::Color color) {
+	setKey(m_base, key, color);
+	uint8_t index = LedKeyboard::getKeyIndex(key);
+	if (index >= LedKeyboard::keyCount || ! m_layers.empty()) return;
+	// Without layers the caller sends it straight away
+	m_red[index] = color.red;
+	m_green[index] = color.green;
+	m_blue[index] = color.blue;
+	m_isShown[index] = true;
+}
+
+void Compositor::setBase(const LedKeyboard::KeyArray &keys, LedKeyboard::Color color) {
+	for (size_t i = 0; i < keys.size(); i++) setBase(keys[i], color);
+}
+
+void Compositor::setBase(LedKeyboard::Color color) {
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) setBase(LedKeyboard::getKey(i), color);
+}
+
+
+bool Compositor::apply(bool commit) {
+	const uint8_t keyCount = LedKeyboard::keyCount;
+	kernels::Frame frame = {};
+	uint8_t coverage[keyCount];
+	
+	copy(m_base.alpha, m_base.alpha + keyCount, coverage);
+	blend(frame, m_base);
+	for (size_t l = 0; l < m_order.size(); l++) {
+		const Layer &layer = *m_order[l];
+		for (uint8_t i = 0; i < keyCount; i++) coverage[i] |= layer.alpha[i];
+		blend(frame, layer);
+	}
+	
+	// Only what changed, a key nothing covers any more goes off
+	LedKeyboard::KeyValue keyValues[keyCount];
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < keyCount; i++) {
+		if (coverage[i] == 0 && ! m_isShown[i]) continue;
+		if (m_isShown[i] && m_red[i] == frame.red[i] && m_green[i] == frame.green[i] && m_blue[i] == frame.blue[i])
+			continue;
+		m_red[i] = frame.red[i];
+		m_green[i] = frame.green[i];
+		m_blue[i] = frame.blue[i];
+		m_isShown[i] = coverage[i] != 0;
+		keyValues[count++] = { LedKeyboard::getKey(i), { m_red[i], m_green[i], m_blue[i] } };
+	}
+	
+	bool retval = true;
+	if (count > 0 && ! m_keyboard.setKeys(keyValues, count)) {
+		// Unknown what made it, send them all again next time
+		fill(m_isShown, m_isShown + keyCount, false);
+		retval = false;
+	}
+	if (commit && ! m_keyboard.commit()) retval = false;
+	return retval;
+}
@@ -0,0 +1,90 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMPOSITOR_CLASS
+#define COMPOSITOR_CLASS
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Keyboard.h"
+
+
+// Blends the layers of several clients into the colors of one keyboard. Each
+// layer holds a color and an alpha for every key index, layers with a higher
+// priority go on top. Under all of them lies the base, what plain commands
+// set. Blending always covers every key index, so it costs the same whatever
+// a client changed, and only the keys whose blended color changed are sent.
+//
+// Keys that neither a layer nor the base covers are left as they are, until
+// a layer that covered them goes away and turns them off.
+class Compositor {
+
+
+	public:
+
+		struct Layer {
+			uint8_t priority = 0;
+			// One array per channel, like a kernels::Frame
+			uint8_t red[LedKeyboard::keyCount] = {};
+			uint8_t green[LedKeyboard::keyCount] = {};
+			uint8_t blue[LedKeyboard::keyCount] = {};
+			uint8_t alpha[LedKeyboard::keyCount] = {};
+		};
+
+
+		Compositor(LedKeyboard &keyboard);
+
+		// Creates the layer on first use, a new priority moves it
+		Layer *getLayer(const std::string &name, uint8_t priority);
+		bool removeLayer(const std::string &name);
+		size_t getLayerCount();
+
+		static void setKey(Layer &layer, LedKeyboard::Key key, LedKeyboard::Color color, uint8_t alpha = 0xff);
+		static void setKeys(Layer &layer, const LedKeyboard::KeyArray &keys, LedKeyboard::Color color,
+				    uint8_t alpha = 0xff);
+		static void setAllKeys(Layer &layer, LedKeyboard::Color color, uint8_t alpha = 0xff);
+
+		// What plain commands set. While there are no layers the caller sends it
+		// to the keyboard itself, after that only apply() does
+		void setBase(LedKeyboard::Key key, LedKeyboard::Color color);
+		void setBase(const LedKeyboard::KeyArray &keys, LedKeyboard::Color color);
+		void setBase(LedKeyboard::Color color);
+
+		// Blends the layers and sends the keys whose color changed
+		bool apply(bool commit = true);
+
+
+	private:
+
+		LedKeyboard &m_keyboard;
+		Layer m_base; // Opaque where set
+		std::map<std::string, Layer> m_layers;
+		std::vector<const Layer*> m_order; // Bottom to top
+
+		// What the keyboard shows for the keys the compositor wrote
+		uint8_t m_red[LedKeyboard::keyCount] = {};
+		uint8_t m_green[LedKeyboard::keyCount] = {};
+		uint8_t m_blue[LedKeyboard::keyCount] = {};
+		bool m_isShown[LedKeyboard::keyCount] = {};
+
+		void sortLayers();
+
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "DeviceCache.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+
+namespace {
+
+	// Fields are tab separated, so strings coming from the device must not break a line
+	string sanitize(string value) {
+		for (size_t i = 0; i < value.size(); i++)
+			if (value[i] == '\t' || value[i] == '\n' || value[i] == '\r') value[i] = ' ';
+		return value;
+	}
+
+	bool isSameDevice(const DeviceCache::Entry &a, const DeviceCache::Entry &b) {
+		if (a.transport != b.transport) return false;
+		if (a.device.path == b.device.path) return true;
+		return a.device.vendorID == b.device.vendorID &&
+		       a.device.productID == b.device.productID &&
+		       a.device.serialNumber == b.device.serialNumber;
+	}
+
+}
+
+
+DeviceCache::DeviceCache() : m_path(getDefaultPath()) {}
+
+DeviceCache::DeviceCache(const string &path) : m_path(path) {}
+
+
+string DeviceCache::getDefaultPath() {
+	const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+	if (runtimeDir != NULL && runtimeDir[0] != '\0') return string(runtimeDir) + "/g810-led.cache";
+	return "/run/g810-led.cache";
+}
+
+string DeviceCache::getPath() {
+	return m_path;
+}
+
+
+bool DeviceCache::lookup(const string &transport, uint16_t vendorID, uint16_t productID,
+			 const string &serial, Entry &entry) {
+	vector<Entry> entries = load();
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].transport != transport) continue;
+		if (vendorID != 0x0 && entries[i].device.vendorID != vendorID) continue;
+		if (productID != 0x0 && entries[i].device.productID != productID) continue;
+		if (! serial.empty() && entries[i].device.serialNumber != serial) continue;
+		entry = entries[i];
+		return true;
+	}
+	return false;
+}
+
+bool DeviceCache::store(const Entry &entry) {
+	vector<Entry> entries = load();
+	if (! entries.empty() && isSameDevice(entries[0], entry) &&
+	    entries[0].device.path == entry.device.path &&
+	    entries[0].device.interfaceNumber == entry.device.interfaceNumber &&
+	    entries[0].model == entry.model) return true; // Nothing changed, skip the write
+	
+	vector<Entry> updated = { entry };
+	for (size_t i = 0; i < entries.size() && updated.size() < maxEntries; i++)
+		if (! isSameDevice(entries[i], entry)) updated.push_back(entries[i]);
+	return save(updated);
+}
+
+bool DeviceCache::remove(const Entry &entry) {
+	vector<Entry> entries = load();
+	vector<Entry> updated;
+	for (size_t i = 0; i < entries.size(); i++)
+		if (! isSameDevice(entries[i], entry)) updated.push_back(entries[i]);
+	if (updated.size() == entries.size()) return true;
+	return save(updated);
+}
+
+
+vector<DeviceCache::Entry> DeviceCache::load() {
+	vector<Entry> entries;
+	ifstream file(m_path);
+	if (! file.is_open()) return entries;
+	
+	// transport vid pid interface model path serial manufacturer product
+	string line;
+	while (getline(file, line)) {
+		vector<string> fields;
+		size_t start = 0, end;
+		while ((end = line.find('\t', start)) != string::npos) {
+			fields.push_back(line.substr(start, end - start));
+			start = end + 1;
+		}
+		fields.push_back(line.substr(start));
+		if (fields.size() != 9) continue;
+		
+		Entry entry;
+		try {
+			entry.transport = fields[0];
+			entry.device.vendorID = stoul(fields[1], nullptr, 16);
+			entry.device.productID = stoul(fields[2], nullptr, 16);
+			entry.device.interfaceNumber = stoul(fields[3], nullptr, 16);
+			entry.model = stoul(fields[4], nullptr, 16);
+		} catch (...) {
+			continue;
+		}
+		entry.device.path = fields[5];
+		entry.device.serialNumber = fields[6];
+		entry.device.manufacturer = fields[7];
+		entry.device.product = fields[8];
+		entries.push_back(entry);
+	}
+	
+	return entries;
+}
+
+bool DeviceCache::save(const vector<Entry> &entries) {
+	// Write a new file and rename it over the old one, so that a concurrent
+	// reader never sees half an entry
+	string tmpPath = m_path + "." + to_string(getpid());
+	ofstream file(tmpPath, ios::trunc);
+	if (! file.is_open()) return false;
+	
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry &entry = entries[i];
+		file<<sanitize(entry.transport)<<'\t'
+		    <<hex<<entry.device.vendorID<<'\t'
+		    <<entry.device.productID<<'\t'
+		    <<entry.device.interfaceNumber<<'\t'
+		    <<entry.model<<dec<<'\t'
+		    <<sanitize(entry.device.path)<<'\t'
+		    <<sanitize(entry.device.serialNumber)<<'\t'
+		    <<sanitize(entry.device.manufacturer)<<'\t'
+		    <<sanitize(entry.device.product)<<'\n';
+	}
+	file.close();
+	
+	if (file.fail() || rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+		unlink(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
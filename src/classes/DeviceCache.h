@@ -0,0 +1,67 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DEVICECACHE_CLASS
+#define DEVICECACHE_CLASS
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Transport.h"
+
+
+// Remembers where the keyboards were found last time, so that opening one
+// does not have to enumerate every USB device. Entries are only hints, the
+// transport validates them before use.
+class DeviceCache {
+
+
+	public:
+
+		struct Entry {
+			std::string transport;
+			uint16_t model = 0;
+			LedTransport::Device device;
+		};
+
+
+		DeviceCache();
+		DeviceCache(const std::string &path);
+
+		// $XDG_RUNTIME_DIR/g810-led.cache, or /run/g810-led.cache without a session
+		static std::string getDefaultPath();
+		std::string getPath();
+
+		// Most recently stored entry matching the IDs, 0 and "" match anything
+		bool lookup(const std::string &transport, uint16_t vendorID, uint16_t productID,
+			    const std::string &serial, Entry &entry);
+		bool store(const Entry &entry);
+		bool remove(const Entry &entry);
+
+
+	private:
+
+		static const size_t maxEntries = 16;
+
+		std::string m_path;
+
+		std::vector<Entry> load();
+		bool save(const std::vector<Entry> &entries);
+
+};
+
+#endif
@@ -0,0 +1,151 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "FrameScheduler.h"
+
+#include <cerrno>
+#include <cmath>
+#include <ctime>
+
+
+using namespace std;
+
+
+FrameScheduler::FrameScheduler(LedKeyboard &keyboard, unsigned int frameRate) : m_keyboard(keyboard) {
+	setFrameRate(frameRate);
+}
+
+
+void FrameScheduler::setFrameRate(unsigned int frameRate) {
+	if (frameRate == 0) m_period = chrono::steady_clock::duration::zero();
+	else m_period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::seconds(1)) / frameRate;
+	m_deadline = chrono::steady_clock::now();
+}
+
+unsigned int FrameScheduler::getFrameRate() {
+	if (m_period.count() == 0) return 0;
+	return chrono::duration_cast<chrono::steady_clock::duration>(chrono::seconds(1)) / m_period;
+}
+
+
+void FrameScheduler::setKeys(const LedKeyboard::KeyValue *keyValues, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		uint8_t index = LedKeyboard::getKeyIndex(keyValues[i].key);
+		if (index >= LedKeyboard::keyCount) continue;
+		if (! m_isSet[index]) {
+			m_isSet[index] = true;
+			m_indexes[m_setCount++] = index;
+		}
+		m_colors[index] = keyValues[i].color;
+	}
+}
+
+void FrameScheduler::endFrame(uint32_t frames) {
+	if (frames == 0) return;
+	// Only the newest frame makes it, the ones still waiting are superseded
+	m_stats.dropped += frames - 1;
+	if (m_isEnded) m_stats.dropped++;
+	else m_endedAt = chrono::steady_clock::now();
+	m_isEnded = true;
+	if (m_period.count() == 0) flush();
+}
+
+
+bool FrameScheduler::isFrameWaiting() {
+	return m_isEnded;
+}
+
+chrono::steady_clock::time_point FrameScheduler::getDeadline() {
+	return m_deadline;
+}
+
+bool FrameScheduler::flushIfDue() {
+	if (! m_isEnded || chrono::steady_clock::now() < m_deadline) return true;
+	return flush();
+}
+
+bool FrameScheduler::waitAndFlush() {
+	if (! m_isEnded) return true;
+	
+	if (m_period.count() > 0) {
+		chrono::nanoseconds deadline = chrono::duration_cast<chrono::nanoseconds>(m_deadline.time_since_epoch());
+		timespec time = { (time_t)(deadline.count() / 1000000000), (long)(deadline.count() % 1000000000) };
+		// steady_clock is CLOCK_MONOTONIC on Linux
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) == EINTR) {}
+	}
+	return flush();
+}
+
+bool FrameScheduler::flush() {
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	bool retval = true;
+	uint64_t keysSent = m_keyboard.getStats().keysSent;
+	if (m_setCount > 0) {
+		LedKeyboard::KeyValue keyValues[LedKeyboard::keyCount];
+		for (uint8_t i = 0; i < m_setCount; i++) {
+			keyValues[i].key = LedKeyboard::getKey(m_indexes[i]);
+			keyValues[i].color = m_colors[m_indexes[i]];
+			m_isSet[m_indexes[i]] = false;
+		}
+		retval = m_keyboard.setKeys(keyValues, m_setCount);
+		m_setCount = 0;
+	}
+	// Nothing to commit when every key already had its color
+	if (m_keyboard.getStats().keysSent != keysSent && ! m_keyboard.commit()) retval = false;
+	m_isEnded = false;
+	if (! retval) m_stats.errors++;
+	
+	if (m_stats.frames == 0) m_start = start;
+	m_stats.frames++;
+	m_stats.elapsed = start - m_start;
+	if (m_period.count() == 0) return retval;
+	
+	// A frame ended after its tick went out as soon as it could, only the
+	// ones that waited for the tick tell how well it was kept
+	chrono::steady_clock::time_point due = m_deadline;
+	if (m_endedAt > due) due = m_endedAt;
+	else {
+		chrono::nanoseconds jitter = chrono::duration_cast<chrono::nanoseconds>(start - due);
+		m_stats.jitterSamples++;
+		m_stats.jitterSquares += (double)jitter.count() * jitter.count();
+		if (jitter > m_stats.jitterMax) m_stats.jitterMax = jitter;
+	}
+	
+	// Next tick on the grid, skipping the ones a slow write went past
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	m_deadline = due + m_period;
+	if (m_deadline <= now) {
+		uint64_t late = (now - m_deadline) / m_period + 1;
+		m_stats.lateTicks += late;
+		m_deadline += m_period * late;
+	}
+	return retval;
+}
+
+
+FrameScheduler::Stats FrameScheduler::getStats() {
+	return m_stats;
+}
+
+double FrameScheduler::getFramesPerSecond() {
+	if (m_stats.frames < 2) return 0;
+	return (m_stats.frames - 1) / chrono::duration<double>(m_stats.elapsed).count();
+}
+
+chrono::nanoseconds FrameScheduler::getJitter() {
+	if (m_stats.jitterSamples == 0) return chrono::nanoseconds::zero();
+	return chrono::nanoseconds((int64_t)sqrt(m_stats.jitterSquares / m_stats.jitterSamples));
+}
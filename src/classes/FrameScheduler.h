@@ -0,0 +1,93 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMESCHEDULER_CLASS
+#define FRAMESCHEDULER_CLASS
+
+#include <chrono>
+#include <cstdint>
+
+#include "Keyboard.h"
+
+
+// Paces a keyboard at a fixed frame rate. Keys set between two ticks are
+// merged, the last color of a key wins, and go out as one frame with a
+// single commit. Frames a producer ends faster than the keyboard takes them
+// are dropped, only the newest is shown. Keys the keyboard already shows are
+// left out by its shadow, a frame that changes none is not committed.
+//
+// Either call waitAndFlush(), which sleeps until the next tick, or wait on
+// input until getDeadline() and call flushIfDue().
+class FrameScheduler {
+
+
+	public:
+
+		struct Stats {
+			uint64_t frames = 0; // Sent to the keyboard
+			uint64_t dropped = 0; // Ended by a producer but superseded before a tick
+			uint64_t lateTicks = 0; // Skipped because a frame took longer than a tick
+			uint64_t errors = 0;
+			std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+			// How far from its tick a frame that was waiting for it went out
+			uint64_t jitterSamples = 0;
+			std::chrono::nanoseconds jitterMax = std::chrono::nanoseconds::zero();
+			double jitterSquares = 0; // Sum of the squared distances in ns, for the RMS
+		};
+
+
+		FrameScheduler(LedKeyboard &keyboard, unsigned int frameRate = 60);
+
+		// 0 sends each frame as soon as it ends
+		void setFrameRate(unsigned int frameRate);
+		unsigned int getFrameRate();
+
+		void setKeys(const LedKeyboard::KeyValue *keyValues, size_t count);
+		// Marks the keys set so far as a frame, frames counts the producer frames
+		// it stands for when some were merged before reaching the scheduler
+		void endFrame(uint32_t frames = 1);
+
+		// When a frame is waiting, the time it goes out
+		bool isFrameWaiting();
+		std::chrono::steady_clock::time_point getDeadline();
+		bool flushIfDue();
+		bool waitAndFlush();
+
+		Stats getStats();
+		double getFramesPerSecond();
+		std::chrono::nanoseconds getJitter(); // RMS
+
+
+	private:
+
+		LedKeyboard &m_keyboard;
+		std::chrono::steady_clock::duration m_period;
+		std::chrono::steady_clock::time_point m_deadline;
+		std::chrono::steady_clock::time_point m_start;
+		std::chrono::steady_clock::time_point m_endedAt; // When the waiting frame ended
+		Stats m_stats;
+
+		LedKeyboard::Color m_colors[LedKeyboard::keyCount];
+		bool m_isSet[LedKeyboard::keyCount] = {};
+		uint8_t m_indexes[LedKeyboard::keyCount];
+		uint8_t m_setCount = 0;
+		bool m_isEnded = false; // A frame is waiting for its tick
+
+		bool flush();
+
+};
+
+#endif
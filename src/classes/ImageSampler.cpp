@@ -0,0 +1,116 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ImageSampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Layout.h"
+
+
+using namespace std;
+
+
+
+ImageSampler::ImageSampler(LedKeyboard::KeyboardModel model, uint32_t width, uint32_t height) :
+	m_width(width), m_height(height) {
+	
+	// The image covers the outer edges of the keys, a key being 1 unit high
+	const layout::Geometry &geometry = layout::getGeometry(model);
+	float left = 0, right = 0;
+	bool isFirst = true;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+		if (! geometry.isPlaced[i]) continue;
+		float from = geometry.x[i] - geometry.width[i] / 2, to = geometry.x[i] + geometry.width[i] / 2;
+		left = isFirst ? from : min(left, from);
+		right = isFirst ? to : max(right, to);
+		isFirst = false;
+	}
+	float top = geometry.top - 0.5f;
+	float bottom = geometry.bottom + 0.5f;
+	if (isFirst || width == 0 || height == 0) return;
+	
+	float xScale = width / (right - left);
+	float yScale = height / (bottom - top);
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+		if (! geometry.isPlaced[i]) continue;
+		m_columns[i] = makeSpan((geometry.x[i] - geometry.width[i] / 2 - left) * xScale,
+					(geometry.x[i] + geometry.width[i] / 2 - left) * xScale, width);
+		m_rows[i] = makeSpan((geometry.y[i] - 0.5f - top) * yScale, (geometry.y[i] + 0.5f - top) * yScale, height);
+	}
+}
+
+// Pixel n covers n to n + 1, its weight is how much of it from..to covers
+ImageSampler::Span ImageSampler::makeSpan(float from, float to, uint32_t size) {
+	Span span;
+	from = max(0.0f, from);
+	to = min(static_cast<float>(size), to);
+	if (to <= from) return span;
+	
+	span.first = min<uint32_t>(size - 1, floor(from));
+	uint32_t last = min<uint32_t>(size - 1, max<float>(span.first, ceil(to) - 1));
+	span.count = last - span.first + 1;
+	span.weights = m_weights.size();
+	for (uint32_t n = span.first; n <= last; n++)
+		m_weights.push_back((min<float>(n + 1, to) - max<float>(n, from)) / (to - from));
+	return span;
+}
+
+
+uint32_t ImageSampler::getWidth() {
+	return m_width;
+}
+
+uint32_t ImageSampler::getHeight() {
+	return m_height;
+}
+
+bool ImageSampler::isDriven(uint8_t index) {
+	return index < LedKeyboard::keyCount && m_columns[index].count > 0 && m_rows[index].count > 0;
+}
+
+
+void ImageSampler::sample(const uint8_t *pixels, uint16_t maxValue, LedKeyboard::Color *colors) {
+	const float scale = 255.0f / max<uint16_t>(maxValue, 1);
+	const size_t stride = static_cast<size_t>(m_width) * 3;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+		const Span &columns = m_columns[i];
+		const Span &rows = m_rows[i];
+		if (columns.count == 0 || rows.count == 0) continue;
+		
+		const float *columnWeights = &m_weights[columns.weights];
+		const float *rowWeights = &m_weights[rows.weights];
+		float red = 0, green = 0, blue = 0;
+		for (uint32_t row = 0; row < rows.count; row++) {
+			const uint8_t *pixel = pixels + (rows.first + row) * stride + columns.first * 3;
+			float rowRed = 0, rowGreen = 0, rowBlue = 0;
+			for (uint32_t column = 0; column < columns.count; column++, pixel += 3) {
+				rowRed += columnWeights[column] * pixel[0];
+				rowGreen += columnWeights[column] * pixel[1];
+				rowBlue += columnWeights[column] * pixel[2];
+			}
+			red += rowWeights[row] * rowRed;
+			green += rowWeights[row] * rowGreen;
+			blue += rowWeights[row] * rowBlue;
+		}
+		colors[i] = {
+			static_cast<uint8_t>(min(255.0f, red * scale + 0.5f)),
+			static_cast<uint8_t>(min(255.0f, green * scale + 0.5f)),
+			static_cast<uint8_t>(min(255.0f, blue * scale + 0.5f))
+		};
+	}
+}
@@ -0,0 +1,69 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGESAMPLER_CLASS
+#define IMAGESAMPLER_CLASS
+
+#include <cstdint>
+#include <vector>
+
+#include "Keyboard.h"
+
+
+// Averages an RGB image over the keys. The image is stretched over the
+// rectangles of the keys of a model and each key takes the mean of the
+// pixels under it, weighted by how much of each pixel it covers.
+//
+// The weights are computed once for a model and resolution. Keys being
+// rectangles, they are the product of a weight per column and one per row,
+// so a frame is one pass over the rows of each key with a contiguous inner
+// loop.
+class ImageSampler {
+
+
+	public:
+
+		ImageSampler(LedKeyboard::KeyboardModel model, uint32_t width, uint32_t height);
+
+		uint32_t getWidth();
+		uint32_t getHeight();
+		bool isDriven(uint8_t index);
+
+		// Rows of width red, green, blue bytes, top first, with samples up to maxValue
+		void sample(const uint8_t *pixels, uint16_t maxValue, LedKeyboard::Color *colors);
+
+
+	private:
+
+		// Pixels first to first + count - 1 along one axis, with their weights
+		// from m_weights[weights] on, adding up to 1
+		struct Span {
+			uint32_t first = 0;
+			uint32_t count = 0;
+			uint32_t weights = 0;
+		};
+
+		uint32_t m_width;
+		uint32_t m_height;
+		Span m_columns[LedKeyboard::keyCount];
+		Span m_rows[LedKeyboard::keyCount];
+		std::vector<float> m_weights;
+
+		Span makeSpan(float from, float to, uint32_t size);
+
+};
+
+#endif
@@ -0,0 +1,191 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "KeyInput.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+namespace {
+	
+	typedef LedKeyboard::Key Key;
+	
+	// What the kernel maps the HID usages of the keys to
+	const struct {
+		uint16_t code;
+		Key key;
+	} keyCodes[] = {
+		{ KEY_ESC, Key::esc },
+		{ KEY_1, Key::n1 }, { KEY_2, Key::n2 }, { KEY_3, Key::n3 }, { KEY_4, Key::n4 }, { KEY_5, Key::n5 },
+		{ KEY_6, Key::n6 }, { KEY_7, Key::n7 }, { KEY_8, Key::n8 }, { KEY_9, Key::n9 }, { KEY_0, Key::n0 },
+		{ KEY_MINUS, Key::minus }, { KEY_EQUAL, Key::equal }, { KEY_BACKSPACE, Key::backspace }, { KEY_TAB, Key::tab },
+		{ KEY_Q, Key::q }, { KEY_W, Key::w }, { KEY_E, Key::e }, { KEY_R, Key::r }, { KEY_T, Key::t },
+		{ KEY_Y, Key::y }, { KEY_U, Key::u }, { KEY_I, Key::i }, { KEY_O, Key::o }, { KEY_P, Key::p },
+		{ KEY_LEFTBRACE, Key::open_bracket }, { KEY_RIGHTBRACE, Key::close_bracket }, { KEY_ENTER, Key::enter },
+		{ KEY_LEFTCTRL, Key::ctrl_left },
+		{ KEY_A, Key::a }, { KEY_S, Key::s }, { KEY_D, Key::d }, { KEY_F, Key::f }, { KEY_G, Key::g },
+		{ KEY_H, Key::h }, { KEY_J, Key::j }, { KEY_K, Key::k }, { KEY_L, Key::l },
+		{ KEY_SEMICOLON, Key::semicolon }, { KEY_APOSTROPHE, Key::quote }, { KEY_GRAVE, Key::tilde },
+		{ KEY_LEFTSHIFT, Key::shift_left }, { KEY_BACKSLASH, Key::backslash },
+		{ KEY_Z, Key::z }, { KEY_X, Key::x }, { KEY_C, Key::c }, { KEY_V, Key::v }, { KEY_B, Key::b },
+		{ KEY_N, Key::n }, { KEY_M, Key::m }, { KEY_COMMA, Key::comma }, { KEY_DOT, Key::period },
+		{ KEY_SLASH, Key::slash }, { KEY_RIGHTSHIFT, Key::shift_right }, { KEY_KPASTERISK, Key::num_asterisk },
+		{ KEY_LEFTALT, Key::alt_left }, { KEY_SPACE, Key::space }, { KEY_CAPSLOCK, Key::caps_lock },
+		{ KEY_F1, Key::f1 }, { KEY_F2, Key::f2 }, { KEY_F3, Key::f3 }, { KEY_F4, Key::f4 }, { KEY_F5, Key::f5 },
+		{ KEY_F6, Key::f6 }, { KEY_F7, Key::f7 }, { KEY_F8, Key::f8 }, { KEY_F9, Key::f9 }, { KEY_F10, Key::f10 },
+		{ KEY_NUMLOCK, Key::num_lock }, { KEY_SCROLLLOCK, Key::scroll_lock },
+		{ KEY_KP7, Key::num_7 }, { KEY_KP8, Key::num_8 }, { KEY_KP9, Key::num_9 }, { KEY_KPMINUS, Key::num_minus },
+		{ KEY_KP4, Key::num_4 }, { KEY_KP5, Key::num_5 }, { KEY_KP6, Key::num_6 }, { KEY_KPPLUS, Key::num_plus },
+		{ KEY_KP1, Key::num_1 }, { KEY_KP2, Key::num_2 }, { KEY_KP3, Key::num_3 }, { KEY_KP0, Key::num_0 },
+		{ KEY_KPDOT, Key::num_dot }, { KEY_102ND, Key::intl_backslash }, { KEY_F11, Key::f11 }, { KEY_F12, Key::f12 },
+		{ KEY_RO, Key::abnt_slash }, { KEY_KPENTER, Key::num_enter }, { KEY_RIGHTCTRL, Key::ctrl_right },
+		{ KEY_KPSLASH, Key::num_slash }, { KEY_SYSRQ, Key::print_screen }, { KEY_RIGHTALT, Key::alt_right },
+		{ KEY_HOME, Key::home }, { KEY_UP, Key::arrow_top }, { KEY_PAGEUP, Key::page_up },
+		{ KEY_LEFT, Key::arrow_left }, { KEY_RIGHT, Key::arrow_right }, { KEY_END, Key::end },
+		{ KEY_DOWN, Key::arrow_bottom }, { KEY_PAGEDOWN, Key::page_down }, { KEY_INSERT, Key::insert },
+		{ KEY_DELETE, Key::del }, { KEY_MUTE, Key::mute }, { KEY_PAUSE, Key::pause_break },
+		{ KEY_LEFTMETA, Key::win_left }, { KEY_RIGHTMETA, Key::win_right }, { KEY_COMPOSE, Key::menu },
+		{ KEY_NEXTSONG, Key::next }, { KEY_PLAYPAUSE, Key::play }, { KEY_PREVIOUSSONG, Key::prev },
+		{ KEY_STOPCD, Key::stop },
+		// G-keys, on kernels that report them
+		{ KEY_MACRO1, Key::g1 }, { KEY_MACRO2, Key::g2 }, { KEY_MACRO3, Key::g3 }, { KEY_MACRO4, Key::g4 },
+		{ KEY_MACRO5, Key::g5 }, { KEY_MACRO6, Key::g6 }, { KEY_MACRO7, Key::g7 }, { KEY_MACRO8, Key::g8 },
+		{ KEY_MACRO9, Key::g9 }
+	};
+	
+	const uint16_t codeCount = KEY_MACRO9 + 1;
+	
+	bool readHex(const string &path, uint16_t &value) {
+		ifstream file(path);
+		unsigned int hex;
+		if (! (file>>hex>>hex)) return false;
+		value = hex;
+		return true;
+	}
+	
+}
+
+
+KeyInput::~KeyInput() {
+	close();
+}
+
+
+string KeyInput::find(uint16_t vendorID, uint16_t productID) {
+	DIR *dir = opendir("/sys/class/input");
+	if (dir == NULL) return "";
+	
+	string found;
+	struct dirent *entry;
+	while (found.empty() && (entry = readdir(dir)) != NULL) {
+		string name = entry->d_name;
+		if (name.compare(0, 5, "event") != 0) continue;
+		
+		string id = "/sys/class/input/" + name + "/device/id/";
+		uint16_t vendor, product;
+		if (! readHex(id + "vendor", vendor) || ! readHex(id + "product", product)) continue;
+		if ((vendorID != 0x0 && vendor != vendorID) || (productID != 0x0 && product != productID)) continue;
+		
+		// The keyboard has several nodes, the one with letters is the one typed on
+		string path = "/dev/input/" + name;
+		int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) continue;
+		unsigned long keys[KEY_CNT / (8 * sizeof(unsigned long)) + 1] = {};
+		const size_t bits = 8 * sizeof(unsigned long);
+		if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) >= 0 && (keys[KEY_A / bits] >> (KEY_A % bits)) & 1)
+			found = path;
+		::close(fd);
+	}
+	closedir(dir);
+	return found;
+}
+
+bool KeyInput::getKey(uint16_t code, LedKeyboard::Key &key) {
+	// Built once, indexed like the codes
+	static const struct Table {
+		uint8_t indexes[codeCount];
+		Table() {
+			fill(indexes, indexes + codeCount, LedKeyboard::keyCount);
+			for (size_t i = 0; i < sizeof(keyCodes) / sizeof(keyCodes[0]); i++)
+				indexes[keyCodes[i].code] = LedKeyboard::getKeyIndex(keyCodes[i].key);
+		}
+	} table;
+	
+	if (code >= codeCount || table.indexes[code] >= LedKeyboard::keyCount) return false;
+	key = LedKeyboard::getKey(table.indexes[code]);
+	return true;
+}
+
+
+bool KeyInput::open(const string &path) {
+	close();
+	m_fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (m_fd < 0) return false;
+	// Fails on something that is not an event node, such as a pipe replaying events
+	int clock = CLOCK_MONOTONIC;
+	ioctl(m_fd, EVIOCSCLOCKID, &clock);
+	return true;
+}
+
+void KeyInput::close() {
+	if (m_fd < 0) return;
+	::close(m_fd);
+	m_fd = -1;
+}
+
+int KeyInput::getFd() {
+	return m_fd;
+}
+
+
+int KeyInput::read(Press *presses, size_t count) {
+	if (m_fd < 0) return -1;
+	
+	input_event events[64];
+	size_t pressed = 0;
+	while (pressed < count) {
+		ssize_t size = ::read(m_fd, events, sizeof(events));
+		if (size < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN) break;
+			return -1;
+		}
+		if (size == 0) return pressed > 0 ? pressed : -1; // Writer of a pipe gone
+		
+		for (size_t i = 0; i < size / sizeof(input_event) && pressed < count; i++) {
+			const input_event &event = events[i];
+			// 1 is a press, 0 a release and 2 a repeat
+			if (event.type != EV_KEY || event.value != 1) continue;
+			if (! getKey(event.code, presses[pressed].key)) continue;
+			presses[pressed].time = chrono::steady_clock::time_point(chrono::duration_cast<chrono::steady_clock::duration>(
+				chrono::seconds(event.input_event_sec) + chrono::microseconds(event.input_event_usec)));
+			pressed++;
+		}
+	}
+	return pressed;
+}
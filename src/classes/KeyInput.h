@@ -0,0 +1,63 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef KEYINPUT_CLASS
+#define KEYINPUT_CLASS
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Keyboard.h"
+
+
+// Key presses of a keyboard, read from its /dev/input/eventN node. The node
+// is non-blocking so that it can sit in an epoll set, and its timestamps are
+// on the monotonic clock, so that they compare with steady_clock.
+class KeyInput {
+
+
+	public:
+
+		struct Press {
+			LedKeyboard::Key key;
+			std::chrono::steady_clock::time_point time;
+		};
+
+
+		~KeyInput();
+
+		// The event node of a device with letter keys, empty when none matches
+		static std::string find(uint16_t vendorID, uint16_t productID);
+		// KEY_* code to key, false for a code with no LED
+		static bool getKey(uint16_t code, LedKeyboard::Key &key);
+
+		bool open(const std::string &path);
+		void close();
+		int getFd();
+
+		// Presses read so far, without waiting. Releases, repeats, keys without
+		// a LED and presses past count are skipped. -1 once the device is gone
+		int read(Press *presses, size_t count);
+
+
+	private:
+
+		int m_fd = -1;
+
+};
+
+#endif
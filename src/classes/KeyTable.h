@@ -0,0 +1,226 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef KEYTABLE_HELPER
+#define KEYTABLE_HELPER
+
+#include <cstdint>
+
+#include "Keyboard.h"
+
+
+// Dense 0..count-1 index of every LedKeyboard::Key, and the code each model
+// puts on the wire for it, all worked out at compile time
+namespace keytable {
+
+	typedef LedKeyboard::Key Key;
+	typedef LedKeyboard::KeyboardModel KeyboardModel;
+	typedef LedKeyboard::KeyAddressGroup KeyAddressGroup;
+
+	constexpr uint8_t noIndex = 0xff;
+	constexpr uint8_t noCode = 0x00; // The model has no such key
+	constexpr uint8_t modelCount = static_cast<uint8_t>(KeyboardModel::gpro) + 1;
+	constexpr uint8_t groupCount = static_cast<uint8_t>(KeyAddressGroup::keys) + 1;
+
+	// With the name parseKey takes for it, which --help-stream lists
+	struct Entry {
+		Key key;
+		const char *name;
+	};
+
+	constexpr Entry entries[] = {
+		{ Key::logo, "logo" }, { Key::logo2, "logo2" },
+		{ Key::backlight, "backlight" }, { Key::game, "game" }, { Key::caps, "caps" },
+		{ Key::scroll, "scroll" }, { Key::num, "num" },
+		{ Key::next, "next" }, { Key::prev, "prev" }, { Key::stop, "stop" }, { Key::play, "play" },
+		{ Key::mute, "mute" },
+		{ Key::g1, "g1" }, { Key::g2, "g2" }, { Key::g3, "g3" }, { Key::g4, "g4" }, { Key::g5, "g5" },
+		{ Key::g6, "g6" }, { Key::g7, "g7" }, { Key::g8, "g8" }, { Key::g9, "g9" },
+		{ Key::a, "a" }, { Key::b, "b" }, { Key::c, "c" }, { Key::d, "d" }, { Key::e, "e" }, { Key::f, "f" },
+		{ Key::g, "g" }, { Key::h, "h" }, { Key::i, "i" }, { Key::j, "j" }, { Key::k, "k" }, { Key::l, "l" },
+		{ Key::m, "m" }, { Key::n, "n" }, { Key::o, "o" }, { Key::p, "p" }, { Key::q, "q" }, { Key::r, "r" },
+		{ Key::s, "s" }, { Key::t, "t" }, { Key::u, "u" }, { Key::v, "v" }, { Key::w, "w" }, { Key::x, "x" },
+		{ Key::y, "y" }, { Key::z, "z" },
+		{ Key::n1, "1" }, { Key::n2, "2" }, { Key::n3, "3" }, { Key::n4, "4" }, { Key::n5, "5" },
+		{ Key::n6, "6" }, { Key::n7, "7" }, { Key::n8, "8" }, { Key::n9, "9" }, { Key::n0, "0" },
+		{ Key::enter, "enter" }, { Key::esc, "esc" }, { Key::backspace, "backspace" }, { Key::tab, "tab" },
+		{ Key::space, "space" }, { Key::minus, "minus" }, { Key::equal, "equal" },
+		{ Key::open_bracket, "open_bracket" }, { Key::close_bracket, "close_bracket" },
+		{ Key::backslash, "backslash" }, { Key::dollar, "dollar" }, { Key::semicolon, "semicolon" },
+		{ Key::quote, "quote" }, { Key::tilde, "tilde" }, { Key::comma, "comma" }, { Key::period, "period" },
+		{ Key::slash, "slash" }, { Key::caps_lock, "caps_lock" },
+		{ Key::f1, "f1" }, { Key::f2, "f2" }, { Key::f3, "f3" }, { Key::f4, "f4" }, { Key::f5, "f5" },
+		{ Key::f6, "f6" }, { Key::f7, "f7" }, { Key::f8, "f8" }, { Key::f9, "f9" }, { Key::f10, "f10" },
+		{ Key::f11, "f11" }, { Key::f12, "f12" },
+		{ Key::print_screen, "print_screen" }, { Key::scroll_lock, "scroll_lock" },
+		{ Key::pause_break, "pause_break" }, { Key::insert, "insert" }, { Key::home, "home" },
+		{ Key::page_up, "page_up" }, { Key::del, "del" }, { Key::end, "end" }, { Key::page_down, "page_down" },
+		{ Key::arrow_right, "arrow_right" }, { Key::arrow_left, "arrow_left" },
+		{ Key::arrow_bottom, "arrow_bottom" }, { Key::arrow_top, "arrow_top" },
+		{ Key::num_lock, "num_lock" }, { Key::num_slash, "num_slash" }, { Key::num_asterisk, "num_asterisk" },
+		{ Key::num_minus, "num_minus" }, { Key::num_plus, "num_plus" }, { Key::num_enter, "numenter" },
+		{ Key::num_1, "num1" }, { Key::num_2, "num2" }, { Key::num_3, "num3" }, { Key::num_4, "num4" },
+		{ Key::num_5, "num5" }, { Key::num_6, "num6" }, { Key::num_7, "num7" }, { Key::num_8, "num8" },
+		{ Key::num_9, "num9" }, { Key::num_0, "num0" },
+		{ Key::num_dot, "num." }, { Key::intl_backslash, "intl_backslash" }, { Key::menu, "menu" },
+		{ Key::abnt_slash, "abnt_slash" },
+		{ Key::ctrl_left, "ctrl_left" }, { Key::shift_left, "shift_left" }, { Key::alt_left, "alt_left" },
+		{ Key::win_left, "win_left" }, { Key::ctrl_right, "ctrl_right" }, { Key::shift_right, "shift_right" },
+		{ Key::alt_right, "alt_right" }, { Key::win_right, "win_right" }
+	};
+
+	constexpr uint8_t count = sizeof(entries) / sizeof(entries[0]);
+	static_assert(count == LedKeyboard::keyCount, "LedKeyboard::keyCount does not match the key table");
+
+	constexpr KeyAddressGroup groupOf(Key key) {
+		return static_cast<KeyAddressGroup>(static_cast<uint16_t>(key) >> 8);
+	}
+
+	// The 0x6c/0x1c reports of the G815 and G915 number the keys on their own
+	constexpr uint8_t g815Code(Key key) {
+		uint8_t code = static_cast<uint16_t>(key) & 0x00ff;
+		switch (key) {
+			case Key::logo2:
+			case Key::game:
+			case Key::caps:
+			case Key::scroll:
+			case Key::num:
+			case Key::stop:
+			case Key::g6:
+			case Key::g7:
+			case Key::g8:
+			case Key::g9:
+				return noCode;
+			case Key::play:
+				return 0x9b;
+			case Key::mute:
+				return 0x9c;
+			case Key::next:
+				return 0x9d;
+			case Key::prev:
+				return 0x9e;
+			case Key::ctrl_left:
+			case Key::shift_left:
+			case Key::alt_left:
+			case Key::win_left:
+			case Key::ctrl_right:
+			case Key::shift_right:
+			case Key::alt_right:
+			case Key::win_right:
+				return code - 0x78;
+			default:
+				break;
+		}
+		switch (groupOf(key)) {
+			case KeyAddressGroup::logo:
+				return code + 0xd1;
+			case KeyAddressGroup::indicators:
+				return code + 0x98;
+			case KeyAddressGroup::gkeys:
+				return code + 0xb3;
+			case KeyAddressGroup::keys:
+				return code - 0x03;
+			default:
+				return noCode;
+		}
+	}
+
+	// The other models take the low byte of the key within its address group
+	constexpr uint8_t groupCode(KeyboardModel model, Key key) {
+		uint8_t code = static_cast<uint16_t>(key) & 0x00ff;
+		switch (groupOf(key)) {
+			case KeyAddressGroup::logo:
+				switch (model) {
+					case KeyboardModel::g610:
+					case KeyboardModel::g810:
+					case KeyboardModel::gpro:
+						return key == Key::logo ? code : noCode;
+					case KeyboardModel::g910:
+						return code;
+					default:
+						return noCode;
+				}
+			case KeyAddressGroup::indicators:
+				return code;
+			case KeyAddressGroup::multimedia:
+				switch (model) {
+					case KeyboardModel::g610:
+					case KeyboardModel::g810:
+					case KeyboardModel::gpro:
+						return code;
+					default:
+						return noCode;
+				}
+			case KeyAddressGroup::gkeys:
+				return model == KeyboardModel::g910 ? code : noCode;
+			case KeyAddressGroup::keys:
+				if (model == KeyboardModel::g410 && key >= Key::num_lock && key <= Key::num_dot)
+					return noCode; // Tenkeyless
+				return code;
+			default:
+				return noCode;
+		}
+	}
+
+	constexpr uint8_t wireCodeOf(KeyboardModel model, Key key) {
+		switch (model) {
+			case KeyboardModel::g815:
+			case KeyboardModel::g915:
+				return g815Code(key);
+			case KeyboardModel::g410:
+			case KeyboardModel::g512:
+			case KeyboardModel::g513:
+			case KeyboardModel::g610:
+			case KeyboardModel::g810:
+			case KeyboardModel::g910:
+			case KeyboardModel::gpro:
+				return groupCode(model, key);
+			default:
+				return noCode; // No per-key lighting
+		}
+	}
+
+	struct Tables {
+		uint8_t indexes[groupCount][256];
+		uint8_t wireCodes[modelCount][count];
+
+		constexpr Tables() : indexes(), wireCodes() {
+			for (uint8_t group = 0; group < groupCount; group++)
+				for (uint16_t code = 0; code < 256; code++) indexes[group][code] = noIndex;
+			for (uint8_t i = 0; i < count; i++) {
+				Key key = entries[i].key;
+				indexes[static_cast<uint8_t>(groupOf(key))][static_cast<uint16_t>(key) & 0x00ff] = i;
+				for (uint8_t model = 0; model < modelCount; model++)
+					wireCodes[model][i] = wireCodeOf(static_cast<KeyboardModel>(model), key);
+			}
+		}
+	};
+	constexpr Tables tables = Tables();
+
+	inline uint8_t indexOf(Key key) {
+		uint8_t group = static_cast<uint16_t>(key) >> 8;
+		if (group >= groupCount) return noIndex;
+		return tables.indexes[group][static_cast<uint16_t>(key) & 0x00ff];
+	}
+
+	inline uint8_t wireCode(KeyboardModel model, uint8_t index) {
+		if (static_cast<uint8_t>(model) >= modelCount || index >= count) return noCode;
+		return tables.wireCodes[static_cast<uint8_t>(model)][index];
+	}
+
+}
+
+#endif
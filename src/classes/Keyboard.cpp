@@ -15,339 +15,287 @@
 */
 
 #include "Keyboard.h"
+#include "Calibration.h"
+#include "DeviceCache.h"
+#include "KeyTable.h"
+#include "Protocol.h"
 
 #include <iostream>
 #include <unistd.h>
 #include <vector>
-#include <map>
+#include <algorithm>
 #include <cerrno>
-
-#if defined(hidapi)
-	#include <locale>
-	#include "hidapi/hidapi.h"
-#elif defined(libusb)
-	#include "libusb-1.0/libusb.h"
-#endif
+#include <cstring>
 
 
 using namespace std;
 
 
+namespace {
 
-LedKeyboard::~LedKeyboard() {
-	close();
-}
+	// Zero filled report of the given size, starting with the header
+	void fillReport(LedTransport::Report &report, size_t size, initializer_list<unsigned char> header) {
+		report.size = size;
+		memset(report.data, 0x00, sizeof(report.data));
+		copy(header.begin(), header.end(), report.data);
+	}
 
+	void fillReport(LedTransport::Report &report, size_t size, const vector<unsigned char> &header) {
+		report.size = size;
+		memset(report.data, 0x00, sizeof(report.data));
+		copy(header.begin(), header.end(), report.data);
+	}
+
+	void fillReport(LedTransport::Report &report, size_t size, const protocol::Header &header) {
+		report.size = size;
+		memset(report.data, 0x00, sizeof(report.data));
+		copy(header.bytes, header.bytes + header.size, report.data);
+	}
+
+}
 
-vector<LedKeyboard::DeviceInfo> LedKeyboard::listKeyboards() {
-	vector<LedKeyboard::DeviceInfo> deviceList;
 
+LedKeyboard::LedKeyboard() {
+	m_protocol = &protocol::get(KeyboardModel::unknown);
+	m_batch.reserve(keyCount); // A frame never takes more than a report per key
+	updateColorTables();
+	
 	#if defined(hidapi)
-		if (hid_init() < 0) return deviceList;
-		
-		struct hid_device_info *devs, *dev;
-		devs = hid_enumerate(0x0, 0x0);
-		dev = devs;
-		while (dev) {
-			for (size_t i = 0; i < SupportedKeyboards.size(); i++) {
-				if (dev->vendor_id == SupportedKeyboards[i][0]) {
-					if (dev->product_id == SupportedKeyboards[i][1]) {
-						DeviceInfo deviceInfo;
-						deviceInfo.vendorID=dev->vendor_id;
-						deviceInfo.productID=dev->product_id;
-
-						if (dev->serial_number != NULL) {
-							char buf[256];
-							wcstombs(buf, dev->serial_number, 256);
-							deviceInfo.serialNumber = string(buf);
-						}
-
-						if (dev->manufacturer_string != NULL)
-						{
-							char buf[256];
-							wcstombs(buf, dev->manufacturer_string, 256);
-							deviceInfo.manufacturer = string(buf);
-						}
-
-						if (dev->product_string != NULL)
-						{
-							char buf[256];
-							wcstombs(buf, dev->product_string, 256);
-							deviceInfo.product = string(buf);
-						}
-
-						deviceList.push_back(deviceInfo);
-						dev = dev->next;
-						break;
-					}
-				}
-			}
-			if (dev != NULL) dev = dev->next;
-		}
-		hid_free_enumeration(devs);
-		hid_exit();
-		
+		setTransport(TransportType::hidApi);
 	#elif defined(libusb)
-		libusb_context *ctx = NULL;
-		if(libusb_init(&m_ctx) < 0) return deviceList;
-		
-		libusb_device **devs;
-		ssize_t cnt = libusb_get_device_list(ctx, &devs);
-		for(ssize_t i = 0; i < cnt; i++) {
-			libusb_device *device = devs[i];
-			libusb_device_descriptor desc;
-			libusb_get_device_descriptor(device, &desc);
-			for (int i=0; i<(int)SupportedKeyboards.size(); i++) {
-				if (desc.idVendor == SupportedKeyboards[i][0]) {
-					if (desc.idProduct == SupportedKeyboards[i][1]) {
-					  unsigned char buf[256];
-						DeviceInfo deviceInfo;
-						deviceInfo.vendorID=desc.idVendor;
-						deviceInfo.productID=desc.idProduct;
-
-						if (libusb_open(device, &m_hidHandle) != 0)	continue;
-
-						if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iSerialNumber, buf, 256) >= 1) deviceInfo.serialNumber = string((char*)buf);
-						if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iManufacturer, buf, 256) >= 1) deviceInfo.manufacturer = string((char*)buf);
-						if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iProduct, buf, 256) >= 1) deviceInfo.product = string((char*)buf);
-
-						deviceList.push_back(deviceInfo);
-						libusb_close(m_hidHandle);
-						m_hidHandle = NULL;
-						break;
-					}
-				}
-			}
-		}
-		libusb_free_device_list(devs, 1);
-
-		if (m_hidHandle != NULL) {
-			libusb_close(m_hidHandle);
-			m_hidHandle = NULL;
-		}
-		
-		libusb_exit(m_ctx);
-		m_ctx = NULL;
+		setTransport(TransportType::libUsb);
+	#elif defined(hidraw)
+		setTransport(TransportType::hidRaw);
+	#else
+		setTransport(TransportType::memory);
 	#endif
-	
-	return deviceList;
 }
 
+LedKeyboard::~LedKeyboard() {
+	close();
+}
 
-bool LedKeyboard::isOpen() {
-	return m_isOpen;
+
+uint8_t LedKeyboard::getKeyIndex(Key key) {
+	uint8_t index = keytable::indexOf(key);
+	return index == keytable::noIndex ? keyCount : index;
 }
 
-bool LedKeyboard::open() {
-	if (m_isOpen) return true;
-	
-	return open(0x0, 0x0, "");
+LedKeyboard::Key LedKeyboard::getKey(uint8_t index) {
+	if (index >= keyCount) return Key::logo;
+	return keytable::entries[index].key;
 }
 
-bool LedKeyboard::open(uint16_t vendorID, uint16_t productID, string serial) {
-	if (m_isOpen && ! close()) return false;
-	currentDevice.model = KeyboardModel::unknown;
 
-	#if defined(hidapi)
-		if (hid_init() < 0) return false;
+bool LedKeyboard::setTransport(TransportType transportType) {
+	switch (transportType) {
+		#if defined(hidapi)
+			case TransportType::hidApi:
+				setTransport(new HidapiTransport());
+				return true;
+		#elif defined(libusb)
+			case TransportType::libUsb:
+				setTransport(new LibusbTransport());
+				return true;
+		#elif defined(hidraw)
+			case TransportType::hidRaw:
+				setTransport(new HidrawTransport());
+				return true;
+		#endif
+		case TransportType::memory:
+			setTransport(new MemoryTransport());
+			return true;
+		default:
+			return false; // Backend not built in
+	}
+}
 
-		struct hid_device_info *devs, *dev;
-		devs = hid_enumerate(vendorID, productID);
-		dev = devs;
-		wstring wideSerial;
+void LedKeyboard::setTransport(LedTransport *transport) {
+	close();
+	m_transport.reset(transport);
+	m_transport->setAckReading(m_ackTimeout.count() > 0);
+}
 
-		if (!serial.empty()) {
-			wchar_t tempSerial[256];
-			if (mbstowcs(tempSerial, serial.c_str(), 256) < 1) return false;
-			wideSerial = wstring(tempSerial);
-		}
+LedTransport *LedKeyboard::getTransport() {
+	return m_transport.get();
+}
 
-		while (dev) {
-			for (int i=0; i<(int)SupportedKeyboards.size(); i++) {
-				if (dev->vendor_id == SupportedKeyboards[i][0] && dev->product_id == SupportedKeyboards[i][1] && dev->interface_number == SupportedKeyboards[i][2]) {
-					if (!serial.empty() && dev->serial_number != NULL && wideSerial.compare(dev->serial_number) != 0) break; //Serial didn't match
 
-					if (dev->serial_number != NULL) {
-						char buf[256];
-						wcstombs(buf,dev->serial_number,256);
-						currentDevice.serialNumber=string(buf);
-					}
+void LedKeyboard::setAckTimeout(std::chrono::milliseconds timeout) {
+	m_ackTimeout = timeout;
+	m_transport->setAckReading(timeout.count() > 0);
+}
 
-					if (dev->manufacturer_string != NULL)
-					{
-						char buf[256];
-						wcstombs(buf,dev->manufacturer_string,256);
-						currentDevice.manufacturer = string(buf);
-					}
+uint8_t LedKeyboard::getLastAckError() {
+	return m_lastAckError;
+}
 
-					if (dev->product_string != NULL)
-					{
-						char buf[256];
-						wcstombs(buf,dev->product_string,256);
-						currentDevice.product = string(buf);
-					}
 
-					currentDevice.vendorID = dev->vendor_id;
-					currentDevice.productID = dev->product_id;
-					currentDevice.path = dev->path;
-					currentDevice.model = (KeyboardModel)SupportedKeyboards[i][3];
-					break;
-				}
-			}
-			if (currentDevice.model != KeyboardModel::unknown) break;
-			dev = dev->next;
-		}
+void LedKeyboard::setDeviceCache(bool enabled) {
+	m_useDeviceCache = enabled;
+}
 
-		hid_free_enumeration(devs);
+void LedKeyboard::setCalibration(shared_ptr<const Calibration> calibration) {
+	m_calibration = calibration;
+	updateColorTables();
+	invalidateShadow(); // The same colors now map to other values
+}
 
-		if (! dev) {
-			currentDevice.model = KeyboardModel::unknown;
-			errno = ENODEV;
+void LedKeyboard::updateColorTables() {
+	if (m_calibration) {
+		m_colorTables = m_calibration->getTables(currentDevice.model);
+		return;
+	}
+	for (int i = 0; i < 256; i++) m_colorTables.red[i] = m_colorTables.green[i] = m_colorTables.blue[i] = i;
+}
 
-			hid_exit();
-			return false;
-		}
 
-		m_hidHandle = hid_open_path(currentDevice.path.c_str());
+LedKeyboard::Stats LedKeyboard::getStats() {
+	return m_stats;
+}
 
-		if(m_hidHandle == 0) {
-			hid_exit();
-			errno = EACCES;
-			return false;
-		}
+void LedKeyboard::resetStats() {
+	m_stats = Stats();
+}
 
-		m_isOpen = true;
-		return true;
 
-	#elif defined(libusb)
-		if (libusb_init(&m_ctx) < 0) return false;
+vector<LedKeyboard::DeviceInfo> LedKeyboard::listKeyboards() {
+	vector<LedKeyboard::DeviceInfo> deviceList;
+	
+	vector<LedTransport::Device> devices = m_transport->enumerate(SupportedKeyboards);
+	for (size_t i = 0; i < devices.size(); i++) {
+		for (size_t j = 0; j < SupportedKeyboards.size(); j++) {
+			if (devices[i].vendorID != SupportedKeyboards[j][0]) continue;
+			if (devices[i].productID != SupportedKeyboards[j][1]) continue;
 			
-		libusb_device **devs;
-		libusb_device *dev = NULL;
-		ssize_t cnt = libusb_get_device_list(m_ctx, &devs);
-		if(cnt >= 0) {
-			for(ssize_t i = 0; i < cnt; i++) {
-				libusb_device *device = devs[i];
-				libusb_device_descriptor desc;
-				libusb_get_device_descriptor(device, &desc);
-
-				if (vendorID != 0x0 && desc.idVendor != vendorID) continue;
-				else if (productID != 0x0 && desc.idProduct != productID) continue;
-				else if (! serial.empty()) {
-					if (desc.iSerialNumber <= 0) continue; //Device does not populate serial number
-
-					unsigned char buf[256];
-					if (libusb_open(device, &m_hidHandle) != 0){
-						m_hidHandle = NULL;
-						continue;
-					}
-
-					if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iSerialNumber, buf, 256) >= 1 && serial.compare((char*)buf) == 0) {
-						//Make sure entry is a supported keyboard and get model
-						for (int i=0; i<(int)SupportedKeyboards.size(); i++) {
-							if (desc.idVendor == SupportedKeyboards[i][0]) {
-								if (desc.idProduct == SupportedKeyboards[i][1]) {
-									if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iManufacturer, buf, 256) >= 1) currentDevice.manufacturer = string((char*)buf);
-									if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iProduct, buf, 256) >= 1) currentDevice.product = string((char*)buf);
-									currentDevice.serialNumber = serial;
-									currentDevice.vendorID = desc.idVendor;
-									currentDevice.productID = desc.idProduct;
-									currentDevice.model = (KeyboardModel)SupportedKeyboards[i][3];
-
-									dev = device;
-									libusb_close(m_hidHandle);
-									m_hidHandle = NULL;
-									break;
-								}
-							}
-						}
-					}
-					else {
-						libusb_close(m_hidHandle);
-						m_hidHandle = NULL;
-						continue; //Serial number set but doesn't match
-					}
-				}
-
-				//For the case where serial is not specified, find first supported device
-				for (int i=0; i<(int)SupportedKeyboards.size(); i++) {
-					if (desc.idVendor == SupportedKeyboards[i][0]) {
-						if (desc.idProduct == SupportedKeyboards[i][1]) {
-							unsigned char buf[256];
-							if (libusb_open(device, &m_hidHandle) != 0){
-								m_hidHandle = NULL;
-								continue;
-							}
-							currentDevice.vendorID = desc.idVendor;
-							currentDevice.productID = desc.idProduct;
-							currentDevice.model = (KeyboardModel)SupportedKeyboards[i][3];
-							if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iManufacturer, buf, 256) >= 1) currentDevice.manufacturer = string((char*)buf);
-							if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iProduct, buf, 256) >= 1) currentDevice.product = string((char*)buf);
-							if (libusb_get_string_descriptor_ascii(m_hidHandle, desc.iSerialNumber, buf, 256) >= 1) currentDevice.serialNumber = string((char*)buf);
-
-							libusb_close(m_hidHandle);
-							m_hidHandle=NULL;
-							break;
-						}
-					}
-				}
-				if (currentDevice.model != KeyboardModel::unknown) break;
-			}
-			libusb_free_device_list(devs, 1);
+			DeviceInfo deviceInfo;
+			deviceInfo.vendorID = devices[i].vendorID;
+			deviceInfo.productID = devices[i].productID;
+			deviceInfo.manufacturer = devices[i].manufacturer;
+			deviceInfo.product = devices[i].product;
+			deviceInfo.serialNumber = devices[i].serialNumber;
+			deviceInfo.path = devices[i].path;
+			deviceInfo.model = (KeyboardModel)SupportedKeyboards[j][3];
+			deviceList.push_back(deviceInfo);
+			break;
 		}
+	}
+	
+	return deviceList;
+}
 
-		if (currentDevice.model == KeyboardModel::unknown) {
-			libusb_exit(m_ctx);
-			errno = ENODEV;
-			m_ctx = NULL;
-			return false;
-		}
-			
-		if (dev == NULL) m_hidHandle = libusb_open_device_with_vid_pid(m_ctx, currentDevice.vendorID, currentDevice.productID);
-		else libusb_open(dev, &m_hidHandle);
 
-		if(m_hidHandle == NULL) {
-			libusb_exit(m_ctx);
-			errno = EACCES;
-			m_ctx = NULL;
-			return false;
-		}
+bool LedKeyboard::isOpen() {
+	return m_isOpen;
+}
 
-		int interface_num;
-		switch (currentDevice.model) {
-			case KeyboardModel::g915:
-				interface_num = 2;
-				break;
-			default:
-				interface_num = 1;
-		}
+bool LedKeyboard::open() {
+	if (m_isOpen) return true;
+	
+	return open(0x0, 0x0, "");
+}
 
-		if(libusb_kernel_driver_active(m_hidHandle, interface_num) == 1) {
-			if(libusb_detach_kernel_driver(m_hidHandle, interface_num) != 0) {
-				libusb_exit(m_ctx);
-				errno = EACCES;
-				m_ctx = NULL;
-				return false;
-			}
-			m_isKernellDetached = true;
-		}
+bool LedKeyboard::open(uint16_t vendorID, uint16_t productID, string serial) {
+	if (m_isOpen && ! close()) return false;
+	currentDevice.model = KeyboardModel::unknown;
+	m_protocol = &protocol::get(KeyboardModel::unknown);
+	invalidateShadow(); // Nothing is known about what a (re)opened device shows
+	
+	vector<vector<uint16_t>> deviceIds;
+	for (size_t i = 0; i < SupportedKeyboards.size(); i++) {
+		if (vendorID != 0x0 && SupportedKeyboards[i][0] != vendorID) continue;
+		if (productID != 0x0 && SupportedKeyboards[i][1] != productID) continue;
+		deviceIds.push_back(SupportedKeyboards[i]);
+	}
+	
+	if (m_useDeviceCache && openCached(deviceIds, vendorID, productID, serial)) {
+		m_protocol = &protocol::get(currentDevice.model);
+		updateColorTables();
+		return true;
+	}
+	
+	LedTransport::Device device;
+	vector<LedTransport::Device> devices = m_transport->enumerate(deviceIds);
+	for (size_t i = 0; i < devices.size(); i++) {
+		if (! serial.empty() && ! devices[i].serialNumber.empty() && devices[i].serialNumber != serial) continue; //Serial didn't match
+		
+		for (size_t j = 0; j < deviceIds.size(); j++) {
+			if (devices[i].vendorID != deviceIds[j][0] || devices[i].productID != deviceIds[j][1]) continue;
+			if (devices[i].interfaceNumber != LedTransport::anyInterface &&
+				devices[i].interfaceNumber != deviceIds[j][2]) continue;
 			
-		if(libusb_claim_interface(m_hidHandle, interface_num) < 0) {
-			if(m_isKernellDetached==true) {
-				libusb_attach_kernel_driver(m_hidHandle, interface_num);
-				m_isKernellDetached = false;
-			}
-			libusb_exit(m_ctx);
-			errno = EACCES;
-			m_ctx = NULL;
-			return false;
-		}
+			device = devices[i];
+			device.interfaceNumber = deviceIds[j][2];
 			
-		m_isOpen = true;
-		return true;
-	#endif
+			currentDevice.vendorID = device.vendorID;
+			currentDevice.productID = device.productID;
+			currentDevice.manufacturer = device.manufacturer;
+			currentDevice.product = device.product;
+			currentDevice.serialNumber = device.serialNumber;
+			currentDevice.path = device.path;
+			currentDevice.model = (KeyboardModel)deviceIds[j][3];
+			break;
+		}
+		if (currentDevice.model != KeyboardModel::unknown) break;
+	}
+	
+	if (currentDevice.model == KeyboardModel::unknown) {
+		errno = ENODEV;
+		return false;
+	}
+	
+	if (! m_transport->open(device)) {
+		currentDevice.model = KeyboardModel::unknown;
+		errno = EACCES;
+		return false;
+	}
+	
+	m_isOpen = true;
+	m_protocol = &protocol::get(currentDevice.model);
+	updateColorTables();
+	
+	if (m_useDeviceCache && m_transport->validate(device)) {
+		DeviceCache::Entry entry;
+		entry.transport = m_transport->getName();
+		entry.model = (uint16_t)currentDevice.model;
+		entry.device = device;
+		DeviceCache().store(entry);
+	}
+	
+	return true;
+}
 
-	return false; //In case neither is defined
+bool LedKeyboard::openCached(const vector<vector<uint16_t>> &deviceIds, uint16_t vendorID,
+			     uint16_t productID, const string &serial) {
+	DeviceCache cache;
+	DeviceCache::Entry entry;
+	if (! cache.lookup(m_transport->getName(), vendorID, productID, serial, entry)) return false;
+	
+	// The model still comes from the table, -tuk may have replaced it since
+	KeyboardModel model = KeyboardModel::unknown;
+	for (size_t i = 0; i < deviceIds.size(); i++) {
+		if (entry.device.vendorID != deviceIds[i][0] || entry.device.productID != deviceIds[i][1]) continue;
+		if (entry.device.interfaceNumber != deviceIds[i][2]) continue;
+		model = (KeyboardModel)deviceIds[i][3];
+		break;
+	}
+	
+	if (model == KeyboardModel::unknown || (uint16_t)model != entry.model ||
+	    ! m_transport->validate(entry.device) || ! m_transport->open(entry.device)) {
+		cache.remove(entry);
+		return false;
+	}
+	
+	currentDevice.vendorID = entry.device.vendorID;
+	currentDevice.productID = entry.device.productID;
+	currentDevice.manufacturer = entry.device.manufacturer;
+	currentDevice.product = entry.device.product;
+	currentDevice.serialNumber = entry.device.serialNumber;
+	currentDevice.path = entry.device.path;
+	currentDevice.model = model;
+	
+	m_isOpen = true;
+	return true;
 }
 
 LedKeyboard::DeviceInfo LedKeyboard::getCurrentDevice() {
@@ -358,26 +306,7 @@ bool LedKeyboard::close() {
 	if (! m_isOpen) return true;
 	m_isOpen = false;
 	
-	#if defined(hidapi)
-		hid_close(m_hidHandle);
-		m_hidHandle = NULL;
-		hid_exit();
-		return true;
-	#elif defined(libusb)
-		if (m_hidHandle == NULL) return true;
-		if(libusb_release_interface(m_hidHandle, 1) != 0) return false;
-		if(m_isKernellDetached==true) {
-			libusb_attach_kernel_driver(m_hidHandle, 1);
-			m_isKernellDetached = false;
-		}
-		libusb_close(m_hidHandle);
-		m_hidHandle = NULL;
-		libusb_exit(m_ctx);
-		m_ctx = NULL;
-		return true;
-	#endif
-	
-	return false;
+	return m_transport->close();
 }
 
 
@@ -386,329 +315,279 @@ LedKeyboard::KeyboardModel LedKeyboard::getKeyboardModel() {
 }
 
 bool LedKeyboard::commit() {
-	byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g213:
-		case KeyboardModel::g413:
-			return true; // Keyboard is non-transactional
-		case KeyboardModel::g410:
-		case KeyboardModel::g512:
-		case KeyboardModel::g513:
-		case KeyboardModel::g610:
-		case KeyboardModel::g810:
-		case KeyboardModel::gpro:
-			data = { 0x11, 0xff, 0x0c, 0x5a };
-			break;
-		case KeyboardModel::g815:
-			data = { 0x11, 0xff, 0x10, 0x7f };
-			break;
-		case KeyboardModel::g910:
-			data = { 0x11, 0xff, 0x0f, 0x5d };
-			break;
-		case KeyboardModel::g915:
-			data = { 0x11, 0x01, 0x0b, 0x7f };
-			break;
-		default:
-			return false;
-	}
-	data.resize(20, 0x00);
-	return sendDataInternal(data);
+	if (m_protocol->flags & protocol::nonTransactional) return true;
+	return sendFeatureReport(m_protocol->commit, {});
 }
 
 bool LedKeyboard::setKey(LedKeyboard::KeyValue keyValue) {
-	return setKeys(KeyValueArray {keyValue});
+	return setKeys(&keyValue, 1);
 }
 
-bool LedKeyboard::setKeys(KeyValueArray keyValues) {
-	if (keyValues.empty()) return false;
+bool LedKeyboard::setKeys(const KeyValueArray &keyValues) {
+	return setKeys(keyValues.data(), keyValues.size());
+}
+
+bool LedKeyboard::setKeys(const KeyValue *keyValues, size_t count) {
+	if (count == 0) return false;
 	
-	bool retval = true;
+	// A key given twice keeps its last color
+	uint8_t indexes[keyCount];
+	Color colors[keyCount];
+	bool isQueued[keyCount] = {};
+	uint8_t queued = 0;
+	for (size_t i = 0; i < count; i++) {
+		uint8_t index = keytable::indexOf(keyValues[i].key);
+		if (index == keytable::noIndex) continue;
+		if (! isQueued[index]) {
+			isQueued[index] = true;
+			indexes[queued++] = index;
+		}
+		colors[index] = calibrate(keyValues[i].color);
+	}
 	
-	vector<vector<KeyValue>> SortedKeys;
-	map<int32_t, vector<KeyValue>> KeyByColors;
-	map<int32_t, vector<KeyValue>>::iterator KeyByColorsIterator;
-	const uint8_t maxKeyPerColor = 13;
+	// Only send the keys whose color differs from what the device already has
+	uint8_t dirty = 0;
+	for (uint8_t i = 0; i < queued; i++) {
+		uint8_t index = indexes[i];
+		if (m_isShadowed[index] &&
+		    m_shadow[index].red == colors[index].red &&
+		    m_shadow[index].green == colors[index].green &&
+		    m_shadow[index].blue == colors[index].blue) {
+			m_stats.keysSkipped++;
+			continue;
+		}
+		indexes[dirty++] = index;
+	}
+	if (dirty == 0) return true;
 	
-	switch (currentDevice.model) {
-		case KeyboardModel::g815:
-		case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x0b;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x10;
-			}
-			for (uint8_t i = 0; i < keyValues.size(); i++) {
-				uint32_t colorkey = static_cast<uint32_t>(keyValues[i].color.red | keyValues[i].color.green << 8 | keyValues[i].color.blue << 16 );
-				if (KeyByColors.count(colorkey) == 0) KeyByColors.insert(pair<uint32_t, vector<KeyValue>>(colorkey, {}));
-				KeyByColors[colorkey].push_back(keyValues[i]);
-			}
+	bool retval = writeKeys(indexes, colors, dirty);
+	for (uint8_t i = 0; i < dirty; i++) {
+		// Unknown what made it when the write failed, send it again next time
+		m_isShadowed[indexes[i]] = retval;
+		m_shadow[indexes[i]] = colors[indexes[i]];
+	}
+	m_stats.keysSent += dirty;
+	return retval;
+}
+
+bool LedKeyboard::resync() {
+	uint8_t indexes[keyCount];
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < keyCount; i++)
+		if (m_isShadowed[i]) indexes[count++] = i;
+	if (count == 0) return true;
+	
+	bool retval = writeKeys(indexes, m_shadow, count);
+	if (! retval) invalidateShadow();
+	m_stats.keysSent += count;
+	return retval;
+}
+
+void LedKeyboard::invalidateShadow() {
+	fill(m_isShadowed, m_isShadowed + keyCount, false);
+}
+
+bool LedKeyboard::writeKeys(const uint8_t *keyIndexes, const Color *colors, uint8_t count) {
+	// Drop the keys the model does not have
+	uint8_t indexes[keyCount];
+	uint8_t queued = 0;
+	for (uint8_t i = 0; i < count; i++)
+		if (keytable::wireCode(currentDevice.model, keyIndexes[i]) != keytable::noCode)
+			indexes[queued++] = keyIndexes[i];
+	if (queued == 0) return true;
+	
+	bool retval = true;
+	uint16_t planned = 0;
+	uint16_t reports = 0;
+	LedTransport::Report report;
+	beginBatch();
+	
+	switch (m_protocol->keyEncoding) {
+		case protocol::KeyEncoding::colorGroups: {
+			// Colors in ascending order, keys of a color in the order they were given
+			const uint8_t maxKeyPerColor = m_protocol->maxKeysPerColor;
+			const uint8_t maxKeyPerReport = m_protocol->maxKeysPerReport;
+			uint64_t byColor[keyCount];
+			for (uint8_t i = 0; i < queued; i++) {
+				const Color &color = colors[indexes[i]];
+				byColor[i] = static_cast<uint64_t>(color.red | color.green << 8 | color.blue << 16) << 8 | i;
+			}
+			sort(byColor, byColor + queued);
 			
-			for (auto& x: KeyByColors) {
-				if (x.second.size() > 0) {
-					uint8_t gi = 0;
-					while (gi < x.second.size()) {
-						size_t data_size = 20;
-						byte_buffer_t data = { 0x11, g815_target, g815_feat_idx, 0x6c };
-						data.push_back(x.second[0].color.red);
-						data.push_back(x.second[0].color.green);
-						data.push_back(x.second[0].color.blue);
-						for (uint8_t i = 0; i < maxKeyPerColor; i++) {
-							if (gi + i < x.second.size()) {
-								switch (x.second[gi+i].key) {
-									case Key::logo2:
-									case Key::game:
-									case Key::caps:
-									case Key::scroll:
-									case Key::num:
-									case Key::stop:
-									case Key::g6:
-									case Key::g7:
-									case Key::g8:
-									case Key::g9:
-										break;
-									case Key::play:
-										data.push_back(0x9b);
-										break;
-									case Key::mute:
-										data.push_back(0x9c);
-										break;
-									case Key::next:
-										data.push_back(0x9d);
-										break;
-									case Key::prev:
-										data.push_back(0x9e);
-										break;
-									case Key::ctrl_left:
-									case Key::shift_left:
-									case Key::alt_left:
-									case Key::win_left:
-									case Key::ctrl_right:
-									case Key::shift_right:
-									case Key::alt_right:
-									case Key::win_right:
-										data.push_back((static_cast<uint8_t>(x.second[gi+i].key) & 0x00ff) - 0x78);
-										break;
-									default:
-										switch (static_cast<KeyAddressGroup>((static_cast<uint16_t>(x.second[gi+i].key) & 0xff00) / 0xff)) {
-											case KeyAddressGroup::logo:
-												data.push_back((static_cast<uint8_t>(x.second[gi+i].key) & 0x00ff) + 0xd1);
-												break;
-											case KeyAddressGroup::indicators:
-												data.push_back((static_cast<uint8_t>(x.second[gi+i].key) & 0x00ff) + 0x98);
-												break;
-											case KeyAddressGroup::gkeys:
-												data.push_back((static_cast<uint8_t>(x.second[gi+i].key) & 0x00ff) + 0xb3);
-												break;
-											case KeyAddressGroup::keys:
-												data.push_back((static_cast<uint8_t>(x.second[gi+i].key) & 0x00ff) - 0x03);
-												break;
-											default:
-												break;
-										}
-								}
-							}
-						}
-						
-						if (data.size() < data_size) data.push_back(0xff);
-						data.resize(data_size, 0x00);
-						if (retval) retval = sendDataInternal(data);
-						else sendDataInternal(data);
-						
-						gi = gi + maxKeyPerColor;
-					}
+			uint8_t runStarts[keyCount];
+			uint8_t runLengths[keyCount];
+			uint8_t runs = 0;
+			for (uint8_t i = 0; i < queued; i++) {
+				if (i == 0 || byColor[i] >> 8 != byColor[i - 1] >> 8) {
+					runStarts[runs] = i;
+					runLengths[runs++] = 0;
 				}
+				runLengths[runs - 1]++;
 			}
 			
-			break;
-		default:
-			SortedKeys = {
-				{}, // Logo AddressGroup
-				{}, // Indicators AddressGroup
-				{}, // Multimedia AddressGroup
-				{}, // GKeys AddressGroup
-				{} // Keys AddressGroup
-			};
+			// Full sets of 13 keys of a color always go as one 0x6c report. What is
+			// left of a color costs a 0x6c report of its own, or a share of the 0x1c
+			// reports that take 4 keys of any color. Moving the smallest leftovers
+			// first, keep the count of moved colors that needs the fewest reports.
+			uint16_t leftovers[keyCount];
+			uint8_t leftoverCount = 0;
+			for (uint8_t run = 0; run < runs; run++) {
+				planned += runLengths[run] / maxKeyPerColor;
+				if (runLengths[run] % maxKeyPerColor > 0)
+					leftovers[leftoverCount++] = (runLengths[run] % maxKeyPerColor) << 8 | run;
+			}
+			sort(leftovers, leftovers + leftoverCount);
 			
-			for (uint8_t i = 0; i < keyValues.size(); i++) {
-				switch(static_cast<LedKeyboard::KeyAddressGroup>(static_cast<uint16_t>(keyValues[i].key) >> 8 )) {
-					case LedKeyboard::KeyAddressGroup::logo:
-						switch (currentDevice.model) {
-							case LedKeyboard::KeyboardModel::g610:
-							case LedKeyboard::KeyboardModel::g810:
-							case LedKeyboard::KeyboardModel::gpro:
-								if (SortedKeys[0].size() <= 1 && keyValues[i].key == LedKeyboard::Key::logo)
-									SortedKeys[0].push_back(keyValues[i]);
-								break;
-							case LedKeyboard::KeyboardModel::g910:
-								if (SortedKeys[0].size() <= 2) SortedKeys[0].push_back(keyValues[i]);
-								break;
-							default:
-								break;
-						}
-						break;
-					case LedKeyboard::KeyAddressGroup::indicators:
-						if (SortedKeys[1].size() <= 5) SortedKeys[1].push_back(keyValues[i]);
-						break;
-					case LedKeyboard::KeyAddressGroup::multimedia:
-						switch (currentDevice.model) {
-							case LedKeyboard::KeyboardModel::g610:
-							case LedKeyboard::KeyboardModel::g810:
-							case LedKeyboard::KeyboardModel::gpro:
-								if (SortedKeys[2].size() <= 5) SortedKeys[2].push_back(keyValues[i]);
-								break;
-							default:
-								break;
-						}
-						break;
-					case LedKeyboard::KeyAddressGroup::gkeys:
-						switch (currentDevice.model) {
-							case LedKeyboard::KeyboardModel::g910:
-								if (SortedKeys[3].size() <= 9) SortedKeys[3].push_back(keyValues[i]);
-								break;
-							default:
-								break;
-						}
-						break;
-					case LedKeyboard::KeyAddressGroup::keys:
-						switch (currentDevice.model) {
-							case LedKeyboard::KeyboardModel::g512:
-							case LedKeyboard::KeyboardModel::g513:
-							case LedKeyboard::KeyboardModel::g610:
-							case LedKeyboard::KeyboardModel::g810:
-							case LedKeyboard::KeyboardModel::g910:
-							case LedKeyboard::KeyboardModel::gpro:
-								if (SortedKeys[4].size() <= 120) SortedKeys[4].push_back(keyValues[i]);
-								break;
-							case LedKeyboard::KeyboardModel::g410:
-								if (SortedKeys[4].size() <= 120)
-									if (keyValues[i].key < LedKeyboard::Key::num_lock ||
-										keyValues[i].key > LedKeyboard::Key::num_dot)
-										SortedKeys[4].push_back(keyValues[i]);
-								break;
-							default:
-								break;
-						}
-						break;
+			uint8_t moved = 0;
+			uint16_t movedKeys = 0;
+			uint16_t bestCost = leftoverCount;
+			for (uint8_t i = 1; i <= leftoverCount; i++) {
+				movedKeys += leftovers[i - 1] >> 8;
+				uint16_t cost = (leftoverCount - i) + (movedKeys + maxKeyPerReport - 1) / maxKeyPerReport;
+				if (cost < bestCost) {
+					bestCost = cost;
+					moved = i;
+				}
+			}
+			planned += bestCost;
+			bool isMoved[keyCount] = {};
+			for (uint8_t i = 0; i < moved; i++) isMoved[leftovers[i] & 0xff] = true;
+			
+			uint8_t perKey[keyCount];
+			uint8_t perKeyCount = 0;
+			for (uint8_t run = 0; run < runs; run++) {
+				const uint8_t end = runStarts[run] + runLengths[run];
+				const uint8_t groupedEnd = isMoved[run] ?
+					runStarts[run] + runLengths[run] / maxKeyPerColor * maxKeyPerColor : end;
+				const Color &color = colors[indexes[byColor[runStarts[run]] & 0xff]];
+				
+				uint8_t i = runStarts[run];
+				while (i < groupedEnd) {
+					fillReport(report, 20, { 0x11, m_protocol->deviceIndex, m_protocol->keyColors.index,
+								 m_protocol->keyColors.function, color.red, color.green, color.blue });
+					size_t pos = 7;
+					for (uint8_t n = 0; n < maxKeyPerColor && i < groupedEnd; n++, i++)
+						report.data[pos++] = keytable::wireCode(currentDevice.model, indexes[byColor[i] & 0xff]);
+					
+					if (pos < report.size) report.data[pos] = 0xff;
+					if (! sendReport(report)) retval = false;
+					reports++;
 				}
+				for (; i < end; i++) perKey[perKeyCount++] = i;
 			}
 			
-			for (uint8_t kag = 0; kag < 5; kag++) {
+			const protocol::Header &header = m_protocol->keyGroups[static_cast<uint8_t>(KeyAddressGroup::keys)];
+			for (uint8_t i = 0; i < perKeyCount; i += maxKeyPerReport) {
+				fillReport(report, protocol::reportSize(header), header);
+				size_t pos = header.size;
+				for (uint8_t n = i; n < i + maxKeyPerReport && n < perKeyCount; n++) {
+					uint8_t index = indexes[byColor[perKey[n]] & 0xff];
+					report.data[pos++] = keytable::wireCode(currentDevice.model, index);
+					report.data[pos++] = colors[index].red;
+					report.data[pos++] = colors[index].green;
+					report.data[pos++] = colors[index].blue;
+				}
+				
+				if (pos < report.size) report.data[pos] = 0xff;
+				if (! sendReport(report)) retval = false;
+				reports++;
+			}
+			break;
+		}
+		case protocol::KeyEncoding::keyGroups:
+			for (uint8_t group = 0; group < keytable::groupCount; group++) {
+				const protocol::Header &header = m_protocol->keyGroups[group];
+				if (header.size == 0) continue;
 				
-				if (SortedKeys[kag].size() > 0) {
+				// Header then up to 3 (short report) or 14 keys as code, red, green, blue
+				const size_t data_size = protocol::reportSize(header);
+				const uint8_t maxKeyCount = (data_size - 8) / 4;
+				uint8_t groupKeys = 0;
+				for (uint8_t i = 0; i < queued; i++)
+					if (static_cast<uint8_t>(keytable::groupOf(keytable::entries[indexes[i]].key)) == group) groupKeys++;
+				planned += (groupKeys + maxKeyCount - 1) / maxKeyCount;
+				
+				size_t pos = 0;
+				for (uint8_t i = 0; i < queued; i++) {
+					if (static_cast<uint8_t>(keytable::groupOf(keytable::entries[indexes[i]].key)) != group) continue;
 					
-					uint8_t gi = 0;
-					while (gi < SortedKeys[kag].size()) {
-						
-						size_t data_size = 0;
-						byte_buffer_t data = {};
-						
-						switch (kag) {
-							case 0:
-								data_size = 20;
-								data = getKeyGroupAddress(LedKeyboard::KeyAddressGroup::logo);
-								break;
-							case 1:
-								data_size = 64;
-								data = getKeyGroupAddress(LedKeyboard::KeyAddressGroup::indicators);
-								break;
-							case 2:
-								data_size = 64;
-								data = getKeyGroupAddress(LedKeyboard::KeyAddressGroup::multimedia);
-								break;
-							case 3:
-								data_size = 64;
-								data = getKeyGroupAddress(LedKeyboard::KeyAddressGroup::gkeys);
-								break;
-							case 4:
-								data_size = 64;
-								data = getKeyGroupAddress(LedKeyboard::KeyAddressGroup::keys);
-								break;
-						}
-						
-						const uint8_t maxKeyCount = (data_size - 8) / 4;
-						
-						if (data.size() > 0) {
-							
-							for (uint8_t i = 0; i < maxKeyCount; i++) {
-								if (gi + i < SortedKeys[kag].size()) {
-									data.push_back(static_cast<uint8_t>(
-										static_cast<uint16_t>(SortedKeys[kag][gi+i].key) & 0x00ff));
-									data.push_back(SortedKeys[kag][gi+i].color.red);
-									data.push_back(SortedKeys[kag][gi+i].color.green);
-									data.push_back(SortedKeys[kag][gi+i].color.blue);
-								}
-							}
-							
-							data.resize(data_size, 0x00);
-							
-							if (retval) retval = sendDataInternal(data);
-							else sendDataInternal(data);
-							
-						}
-						
-						gi = gi + maxKeyCount;
+					if (pos == 0) {
+						fillReport(report, data_size, header);
+						pos = header.size;
 					}
+					const Color &color = colors[indexes[i]];
+					report.data[pos++] = keytable::wireCode(currentDevice.model, indexes[i]);
+					report.data[pos++] = color.red;
+					report.data[pos++] = color.green;
+					report.data[pos++] = color.blue;
 					
+					if (pos == data_size) {
+						if (! sendReport(report)) retval = false;
+						reports++;
+						pos = 0;
+					}
+				}
+				if (pos > 0) {
+					if (! sendReport(report)) retval = false;
+					reports++;
 				}
 			}
+			break;
+		case protocol::KeyEncoding::none:
+			break;
 	}
 	
+	if (! flushBatch()) retval = false;
+	m_stats.keyReportsPlanned += planned;
+	m_stats.keyReports += reports;
 	return retval;
 }
 
-bool LedKeyboard::setGroupKeys(KeyGroup keyGroup, LedKeyboard::Color color) {
-	KeyValueArray keyValues;
-	
-	KeyArray keyArray;
-	
+const LedKeyboard::KeyArray *LedKeyboard::getGroupKeys(KeyGroup keyGroup) {
 	switch (keyGroup) {
 		case KeyGroup::logo:
-			keyArray = keyGroupLogo;
-			break;
+			return &keyGroupLogo;
 		case KeyGroup::indicators:
-			keyArray = keyGroupIndicators;
-			break;
+			return &keyGroupIndicators;
 		case KeyGroup::gkeys:
-			keyArray = keyGroupGKeys;
-			break;
+			return &keyGroupGKeys;
 		case KeyGroup::multimedia:
-			keyArray = keyGroupMultimedia;
-			break;
+			return &keyGroupMultimedia;
 		case KeyGroup::fkeys:
-			keyArray = keyGroupFKeys;
-			break;
+			return &keyGroupFKeys;
 		case KeyGroup::modifiers:
-			keyArray = keyGroupModifiers;
-			break;
+			return &keyGroupModifiers;
 		case KeyGroup::arrows:
-			keyArray = keyGroupArrows;
-			break;
+			return &keyGroupArrows;
 		case KeyGroup::numeric:
-			keyArray = keyGroupNumeric;
-			break;
+			return &keyGroupNumeric;
 		case KeyGroup::functions:
-			keyArray = keyGroupFunctions;
-			break;
+			return &keyGroupFunctions;
 		case KeyGroup::keys:
-			keyArray = keyGroupKeys;
-			break;
+			return &keyGroupKeys;
 		default:
-			break;
+			return NULL;
 	}
+}
+
+bool LedKeyboard::setGroupKeys(KeyGroup keyGroup, LedKeyboard::Color color) {
+	const KeyArray *keyArray = getGroupKeys(keyGroup);
+	if (keyArray == NULL) return false;
 	
-	for (uint8_t i = 0; i < keyArray.size(); i++) keyValues.push_back({keyArray[i], color});
+	KeyValue keyValues[keyCount];
+	size_t count = 0;
+	for (size_t i = 0; i < keyArray->size() && count < keyCount; i++) keyValues[count++] = { (*keyArray)[i], color };
 	
-	return setKeys(keyValues);
+	return setKeys(keyValues, count);
 }
 
 bool LedKeyboard::setAllKeys(LedKeyboard::Color color) {
-	KeyValueArray keyValues;
+	KeyValue keyValues[keyCount];
+	size_t count = 0;
+	const KeyArray *keyArrays[] = {
+		&keyGroupLogo, &keyGroupIndicators, &keyGroupMultimedia, &keyGroupGKeys, &keyGroupFKeys,
+		&keyGroupFunctions, &keyGroupArrows, &keyGroupNumeric, &keyGroupModifiers, &keyGroupKeys
+	};
 
 	switch (currentDevice.model) {
 		case KeyboardModel::g213:
@@ -726,17 +605,10 @@ bool LedKeyboard::setAllKeys(LedKeyboard::Color color) {
 		case KeyboardModel::g815:
 		case KeyboardModel::g910:
 		case KeyboardModel::gpro:
-			for (uint8_t i = 0; i < keyGroupLogo.size(); i++) keyValues.push_back({keyGroupLogo[i], color});
-			for (uint8_t i = 0; i < keyGroupIndicators.size(); i++) keyValues.push_back({keyGroupIndicators[i], color});
-			for (uint8_t i = 0; i < keyGroupMultimedia.size(); i++) keyValues.push_back({keyGroupMultimedia[i], color});
-			for (uint8_t i = 0; i < keyGroupGKeys.size(); i++) keyValues.push_back({keyGroupGKeys[i], color});
-			for (uint8_t i = 0; i < keyGroupFKeys.size(); i++) keyValues.push_back({keyGroupFKeys[i], color});
-			for (uint8_t i = 0; i < keyGroupFunctions.size(); i++) keyValues.push_back({keyGroupFunctions[i], color});
-			for (uint8_t i = 0; i < keyGroupArrows.size(); i++) keyValues.push_back({keyGroupArrows[i], color});
-			for (uint8_t i = 0; i < keyGroupNumeric.size(); i++) keyValues.push_back({keyGroupNumeric[i], color});
-			for (uint8_t i = 0; i < keyGroupModifiers.size(); i++) keyValues.push_back({keyGroupModifiers[i], color});
-			for (uint8_t i = 0; i < keyGroupKeys.size(); i++) keyValues.push_back({keyGroupKeys[i], color});
-			return setKeys(keyValues);
+			for (const KeyArray *keyArray : keyArrays)
+				for (size_t i = 0; i < keyArray->size() && count < keyCount; i++)
+					keyValues[count++] = { (*keyArray)[i], color };
+			return setKeys(keyValues, count);
 		default:
 			return false;
 	}
@@ -745,212 +617,43 @@ bool LedKeyboard::setAllKeys(LedKeyboard::Color color) {
 
 
 bool LedKeyboard::setMRKey(uint8_t value) {
-	LedKeyboard::byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g815:
-		case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x13;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x0c;
-			}
-			switch (value) {
-				case 0x00:
-				case 0x01:
-					data = { 0x11, g815_target, g815_feat_idx, 0x0c, value };
-					data.resize(20, 0x00);
-					return sendDataInternal(data);
-				default:
-					break;
-			}
-			break;
-		case KeyboardModel::g910:
-			switch (value) {
-				case 0x00:
-				case 0x01:
-					data = { 0x11, 0xff, 0x0a, 0x0e, value };
-					data.resize(20, 0x00);
-					return sendDataInternal(data);
-				default:
-					break;
-			}
-			break;
-		default:
-			break;
-	}
-	return false;
+	if (value > 0x01) return false;
+	return sendFeatureReport(m_protocol->mrKey, { value });
 }
 
 bool LedKeyboard::setMNKey(uint8_t value) {
-	LedKeyboard::byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g815:
-		case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x12;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x0b;
-			}
-			switch (value) {
-				case 0x01:
-                    data = { 0x11, g815_target, g815_feat_idx, 0x1c, 0x01 };
-                    data.resize(20, 0x00);
-                    return sendDataInternal(data);
-                case 0x02:
-                    data = { 0x11, g815_target, g815_feat_idx, 0x1c, 0x02 };
-                    data.resize(20, 0x00);
-                    return sendDataInternal(data);
-                case 0x03:
-                    data = { 0x11, g815_target, g815_feat_idx, 0x1c, 0x04 };
-                    data.resize(20, 0x00);
-                    return sendDataInternal(data);
-				default:
-					break;
-			}
-			break;
-		case KeyboardModel::g910:
-			switch (value) {
-				case 0x00:
-				case 0x01:
-				case 0x02:
-				case 0x03:
-				case 0x04:
-				case 0x05:
-				case 0x06:
-				case 0x07:
-					data = { 0x11, 0xff, 0x09, 0x1e, value };
-					data.resize(20, 0x00);
-					return sendDataInternal(data);
-				default:
-					break;
-			}
-			break;
-		default:
-			break;
-	}
-	return false;
+	if (m_protocol->flags & protocol::mnKeyBitmask) {
+		if (value < 0x01 || value > 0x03) return false;
+		value = 0x01 << (value - 1);
+	} else if (value > 0x07) return false;
+	return sendFeatureReport(m_protocol->mnKey, { value });
 }
 
 bool LedKeyboard::setGKeysMode(uint8_t value) {
-	LedKeyboard::byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g815:
-		case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x11;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x0a;
-			}
-			switch (value) {
-				case 0x00:
-				case 0x01:
-					data = { 0x11, g815_target, g815_feat_idx, 0x2b, value };
-					data.resize(20, 0x00);
-					return sendDataInternal(data);
-				default:
-					break;
-			}
-			break;
-		case KeyboardModel::g910:
-			switch (value) {
-				case 0x00:
-				case 0x01:
-					data = { 0x11, 0xff, 0x08, 0x2e, value };
-					data.resize(20, 0x00);
-					return sendDataInternal(data);
-				default:
-					break;
-			}
-			break;
-		default:
-			break;
-	}
-	return false;
+	if (value > 0x01) return false;
+	return sendFeatureReport(m_protocol->gKeysMode, { value });
 }
 
 bool LedKeyboard::setRegion(uint8_t region, LedKeyboard::Color color) {
-	LedKeyboard::byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g213:
-			data = { 0x11, 0xff, 0x0c, 0x3a, region, 0x01, color.red, color.green, color.blue };
-			data.resize(20,0x00);
-			return sendDataInternal(data);
-			break;
-		default:
-			break;
-	}
-
-	return false;
+	invalidateShadow();
+	color = calibrate(color);
+	return sendFeatureReport(m_protocol->region, { region, 0x01, color.red, color.green, color.blue });
 }
 
 bool LedKeyboard::setStartupMode(StartupMode startupMode) {
-	byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g213:
-		case KeyboardModel::g410:
-		case KeyboardModel::g610:
-		case KeyboardModel::g810:
-		case KeyboardModel::gpro:
-			data = { 0x11, 0xff, 0x0d, 0x5a, 0x00, 0x01 };
-			break;
-		case KeyboardModel::g910:
-			data = { 0x11, 0xff, 0x10, 0x5e, 0x00, 0x01 };
-			break;
-		default:
-			return false;
-	}
-	data.push_back((unsigned char)startupMode);
-	data.resize(20, 0x00);
-	return sendDataInternal(data);
+	return sendFeatureReport(m_protocol->startupMode, { 0x00, 0x01, static_cast<uint8_t>(startupMode) });
 }
 
 bool LedKeyboard::setOnBoardMode(OnBoardMode onBoardMode) {
-	byte_buffer_t data;
-	switch (currentDevice.model) {
-		case KeyboardModel::g815:
-		case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x15;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x11;
-			}
-			data = { 0x11, g815_target, g815_feat_idx, 0x1a, static_cast<uint8_t>(onBoardMode) };
-			data.resize(20, 0x00);
-			return sendDataInternal(data);
-		default:
-			return false;
-	}
+	invalidateShadow();
+	return sendFeatureReport(m_protocol->onBoardMode, { static_cast<uint8_t>(onBoardMode) });
 }
 
 bool LedKeyboard::setNativeEffect(NativeEffect effect, NativeEffectPart part,
 				  std::chrono::duration<uint16_t, std::milli> period, Color color,
 				  NativeEffectStorage storage) {
-	uint8_t protocolBytes[2] = {0x00, 0x00};
 	NativeEffectGroup effectGroup = static_cast<NativeEffectGroup>(static_cast<uint16_t>(effect) >> 8);
+	invalidateShadow(); // The effect takes over the LEDs
 
 	// NativeEffectPart::all is not in the device protocol, but an alias for both keys and logo, plus indicators
 	if (part == LedKeyboard::NativeEffectPart::all) {
@@ -980,43 +683,13 @@ bool LedKeyboard::setNativeEffect(NativeEffect effect, NativeEffectPart part,
 			setNativeEffect(effect, LedKeyboard::NativeEffectPart::logo, period, color, storage));
 	}
 
-	unsigned char target = 0xff;
-
-	switch (currentDevice.model) {
-		case KeyboardModel::g213:
-		case KeyboardModel::g413:
-			protocolBytes[0] = 0x0c;
-			protocolBytes[1] = 0x3c;
-			if (part == NativeEffectPart::logo) return true; //Does not have logo component
-			break;
-		case KeyboardModel::g410:
-		case KeyboardModel::g512:
-		case KeyboardModel::g513:
-		case KeyboardModel::g610: // Unconfirmed
-		case KeyboardModel::g810:
-		case KeyboardModel::gpro:
-			protocolBytes[0] = 0x0d;
-			protocolBytes[1] = 0x3c;
-			break;
-		case KeyboardModel::g815:
-			protocolBytes[0] = 0x0f;
-			protocolBytes[1] = 0x1c;
-			break;
-		case KeyboardModel::g915:
-			protocolBytes[0] = 0x0a;
-			protocolBytes[1] = 0x1c;
-			target = 0x01;
-			break;
-		case KeyboardModel::g910:
-			protocolBytes[0] = 0x10;
-			protocolBytes[1] = 0x3c;
-			break;
-		default:
-			return false;
-	}
+	const protocol::Feature &feature = m_protocol->nativeEffect;
+	if (feature.index == 0x00) return false;
+	if (part == NativeEffectPart::logo && ! (m_protocol->flags & protocol::effectLogo)) return true; //Does not have logo component
+	color = calibrate(color);
 
 	byte_buffer_t data = {
-		0x11, target, protocolBytes[0], protocolBytes[1],
+		0x11, m_protocol->deviceIndex, feature.index, feature.function,
 		(uint8_t)part, static_cast<uint8_t>(effectGroup),
 		// color of static-color and breathing effects
 		color.red, color.green, color.blue,
@@ -1034,213 +707,199 @@ bool LedKeyboard::setNativeEffect(NativeEffect effect, NativeEffectPart part,
 		0, // unused?
 	};
 
-	byte_buffer_t setupData;
-	bool retval;
-	switch (currentDevice.model) {
-		case KeyboardModel::g815:
-		case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x0a;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x0f;
-			}
-			setupData = { 0x11, g815_target, g815_feat_idx, 0x5c, 0x01, 0x03, 0x03 };
-			setupData.resize(20, 0x00);
-			retval = sendDataInternal(setupData);
-
-			data[16] = 0x01;
-
-			switch (part) {
-				case NativeEffectPart::keys:
-					data[4] = 0x01;
-
-					//Seems to conflict with a star-like effect on G410 and G810
-					switch (effect) {
-						case NativeEffect::ripple:
-							//Adjust periodicity
-							data[9]=0x00;
-							data[10]=period.count() >> 8 & 0xff;;
-							data[11]=period.count() & 0xff;
-							data[12]=0x00;
-							break;
-						default:
-							break;
-					}
-					break;
-				case NativeEffectPart::logo:
-					data[4] = 0x00;
-					switch (effect) {
-						case NativeEffect::breathing:
-							data[5]=0x03;
-							break;
-						case NativeEffect::cwave:
-						case NativeEffect::vwave:
-						case NativeEffect::hwave:
-							data[5]=0x02;
-							data[13]=0x64;
-							break;
-						case NativeEffect::waves:
-						case NativeEffect::cycle:
-							data[5]=0x02;
-							break;
-						case NativeEffect::ripple:
-						case NativeEffect::off:
-							data[5]=0x00;
-							break;
-						default:
-							data[5]=0x01;
-							break;
-					}
-					break;
-				default:
-					break;
-			}
-			break;
-		default: //Many devices may not support logo coloring for wave?
-			if ((effectGroup == NativeEffectGroup::waves) && (part == NativeEffectPart::logo)) {
-				return setNativeEffect(NativeEffect::color, part, std::chrono::seconds(0), Color({0x00, 0xff, 0xff}), storage);
-			}
-			break;
+	if (m_protocol->effectSetup.index != 0x00) {
+		sendFeatureReport(m_protocol->effectSetup, { 0x01, 0x03, 0x03 });
+
+		data[16] = 0x01;
+
+		switch (part) {
+			case NativeEffectPart::keys:
+				data[4] = 0x01;
+
+				//Seems to conflict with a star-like effect on G410 and G810
+				switch (effect) {
+					case NativeEffect::ripple:
+						//Adjust periodicity
+						data[9]=0x00;
+						data[10]=period.count() >> 8 & 0xff;;
+						data[11]=period.count() & 0xff;
+						data[12]=0x00;
+						break;
+					default:
+						break;
+				}
+				break;
+			case NativeEffectPart::logo:
+				data[4] = 0x00;
+				switch (effect) {
+					case NativeEffect::breathing:
+						data[5]=0x03;
+						break;
+					case NativeEffect::cwave:
+					case NativeEffect::vwave:
+					case NativeEffect::hwave:
+						data[5]=0x02;
+						data[13]=0x64;
+						break;
+					case NativeEffect::waves:
+					case NativeEffect::cycle:
+						data[5]=0x02;
+						break;
+					case NativeEffect::ripple:
+					case NativeEffect::off:
+						data[5]=0x00;
+						break;
+					default:
+						data[5]=0x01;
+						break;
+				}
+				break;
+			default:
+				break;
+		}
+	} else if (effectGroup == NativeEffectGroup::waves && part == NativeEffectPart::logo) {
+		//Many devices may not support logo coloring for wave?
+		return setNativeEffect(NativeEffect::color, part, std::chrono::seconds(0), Color({0x00, 0xff, 0xff}), storage);
 	}
-	retval = sendDataInternal(data);
-	return retval;
+
+	return sendDataInternal(data);
 }
 
 
 bool LedKeyboard::sendDataInternal(byte_buffer_t &data) {
-	if (data.size() > 0) {
-		#if defined(hidapi)
-			if (! open(currentDevice.vendorID, currentDevice.productID, currentDevice.serialNumber)) return false;
-			if (hid_write(m_hidHandle, const_cast<unsigned char*>(data.data()), data.size()) < 0) {
-				std::cout<<"Error: Can not write to hidraw, try with the libusb version"<<std::endl;
-				return false;
-			}
-			close();
-			/*
-			byte_buffer_t data2;
-			data2.resize(21, 0x00);
-			hid_read_timeout(m_hidHandle, const_cast<unsigned char*>(data2.data()), data2.size(), 1);
-			*/
-			return true;
-		#elif defined(libusb)
-			int interface_num;
-			int interrupt_endpoint;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					interface_num = 2;
-					interrupt_endpoint = 0x83;
-					break;
-				default:
-					interface_num = 1;
-					interrupt_endpoint = 0x82;
-			}
+	if (data.size() > 0 && data.size() <= LedTransport::maxReportSize) {
+		LedTransport::Report report;
+		fillReport(report, data.size(), data);
+		return sendReport(report);
+	}
+	
+	return false;
+}
 
-			if (! m_isOpen) return false;
-			if (data.size() > 20) {
-				if(libusb_control_transfer(m_hidHandle, 0x21, 0x09, 0x0212, interface_num, 
-						const_cast<unsigned char*>(data.data()), data.size(), 2000) < 0)
-					return false;
-			} else {
-				if(libusb_control_transfer(m_hidHandle, 0x21, 0x09, 0x0211, interface_num, 
-						const_cast<unsigned char*>(data.data()), data.size(), 2000) < 0)
-					return false;
-			}
-			usleep(1000);
-			unsigned char buffer[64];
-			int len = 0;
-			libusb_interrupt_transfer(m_hidHandle, interrupt_endpoint, buffer, sizeof(buffer), &len, 1);
+bool LedKeyboard::sendFeatureReport(const protocol::Feature &feature, initializer_list<unsigned char> params) {
+	if (feature.index == 0x00) return false; // Not on this model
+	
+	LedTransport::Report report;
+	fillReport(report, 20, { 0x11, m_protocol->deviceIndex, feature.index, feature.function });
+	copy(params.begin(), params.end(), report.data + 4);
+	return sendReport(report);
+}
+
+bool LedKeyboard::sendReport(const LedTransport::Report &report) {
+	if (m_isBatching) {
+		m_batch.push_back(report); // Reserved for a whole frame, no allocation
+		return true;
+	}
+	
+	return writeReport(report);
+}
+
+bool LedKeyboard::writeReport(const LedTransport::Report &report) {
+	if (! m_isOpen && ! reconnect()) return false;
+	
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	if (! m_transport->write(report.data, report.size)) {
+		// The handle goes stale when the keyboard is unplugged or re-enumerated,
+		// so reopen the device once and retry before giving up
+		if (! reconnect() || ! m_transport->write(report.data, report.size)) {
+			m_stats.errors++;
+			std::string error = m_transport->getError();
+			if (! error.empty()) std::cout<<"Error: "<<error<<std::endl;
+			return false;
+		}
+		m_stats.reconnects++;
+	}
+	m_stats.writeTime += chrono::steady_clock::now() - start;
+	m_stats.packets++;
+	m_stats.bytes += report.size;
+	
+	if (m_ackTimeout.count() > 0) return waitForAck(report);
+	return true;
+}
+
+bool LedKeyboard::waitForAck(const LedTransport::Report &report) {
+	const unsigned char *data = report.data;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	chrono::steady_clock::time_point deadline = start + m_ackTimeout;
+	unsigned char reply[64];
+	
+	while (true) {
+		int remaining = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+		if (remaining < 0) break;
+		int len = m_transport->read(reply, sizeof(reply), remaining);
+		if (len < 0) {
+			m_stats.errors++;
+			errno = EIO;
+			return false;
+		}
+		if (len == 0) break;
+		
+		// Skip key events and notifications, only the reply to this report counts
+		if (len < 5 || reply[1] != data[1]) continue;
+		if ((reply[2] == 0xff || reply[2] == 0x8f) && reply[3] == data[2] && reply[4] == data[3]) {
+			// HID++ 2.0 (0xff) or 1.0 (0x8f) error for our feature index and function
+			m_stats.ackErrors++;
+			m_lastAckError = len > 5 ? reply[5] : 0xff;
+			errno = EIO;
+			return false;
+		}
+		if (reply[2] == data[2] && reply[3] == data[3]) {
+			m_stats.acks++;
+			m_stats.ackTime += chrono::steady_clock::now() - start;
 			return true;
-		#endif
+		}
 	}
 	
+	m_stats.ackTimeouts++;
+	errno = ETIMEDOUT;
 	return false;
 }
 
-LedKeyboard::byte_buffer_t LedKeyboard::getKeyGroupAddress(LedKeyboard::KeyAddressGroup keyAddressGroup) {
-	switch (currentDevice.model) {
-		case KeyboardModel::g213:
-		case KeyboardModel::g413:
-		  return {}; // Device doesn't support per-key setting
-		case KeyboardModel::g410:
-		case KeyboardModel::g512:
-		case KeyboardModel::g513:
-		case KeyboardModel::gpro:
-			switch (keyAddressGroup) {
-				case LedKeyboard::KeyAddressGroup::logo:
-					return { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 };
-				case LedKeyboard::KeyAddressGroup::indicators:
-					return { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 };
-				case LedKeyboard::KeyAddressGroup::gkeys:
-					return {};
-				case LedKeyboard::KeyAddressGroup::multimedia:
-					return {};
-				case LedKeyboard::KeyAddressGroup::keys:
-					return { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e };
-			}
-			break;
-		case KeyboardModel::g610:
-		case KeyboardModel::g810:
-			switch (keyAddressGroup) {
-				case LedKeyboard::KeyAddressGroup::logo:
-					return { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 };
-				case LedKeyboard::KeyAddressGroup::indicators:
-					return { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 };
-				case LedKeyboard::KeyAddressGroup::gkeys:
-					return {};
-				case LedKeyboard::KeyAddressGroup::multimedia:
-					return { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x02, 0x00, 0x05 };
-				case LedKeyboard::KeyAddressGroup::keys:
-					return { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e };
-			}
-			break;
-		case KeyboardModel::g815:
-			case KeyboardModel::g915:
-			unsigned char g815_target;
-			unsigned char g815_feat_idx;
-			switch (currentDevice.model) {
-				case KeyboardModel::g915:
-					g815_target = 0x01;
-					g815_feat_idx = 0x0b;
-					break;
-				default:
-					g815_target = 0xff;
-					g815_feat_idx = 0x10;
-			}
-			switch (keyAddressGroup) {
-				case LedKeyboard::KeyAddressGroup::logo:
-					return { 0x11, g815_target, g815_feat_idx, 0x1c };
-				case LedKeyboard::KeyAddressGroup::indicators:
-					return { 0x11, g815_target, g815_feat_idx, 0x1c };
-				case LedKeyboard::KeyAddressGroup::gkeys:
-					return { 0x11, g815_target, g815_feat_idx, 0x1c };
-				case LedKeyboard::KeyAddressGroup::multimedia:
-					return { 0x11, g815_target, g815_feat_idx, 0x1c };
-				case LedKeyboard::KeyAddressGroup::keys:
-					return { 0x11, g815_target, g815_feat_idx, 0x1c };
-			}
-			break;
-		case KeyboardModel::g910:
-			switch (keyAddressGroup) {
-				case LedKeyboard::KeyAddressGroup::logo:
-					return { 0x11, 0xff, 0x0f, 0x3a, 0x00, 0x10, 0x00, 0x02 };
-				case LedKeyboard::KeyAddressGroup::indicators:
-					return { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 };
-				case LedKeyboard::KeyAddressGroup::gkeys:
-					return { 0x12, 0xff, 0x0f, 0x3e, 0x00, 0x04, 0x00, 0x09 };
-				case LedKeyboard::KeyAddressGroup::multimedia:
-					return {};
-				case LedKeyboard::KeyAddressGroup::keys:
-					return { 0x12, 0xff, 0x0f, 0x3d, 0x00, 0x01, 0x00, 0x0e };
-			}
-			break;
-		default:
-			break;
+void LedKeyboard::beginBatch() {
+	m_isBatching = true;
+	m_batch.clear();
+}
+
+bool LedKeyboard::flushBatch() {
+	m_isBatching = false;
+	if (m_batch.empty()) return true;
+	
+	if (m_ackTimeout.count() > 0) {
+		// Each report waits for the device to acknowledge the previous one
+		bool retval = true;
+		for (size_t i = 0; i < m_batch.size(); i++)
+			if (! writeReport(m_batch[i])) retval = false;
+		m_batch.clear();
+		return retval;
+	}
+	
+	if (! m_isOpen && ! reconnect()) return false;
+	
+	// Hand the whole frame to the transport in one go so it can submit the
+	// reports back to back, and only reconnect for what did not make it
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	size_t sent = m_transport->writeBatch(m_batch.data(), m_batch.size());
+	if (sent < m_batch.size()) {
+		size_t remaining = m_batch.size() - sent;
+		if (! reconnect() || m_transport->writeBatch(m_batch.data() + sent, remaining) < remaining) {
+			m_stats.errors++;
+			m_batch.clear();
+			return false;
+		}
+		m_stats.reconnects++;
 	}
-	return {};
+	m_stats.writeTime += chrono::steady_clock::now() - start;
+	m_stats.packets += m_batch.size();
+	for (size_t i = 0; i < m_batch.size(); i++) m_stats.bytes += m_batch[i].size;
+	m_batch.clear();
+	return true;
+}
+
+bool LedKeyboard::reconnect() {
+	uint16_t vendorID = currentDevice.vendorID;
+	uint16_t productID = currentDevice.productID;
+	string serial = currentDevice.serialNumber;
+	// Drop the stale handle, but keep matching the same physical keyboard
+	if (m_isOpen) close();
+	return open(vendorID, productID, serial);
 }
@@ -18,20 +18,25 @@
 #define KEYBOARD_CLASS
 
 #include <chrono>
+#include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <vector>
 
-#if defined(hidapi)
-	#include "hidapi/hidapi.h"
-#elif defined(libusb)
-	#include "libusb-1.0/libusb.h"
-#endif
+#include "Transport.h"
+
+namespace protocol {
+	struct Descriptor;
+	struct Feature;
+}
+
+class Calibration;
 
 
 class LedKeyboard {
 	
 	
-	private:
+	public:
 		
 		enum class KeyAddressGroup : uint8_t {
 			logo = 0x00,
@@ -41,9 +46,6 @@ class LedKeyboard {
 			keys
 		};
 		
-		
-	public:
-		
 		std::vector<std::vector<uint16_t>> SupportedKeyboards = {
 			{ 0x46d, 0xc336, 1, (uint16_t)KeyboardModel::g213 },
 			{ 0x46d, 0xc330, 1, (uint16_t)KeyboardModel::g410 },
@@ -75,6 +77,12 @@ class LedKeyboard {
 			g915,
 			gpro
 		};
+		enum class TransportType : uint8_t {
+			hidApi,
+			libUsb,
+			hidRaw,
+			memory
+		};
 		enum class StartupMode : uint8_t {
 			 // TODO: On the G Pro, the value 1 selects the
 			 // user-stored lighting effect, which is not
@@ -127,7 +135,7 @@ class LedKeyboard {
 			numeric,
 			keys
 		};
-		enum class Key : uint16_t { // 127 items
+		enum class Key : uint16_t { // 128 items
 			
 			logo = static_cast<uint8_t>(KeyAddressGroup::logo) << 8 | 0x01,
 			logo2,
@@ -183,12 +191,63 @@ class LedKeyboard {
 			LedKeyboard::Color color;
 		};
 		
+		// Lookup table per channel that every color goes through before it is sent
+		struct ColorTables {
+			uint8_t red[256];
+			uint8_t green[256];
+			uint8_t blue[256];
+		};
+		
 		typedef std::vector<KeyValue> KeyValueArray;
+		typedef std::vector<Key> KeyArray;
+		
+		static const uint8_t keyCount = 128; // Number of Key values
+		
+		struct Stats {
+			uint64_t packets = 0;
+			uint64_t bytes = 0;
+			uint64_t errors = 0;
+			uint64_t reconnects = 0;
+			uint64_t acks = 0;
+			uint64_t ackTimeouts = 0;
+			uint64_t ackErrors = 0;
+			uint64_t keysSent = 0;
+			uint64_t keysSkipped = 0; // Already had that color
+			uint64_t keyReports = 0; // Reports setKeys sent
+			uint64_t keyReportsPlanned = 0; // Reports setKeys expected to need
+			std::chrono::nanoseconds writeTime = std::chrono::nanoseconds(0);
+			std::chrono::nanoseconds ackTime = std::chrono::nanoseconds(0);
+		};
 		
 		
+		LedKeyboard();
 		~LedKeyboard();
 		
 		
+		// Dense 0..keyCount-1 numbering of the keys, keyCount for an unknown key
+		static uint8_t getKeyIndex(Key key);
+		static Key getKey(uint8_t index);
+		
+		
+		bool setTransport(TransportType transportType);
+		void setTransport(LedTransport *transport); // Takes ownership
+		LedTransport *getTransport();
+		
+		// Wait up to timeout for the HID++ reply of every report before sending
+		// the next one, 0 sends reports without waiting
+		void setAckTimeout(std::chrono::milliseconds timeout);
+		uint8_t getLastAckError(); // HID++ error code of the last rejected report
+		
+		// Reopen the keyboard from the path cached by the last open, instead of
+		// enumerating every device (on by default)
+		void setDeviceCache(bool enabled);
+		
+		// Tables of the model are picked on each open, NULL sends colors as given
+		void setCalibration(std::shared_ptr<const Calibration> calibration);
+		
+		Stats getStats();
+		void resetStats();
+		
 		std::vector<DeviceInfo> listKeyboards();
 		
 		bool isOpen();
@@ -202,8 +261,13 @@ class LedKeyboard {
 		bool commit();
 		
 		bool setKey(KeyValue keyValue);
-		bool setKeys(KeyValueArray keyValues);
+		bool setKeys(const KeyValueArray &keyValues);
+		bool setKeys(const KeyValue *keyValues, size_t count);
+		// Send every key again, for when something else changed the LEDs behind our back
+		bool resync();
+		void invalidateShadow(); // Next setKeys sends every key it is given
 		bool setGroupKeys(KeyGroup keyGroup, Color color);
+		const KeyArray *getGroupKeys(KeyGroup keyGroup); // NULL for an unknown group
 		bool setAllKeys(Color color);
 		
 		bool setMRKey(uint8_t value);
@@ -222,7 +286,6 @@ class LedKeyboard {
 	private:
 		
 		typedef std::vector<unsigned char> byte_buffer_t;
-		typedef std::vector<Key> KeyArray;
 		
 		
 		const KeyArray keyGroupLogo = { Key::logo, Key::logo2 };
@@ -259,17 +322,40 @@ class LedKeyboard {
 		bool m_isOpen = false;
 		DeviceInfo currentDevice;
 		
-		#if defined(hidapi)
-			hid_device *m_hidHandle;
-		#elif defined(libusb)
-			bool m_isKernellDetached = false;
-			libusb_device_handle *m_hidHandle;
-			libusb_context *m_ctx = NULL;
-		#endif
+		std::unique_ptr<LedTransport> m_transport;
+		Stats m_stats;
+		
+		bool m_isBatching = false;
+		std::vector<LedTransport::Report> m_batch;
+		const protocol::Descriptor *m_protocol; // Wire format of the current model
+		
+		std::chrono::milliseconds m_ackTimeout = std::chrono::milliseconds(0);
+		uint8_t m_lastAckError = 0;
+		
+		bool m_useDeviceCache = true;
+		
+		std::shared_ptr<const Calibration> m_calibration;
+		ColorTables m_colorTables;
+		
+		Color m_shadow[keyCount]; // Last color sent for each key index
+		bool m_isShadowed[keyCount] = {};
 		
 		
 		bool sendDataInternal(byte_buffer_t &data);
-		byte_buffer_t getKeyGroupAddress(KeyAddressGroup keyAddressGroup);
+		bool sendReport(const LedTransport::Report &report);
+		bool sendFeatureReport(const protocol::Feature &feature, std::initializer_list<unsigned char> params);
+		bool writeReport(const LedTransport::Report &report);
+		bool waitForAck(const LedTransport::Report &report);
+		bool writeKeys(const uint8_t *indexes, const Color *colors, uint8_t count);
+		void updateColorTables();
+		Color calibrate(Color color) {
+			return { m_colorTables.red[color.red], m_colorTables.green[color.green], m_colorTables.blue[color.blue] };
+		}
+		void beginBatch();
+		bool flushBatch();
+		bool openCached(const std::vector<std::vector<uint16_t>> &deviceIds, uint16_t vendorID,
+				uint16_t productID, const std::string &serial);
+		bool reconnect();
 		
 };
 
@@ -0,0 +1,235 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Layout.h"
+
+
+namespace layout {
+	
+	namespace {
+		
+		typedef LedKeyboard::Key Key;
+		
+		struct Place {
+			Key key;
+			Position position;
+		};
+		
+		const Place places[] = {
+			{ Key::logo, { 8.0f, -1.25f, 1.0f } }, { Key::logo2, { 9.0f, -1.25f, 1.0f } },
+			{ Key::backlight, { 15.25f, -1.25f, 1.0f } }, { Key::game, { 16.25f, -1.25f, 1.0f } },
+			{ Key::num, { 18.5f, -1.25f, 1.0f } }, { Key::caps, { 19.5f, -1.25f, 1.0f } },
+			{ Key::scroll, { 20.5f, -1.25f, 1.0f } }, { Key::mute, { 21.5f, -1.25f, 1.0f } },
+			{ Key::g6, { 2.0f, -1.25f, 1.0f } }, { Key::g7, { 3.0f, -1.25f, 1.0f } },
+			{ Key::g8, { 4.0f, -1.25f, 1.0f } }, { Key::g9, { 5.0f, -1.25f, 1.0f } },
+			
+			{ Key::esc, { 0.0f, 0.0f, 1.0f } },
+			{ Key::f1, { 2.0f, 0.0f, 1.0f } }, { Key::f2, { 3.0f, 0.0f, 1.0f } },
+			{ Key::f3, { 4.0f, 0.0f, 1.0f } }, { Key::f4, { 5.0f, 0.0f, 1.0f } },
+			{ Key::f5, { 6.5f, 0.0f, 1.0f } }, { Key::f6, { 7.5f, 0.0f, 1.0f } },
+			{ Key::f7, { 8.5f, 0.0f, 1.0f } }, { Key::f8, { 9.5f, 0.0f, 1.0f } },
+			{ Key::f9, { 11.0f, 0.0f, 1.0f } }, { Key::f10, { 12.0f, 0.0f, 1.0f } },
+			{ Key::f11, { 13.0f, 0.0f, 1.0f } }, { Key::f12, { 14.0f, 0.0f, 1.0f } },
+			{ Key::print_screen, { 15.25f, 0.0f, 1.0f } }, { Key::scroll_lock, { 16.25f, 0.0f, 1.0f } },
+			{ Key::pause_break, { 17.25f, 0.0f, 1.0f } },
+			{ Key::prev, { 18.5f, 0.0f, 1.0f } }, { Key::play, { 19.5f, 0.0f, 1.0f } },
+			{ Key::next, { 20.5f, 0.0f, 1.0f } }, { Key::stop, { 21.5f, 0.0f, 1.0f } },
+			
+			{ Key::g1, { -1.5f, 1.25f, 1.0f } }, { Key::tilde, { 0.0f, 1.25f, 1.0f } },
+			{ Key::n1, { 1.0f, 1.25f, 1.0f } }, { Key::n2, { 2.0f, 1.25f, 1.0f } },
+			{ Key::n3, { 3.0f, 1.25f, 1.0f } }, { Key::n4, { 4.0f, 1.25f, 1.0f } },
+			{ Key::n5, { 5.0f, 1.25f, 1.0f } }, { Key::n6, { 6.0f, 1.25f, 1.0f } },
+			{ Key::n7, { 7.0f, 1.25f, 1.0f } }, { Key::n8, { 8.0f, 1.25f, 1.0f } },
+			{ Key::n9, { 9.0f, 1.25f, 1.0f } }, { Key::n0, { 10.0f, 1.25f, 1.0f } },
+			{ Key::minus, { 11.0f, 1.25f, 1.0f } }, { Key::equal, { 12.0f, 1.25f, 1.0f } },
+			{ Key::backspace, { 13.0f, 1.25f, 2.0f } },
+			{ Key::insert, { 15.25f, 1.25f, 1.0f } }, { Key::home, { 16.25f, 1.25f, 1.0f } },
+			{ Key::page_up, { 17.25f, 1.25f, 1.0f } },
+			{ Key::num_lock, { 18.5f, 1.25f, 1.0f } }, { Key::num_slash, { 19.5f, 1.25f, 1.0f } },
+			{ Key::num_asterisk, { 20.5f, 1.25f, 1.0f } }, { Key::num_minus, { 21.5f, 1.25f, 1.0f } },
+			
+			{ Key::g2, { -1.5f, 2.25f, 1.0f } }, { Key::tab, { 0.0f, 2.25f, 1.5f } },
+			{ Key::q, { 1.5f, 2.25f, 1.0f } }, { Key::w, { 2.5f, 2.25f, 1.0f } },
+			{ Key::e, { 3.5f, 2.25f, 1.0f } }, { Key::r, { 4.5f, 2.25f, 1.0f } },
+			{ Key::t, { 5.5f, 2.25f, 1.0f } }, { Key::y, { 6.5f, 2.25f, 1.0f } },
+			{ Key::u, { 7.5f, 2.25f, 1.0f } }, { Key::i, { 8.5f, 2.25f, 1.0f } },
+			{ Key::o, { 9.5f, 2.25f, 1.0f } }, { Key::p, { 10.5f, 2.25f, 1.0f } },
+			{ Key::open_bracket, { 11.5f, 2.25f, 1.0f } }, { Key::close_bracket, { 12.5f, 2.25f, 1.0f } },
+			{ Key::backslash, { 13.5f, 2.25f, 1.5f } },
+			{ Key::del, { 15.25f, 2.25f, 1.0f } }, { Key::end, { 16.25f, 2.25f, 1.0f } },
+			{ Key::page_down, { 17.25f, 2.25f, 1.0f } },
+			{ Key::num_7, { 18.5f, 2.25f, 1.0f } }, { Key::num_8, { 19.5f, 2.25f, 1.0f } },
+			{ Key::num_9, { 20.5f, 2.25f, 1.0f } }, { Key::num_plus, { 21.5f, 2.75f, 1.0f } },
+			
+			{ Key::g3, { -1.5f, 3.25f, 1.0f } }, { Key::caps_lock, { 0.0f, 3.25f, 1.75f } },
+			{ Key::a, { 1.75f, 3.25f, 1.0f } }, { Key::s, { 2.75f, 3.25f, 1.0f } },
+			{ Key::d, { 3.75f, 3.25f, 1.0f } }, { Key::f, { 4.75f, 3.25f, 1.0f } },
+			{ Key::g, { 5.75f, 3.25f, 1.0f } }, { Key::h, { 6.75f, 3.25f, 1.0f } },
+			{ Key::j, { 7.75f, 3.25f, 1.0f } }, { Key::k, { 8.75f, 3.25f, 1.0f } },
+			{ Key::l, { 9.75f, 3.25f, 1.0f } }, { Key::semicolon, { 10.75f, 3.25f, 1.0f } },
+			{ Key::quote, { 11.75f, 3.25f, 1.0f } }, { Key::dollar, { 12.75f, 3.25f, 1.0f } },
+			{ Key::enter, { 12.75f, 3.25f, 2.25f } },
+			{ Key::num_4, { 18.5f, 3.25f, 1.0f } }, { Key::num_5, { 19.5f, 3.25f, 1.0f } },
+			{ Key::num_6, { 20.5f, 3.25f, 1.0f } },
+			
+			{ Key::g4, { -1.5f, 4.25f, 1.0f } }, { Key::shift_left, { 0.0f, 4.25f, 2.25f } },
+			{ Key::intl_backslash, { 1.25f, 4.25f, 1.0f } },
+			{ Key::z, { 2.25f, 4.25f, 1.0f } }, { Key::x, { 3.25f, 4.25f, 1.0f } },
+			{ Key::c, { 4.25f, 4.25f, 1.0f } }, { Key::v, { 5.25f, 4.25f, 1.0f } },
+			{ Key::b, { 6.25f, 4.25f, 1.0f } }, { Key::n, { 7.25f, 4.25f, 1.0f } },
+			{ Key::m, { 8.25f, 4.25f, 1.0f } }, { Key::comma, { 9.25f, 4.25f, 1.0f } },
+			{ Key::period, { 10.25f, 4.25f, 1.0f } }, { Key::slash, { 11.25f, 4.25f, 1.0f } },
+			{ Key::abnt_slash, { 12.25f, 4.25f, 1.0f } }, { Key::shift_right, { 12.25f, 4.25f, 2.75f } },
+			{ Key::arrow_top, { 16.25f, 4.25f, 1.0f } },
+			{ Key::num_1, { 18.5f, 4.25f, 1.0f } }, { Key::num_2, { 19.5f, 4.25f, 1.0f } },
+			{ Key::num_3, { 20.5f, 4.25f, 1.0f } }, { Key::num_enter, { 21.5f, 4.75f, 1.0f } },
+			
+			{ Key::g5, { -1.5f, 5.25f, 1.0f } }, { Key::ctrl_left, { 0.0f, 5.25f, 1.25f } },
+			{ Key::win_left, { 1.25f, 5.25f, 1.25f } }, { Key::alt_left, { 2.5f, 5.25f, 1.25f } },
+			{ Key::space, { 3.75f, 5.25f, 6.25f } }, { Key::alt_right, { 10.0f, 5.25f, 1.25f } },
+			{ Key::win_right, { 11.25f, 5.25f, 1.25f } }, { Key::menu, { 12.5f, 5.25f, 1.25f } },
+			{ Key::ctrl_right, { 13.75f, 5.25f, 1.25f } },
+			{ Key::arrow_left, { 15.25f, 5.25f, 1.0f } }, { Key::arrow_bottom, { 16.25f, 5.25f, 1.0f } },
+			{ Key::arrow_right, { 17.25f, 5.25f, 1.0f } },
+			{ Key::num_0, { 18.5f, 5.25f, 2.0f } }, { Key::num_dot, { 20.5f, 5.25f, 1.0f } }
+		};
+		
+		// Parts of the full size board that not every model has
+		enum Section : uint8_t {
+			numpad = 1 << 0,
+			media = 1 << 1, // Keys and volume above the numpad
+			logo = 1 << 2,
+			gKeysLeft = 1 << 3, // g1 to g5
+			gKeysTop = 1 << 4 // g6 to g9 above the F-keys, and the second logo
+		};
+		
+		uint8_t getSections(LedKeyboard::KeyboardModel model) {
+			typedef LedKeyboard::KeyboardModel KeyboardModel;
+			switch (model) {
+				case KeyboardModel::g410:
+				case KeyboardModel::gpro:
+					return logo; // Tenkeyless
+				case KeyboardModel::g413:
+				case KeyboardModel::g512:
+				case KeyboardModel::g513:
+					return numpad;
+				case KeyboardModel::g213:
+				case KeyboardModel::g610:
+				case KeyboardModel::g810:
+					return numpad | media | logo;
+				case KeyboardModel::g815:
+				case KeyboardModel::g915:
+					return numpad | media | logo | gKeysLeft;
+				default:
+					return numpad | media | logo | gKeysLeft | gKeysTop;
+			}
+		}
+		
+		uint8_t getSection(Key key) {
+			switch (key) {
+				case Key::num_lock: case Key::num_slash: case Key::num_asterisk: case Key::num_minus:
+				case Key::num_7: case Key::num_8: case Key::num_9: case Key::num_plus:
+				case Key::num_4: case Key::num_5: case Key::num_6:
+				case Key::num_1: case Key::num_2: case Key::num_3: case Key::num_enter:
+				case Key::num_0: case Key::num_dot:
+					return numpad;
+				case Key::prev: case Key::play: case Key::next: case Key::stop: case Key::mute:
+					return media;
+				case Key::logo:
+					return logo;
+				case Key::g1: case Key::g2: case Key::g3: case Key::g4: case Key::g5:
+					return gKeysLeft;
+				case Key::g6: case Key::g7: case Key::g8: case Key::g9: case Key::logo2:
+					return gKeysTop;
+				default:
+					return 0;
+			}
+		}
+		
+		void build(LedKeyboard::KeyboardModel model, Geometry &geometry) {
+			uint8_t sections = getSections(model);
+			bool isFirst = true;
+			for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+				Key key = LedKeyboard::getKey(i);
+				uint8_t section = getSection(key);
+				Position position;
+				geometry.isPlaced[i] = (section == 0 || (sections & section) != 0) && getPosition(key, position);
+				if (! geometry.isPlaced[i]) {
+					geometry.x[i] = geometry.y[i] = geometry.width[i] = 0;
+					continue;
+				}
+				geometry.x[i] = position.x + position.width / 2;
+				geometry.y[i] = position.y + 0.5f;
+				geometry.width[i] = position.width;
+				if (isFirst || geometry.x[i] < geometry.left) geometry.left = geometry.x[i];
+				if (isFirst || geometry.x[i] > geometry.right) geometry.right = geometry.x[i];
+				if (isFirst || geometry.y[i] < geometry.top) geometry.top = geometry.y[i];
+				if (isFirst || geometry.y[i] > geometry.bottom) geometry.bottom = geometry.y[i];
+				isFirst = false;
+			}
+		}
+		
+	}
+	
+	bool getPosition(LedKeyboard::Key key, Position &position) {
+		// Built once, indexed like the keys
+		static const struct Table {
+			Position positions[LedKeyboard::keyCount];
+			bool isPlaced[LedKeyboard::keyCount] = {};
+			Table() {
+				for (const Place &place : places) {
+					uint8_t index = LedKeyboard::getKeyIndex(place.key);
+					if (index >= LedKeyboard::keyCount) continue;
+					positions[index] = place.position;
+					isPlaced[index] = true;
+				}
+			}
+		} table;
+		
+		uint8_t index = LedKeyboard::getKeyIndex(key);
+		if (index >= LedKeyboard::keyCount || ! table.isPlaced[index]) return false;
+		position = table.positions[index];
+		return true;
+	}
+	
+	const Geometry &getGeometry(LedKeyboard::KeyboardModel model) {
+		// Built once for every model
+		static const struct Table {
+			Geometry geometries[static_cast<uint8_t>(LedKeyboard::KeyboardModel::gpro) + 1];
+			Table() {
+				for (uint8_t i = 0; i < sizeof(geometries) / sizeof(geometries[0]); i++)
+					build(static_cast<LedKeyboard::KeyboardModel>(i), geometries[i]);
+			}
+		} table;
+		
+		uint8_t index = static_cast<uint8_t>(model);
+		if (index >= sizeof(table.geometries) / sizeof(table.geometries[0])) index = 0;
+		return table.geometries[index];
+	}
+	
+	void paint(const float *levels, LedKeyboard::Color background, LedKeyboard::Color color, LedKeyboard::Color *colors) {
+		const float red = color.red - background.red;
+		const float green = color.green - background.green;
+		const float blue = color.blue - background.blue;
+		// Rounded, with levels within 0 and 1 the sum is never negative
+		for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+			colors[i].red = background.red + red * levels[i] + 0.5f;
+			colors[i].green = background.green + green * levels[i] + 0.5f;
+			colors[i].blue = background.blue + blue * levels[i] + 0.5f;
+		}
+	}
+	
+}
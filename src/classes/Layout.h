@@ -0,0 +1,67 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef LAYOUT_CLASS
+#define LAYOUT_CLASS
+
+#include "Keyboard.h"
+
+
+// Where the keys are, for effects that spread over the keyboard
+namespace layout {
+	
+	// In key units (19.05mm), x to the right and y down from the top left of esc
+	struct Position {
+		float x;
+		float y;
+		float width;
+	};
+	
+	// The keys of one model, indexed like the keys and one array per
+	// coordinate, so that a function of the position vectorizes over them
+	struct Geometry {
+		float x[LedKeyboard::keyCount]; // Middle of the key
+		float y[LedKeyboard::keyCount];
+		float width[LedKeyboard::keyCount];
+		bool isPlaced[LedKeyboard::keyCount];
+		// Extent of the middles of the placed keys
+		float left;
+		float right;
+		float top;
+		float bottom;
+	};
+	
+	// A full size board with G-keys on the left, both ANSI and ISO keys are
+	// placed, a model only has one of them. False for a key it does not place
+	bool getPosition(LedKeyboard::Key key, Position &position);
+	
+	// The keys a model has, unknown gets every key of the full size board
+	const Geometry &getGeometry(LedKeyboard::KeyboardModel model);
+	
+	// levels[i] = function(x[i], y[i]) for every key index in one pass, 0 for
+	// the keys the model does not have
+	template <typename Function>
+	void evaluate(const Geometry &geometry, Function function, float *levels) {
+		for (uint8_t i = 0; i < LedKeyboard::keyCount; i++)
+			levels[i] = geometry.isPlaced[i] ? function(geometry.x[i], geometry.y[i]) : 0.0f;
+	}
+	
+	// From background at level 0 to color at level 1
+	void paint(const float *levels, LedKeyboard::Color background, LedKeyboard::Color color, LedKeyboard::Color *colors);
+	
+}
+
+#endif
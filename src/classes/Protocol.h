@@ -0,0 +1,223 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROTOCOL_HELPER
+#define PROTOCOL_HELPER
+
+#include <cstdint>
+
+#include "Keyboard.h"
+
+
+// What each model expects on the wire, one descriptor per KeyboardModel,
+// picked once when the keyboard is opened
+namespace protocol {
+
+	// HID++ feature index and function (with software ID) of a command,
+	// index 0 (the root feature) when the model does not have the command
+	struct Feature {
+		uint8_t index;
+		uint8_t function;
+	};
+
+	// Start of a key report for one KeyAddressGroup, size 0 when the model
+	// has no such keys
+	struct Header {
+		uint8_t size;
+		uint8_t bytes[8];
+	};
+
+	enum class KeyEncoding : uint8_t {
+		none, // No per-key lighting
+		keyGroups, // A report per address group, then code, red, green, blue for each key
+		colorGroups // A color for up to maxKeysPerColor keys, or maxKeysPerReport keys with their own color
+	};
+
+	enum Flags : uint8_t {
+		nonTransactional = 0x01, // Shows colors right away, commit has nothing to do
+		mnKeyBitmask = 0x02, // M1-M3 are bits 0-2 instead of 0-7
+		effectLogo = 0x04 // Native effects can address the logo
+	};
+
+	struct Descriptor {
+		uint8_t deviceIndex; // 0xff for wired keyboards, 0x01 behind a receiver
+		uint8_t flags;
+		KeyEncoding keyEncoding;
+		Header keyGroups[5];
+		Feature keyColors; // One color for many keys
+		uint8_t maxKeysPerColor;
+		uint8_t maxKeysPerReport;
+		Feature commit;
+		Feature region;
+		Feature mrKey;
+		Feature mnKey;
+		Feature gKeysMode;
+		Feature startupMode;
+		Feature onBoardMode;
+		Feature nativeEffect;
+		Feature effectSetup; // Sent ahead of every native effect
+	};
+
+	constexpr Feature none = { 0x00, 0x00 };
+	constexpr Header noHeader = { 0, {} };
+
+	constexpr Descriptor descriptors[] = {
+		{ // unknown
+			0xff, 0, KeyEncoding::none,
+			{ noHeader, noHeader, noHeader, noHeader, noHeader },
+			none, 0, 0,
+			none, none, none, none, none, none, none, none, none
+		},
+		{ // g213
+			0xff, nonTransactional, KeyEncoding::none,
+			{ noHeader, noHeader, noHeader, noHeader, noHeader },
+			none, 0, 0,
+			none, { 0x0c, 0x3a }, none, none, none, { 0x0d, 0x5a }, none, { 0x0c, 0x3c }, none
+		},
+		{ // g410
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				noHeader,
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0c, 0x5a }, none, none, none, none, { 0x0d, 0x5a }, none, { 0x0d, 0x3c }, none
+		},
+		{ // g413
+			0xff, nonTransactional, KeyEncoding::none,
+			{ noHeader, noHeader, noHeader, noHeader, noHeader },
+			none, 0, 0,
+			none, none, none, none, none, none, none, { 0x0c, 0x3c }, none
+		},
+		{ // g512
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				noHeader,
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0c, 0x5a }, none, none, none, none, none, none, { 0x0d, 0x3c }, none
+		},
+		{ // g513
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				noHeader,
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0c, 0x5a }, none, none, none, none, none, none, { 0x0d, 0x3c }, none
+		},
+		{ // g610
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x02, 0x00, 0x05 } },
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0c, 0x5a }, none, none, none, none, { 0x0d, 0x5a }, none, { 0x0d, 0x3c }, none
+		},
+		{ // g810
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x02, 0x00, 0x05 } },
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0c, 0x5a }, none, none, none, none, { 0x0d, 0x5a }, none, { 0x0d, 0x3c }, none
+		},
+		{ // g815
+			0xff, mnKeyBitmask | effectLogo, KeyEncoding::colorGroups,
+			{
+				{ 4, { 0x11, 0xff, 0x10, 0x1c } },
+				{ 4, { 0x11, 0xff, 0x10, 0x1c } },
+				{ 4, { 0x11, 0xff, 0x10, 0x1c } },
+				{ 4, { 0x11, 0xff, 0x10, 0x1c } },
+				{ 4, { 0x11, 0xff, 0x10, 0x1c } }
+			},
+			{ 0x10, 0x6c }, 13, 4,
+			{ 0x10, 0x7f }, none, { 0x0c, 0x0c }, { 0x0b, 0x1c }, { 0x0a, 0x2b }, none, { 0x11, 0x1a },
+			{ 0x0f, 0x1c }, { 0x0f, 0x5c }
+		},
+		{ // g910
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0f, 0x3a, 0x00, 0x10, 0x00, 0x02 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0f, 0x3e, 0x00, 0x04, 0x00, 0x09 } },
+				{ 8, { 0x12, 0xff, 0x0f, 0x3d, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0f, 0x5d }, none, { 0x0a, 0x0e }, { 0x09, 0x1e }, { 0x08, 0x2e }, { 0x10, 0x5e }, none,
+			{ 0x10, 0x3c }, none
+		},
+		{ // g915
+			0x01, mnKeyBitmask | effectLogo, KeyEncoding::colorGroups,
+			{
+				{ 4, { 0x11, 0x01, 0x0b, 0x1c } },
+				{ 4, { 0x11, 0x01, 0x0b, 0x1c } },
+				{ 4, { 0x11, 0x01, 0x0b, 0x1c } },
+				{ 4, { 0x11, 0x01, 0x0b, 0x1c } },
+				{ 4, { 0x11, 0x01, 0x0b, 0x1c } }
+			},
+			{ 0x0b, 0x6c }, 13, 4,
+			{ 0x0b, 0x7f }, none, { 0x13, 0x0c }, { 0x12, 0x1c }, { 0x11, 0x2b }, none, { 0x15, 0x1a },
+			{ 0x0a, 0x1c }, { 0x0a, 0x5c }
+		},
+		{ // gpro
+			0xff, effectLogo, KeyEncoding::keyGroups,
+			{
+				{ 8, { 0x11, 0xff, 0x0c, 0x3a, 0x00, 0x10, 0x00, 0x01 } },
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x40, 0x00, 0x05 } },
+				noHeader,
+				noHeader,
+				{ 8, { 0x12, 0xff, 0x0c, 0x3a, 0x00, 0x01, 0x00, 0x0e } }
+			},
+			none, 0, 0,
+			{ 0x0c, 0x5a }, none, none, none, none, { 0x0d, 0x5a }, none, { 0x0d, 0x3c }, none
+		}
+	};
+	static_assert(sizeof(descriptors) / sizeof(descriptors[0]) == static_cast<size_t>(LedKeyboard::KeyboardModel::gpro) + 1,
+		      "Every KeyboardModel needs a protocol descriptor");
+
+	inline const Descriptor &get(LedKeyboard::KeyboardModel model) {
+		if (static_cast<size_t>(model) >= sizeof(descriptors) / sizeof(descriptors[0])) return descriptors[0];
+		return descriptors[static_cast<size_t>(model)];
+	}
+
+	// Short (0x11) reports are 20 bytes, long (0x12) ones 64
+	constexpr size_t reportSize(const Header &header) {
+		return header.bytes[0] == 0x12 ? 64 : 20;
+	}
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ReactiveEffect.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace {
+	
+	const chrono::milliseconds fadeTime(600);
+	const float heatPerPress = 0.2f;
+	const float coolTime = 4.0f; // Seconds for the heat to drop by e
+	const float rippleSpeed = 24.0f; // Key units per second
+	const float rippleWidth = 1.5f; // Key units
+	const chrono::milliseconds rippleTime(900);
+	
+	float seconds(chrono::steady_clock::duration duration) {
+		return chrono::duration<float>(duration).count();
+	}
+	
+}
+
+
+ReactiveEffect::ReactiveEffect(LedKeyboard::KeyboardModel model, Mode mode, LedKeyboard::Color color,
+			       LedKeyboard::Color background) :
+	m_mode(mode), m_color(color), m_background(background), m_geometry(layout::getGeometry(model)) {}
+
+
+void ReactiveEffect::press(LedKeyboard::Key key, chrono::steady_clock::time_point time) {
+	uint8_t index = LedKeyboard::getKeyIndex(key);
+	if (index >= LedKeyboard::keyCount) return;
+	
+	switch (m_mode) {
+		case Mode::fade:
+			m_pressed[index] = time;
+			break;
+		case Mode::heatmap:
+			cool(time);
+			m_heat[index] = min(1.0f, m_heat[index] + heatPerPress);
+			break;
+		case Mode::ripple:
+			if (! m_geometry.isPlaced[index]) break;
+			// The oldest ring makes way when a fast typist fills them all
+			m_ripples[m_nextRipple] = { m_geometry.x[index], m_geometry.y[index], time };
+			m_nextRipple = (m_nextRipple + 1) % maxRipples;
+			if (m_rippleCount < maxRipples) m_rippleCount++;
+			break;
+	}
+}
+
+void ReactiveEffect::cool(chrono::steady_clock::time_point time) {
+	if (time <= m_cooled) return;
+	float factor = exp(-seconds(time - m_cooled) / coolTime);
+	m_cooled = time;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+		m_heat[i] *= factor;
+		if (m_heat[i] < 1.0f / 512) m_heat[i] = 0;
+	}
+}
+
+
+bool ReactiveEffect::render(chrono::steady_clock::time_point time, LedKeyboard::Color *colors) {
+	float levels[LedKeyboard::keyCount] = {};
+	bool isMoving = false;
+	
+	switch (m_mode) {
+		case Mode::fade:
+			for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+				chrono::steady_clock::duration age = time - m_pressed[i];
+				if (age < chrono::steady_clock::duration::zero() || age >= fadeTime) continue;
+				levels[i] = 1.0f - seconds(age) / seconds(fadeTime);
+				isMoving = true;
+			}
+			break;
+		case Mode::heatmap:
+			cool(time);
+			for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+				levels[i] = m_heat[i];
+				if (m_heat[i] > 0) isMoving = true;
+			}
+			break;
+		case Mode::ripple:
+			for (uint8_t r = 0; r < m_rippleCount; r++) {
+				const Ripple &ripple = m_ripples[r];
+				chrono::steady_clock::duration age = time - ripple.start;
+				if (age < chrono::steady_clock::duration::zero() || age >= rippleTime) continue;
+				isMoving = true;
+				float radius = rippleSpeed * seconds(age);
+				float strength = 1.0f - seconds(age) / seconds(rippleTime);
+				float ring[LedKeyboard::keyCount];
+				layout::evaluate(m_geometry, [&](float x, float y) {
+					return (1.0f - fabs(hypot(x - ripple.x, y - ripple.y) - radius) / rippleWidth) * strength;
+				}, ring);
+				for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) levels[i] = max(levels[i], ring[i]);
+			}
+			break;
+	}
+	
+	layout::paint(levels, m_background, m_color, colors);
+	return isMoving;
+}
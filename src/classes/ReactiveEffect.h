@@ -0,0 +1,78 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef REACTIVEEFFECT_CLASS
+#define REACTIVEEFFECT_CLASS
+
+#include <chrono>
+#include <cstdint>
+
+#include "Keyboard.h"
+#include "Layout.h"
+
+
+// Lights keys as they are pressed, what NativeEffect::ripple does in the
+// firmware of some models, for any model with per-key colors. Keeps all its
+// state in fixed arrays, a press costs no allocation.
+class ReactiveEffect {
+
+
+	public:
+
+		enum class Mode : uint8_t {
+			fade, // The pressed key fades out
+			heatmap, // Presses add up on each key and cool down slowly
+			ripple // A ring spreads from the pressed key
+		};
+
+
+		ReactiveEffect(LedKeyboard::KeyboardModel model, Mode mode, LedKeyboard::Color color,
+			       LedKeyboard::Color background);
+
+		void press(LedKeyboard::Key key, std::chrono::steady_clock::time_point time);
+
+		// Colors of every key index at time, false once nothing moves any more
+		bool render(std::chrono::steady_clock::time_point time, LedKeyboard::Color *colors);
+
+
+	private:
+
+		static const uint8_t maxRipples = 16;
+
+		struct Ripple {
+			float x;
+			float y;
+			std::chrono::steady_clock::time_point start;
+		};
+
+		Mode m_mode;
+		LedKeyboard::Color m_color;
+		LedKeyboard::Color m_background;
+
+		const layout::Geometry &m_geometry;
+
+		std::chrono::steady_clock::time_point m_pressed[LedKeyboard::keyCount] = {}; // fade
+		float m_heat[LedKeyboard::keyCount] = {}; // heatmap
+		std::chrono::steady_clock::time_point m_cooled; // heatmap, when m_heat was last cooled
+		Ripple m_ripples[maxRipples]; // ripple, a ring buffer
+		uint8_t m_nextRipple = 0;
+		uint8_t m_rippleCount = 0;
+
+		void cool(std::chrono::steady_clock::time_point time);
+
+};
+
+#endif
@@ -0,0 +1,331 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Shader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#include "Layout.h"
+
+
+using namespace std;
+
+
+
+namespace {
+	
+	const uint8_t keyCount = LedKeyboard::keyCount;
+	
+	inline float clampUnit(float value) {
+		// NaN ends up at 0
+		return min(1.0f, max(0.0f, value));
+	}
+	
+	inline float fractional(float value) {
+		return value - floor(value);
+	}
+	
+}
+
+
+Shader::Shader(LedKeyboard::KeyboardModel model) {
+	const layout::Geometry &geometry = layout::getGeometry(model);
+	m_isPlaced = geometry.isPlaced;
+	m_registers.resize(inputCount);
+	for (uint8_t i = 0; i < keyCount; i++) {
+		m_registers[inputX].values[i] = geometry.x[i];
+		m_registers[inputY].values[i] = geometry.y[i];
+		m_registers[inputIndex].values[i] = i;
+		m_registers[inputTime].values[i] = 0;
+	}
+	compile("0");
+}
+
+
+bool Shader::compile(const string &source) {
+	m_program.clear();
+	m_registers.resize(inputCount);
+	m_isTemporary.assign(inputCount, false);
+	m_isFree.assign(inputCount, false);
+	m_source = source;
+	m_position = 0;
+	m_depth = 0;
+	m_error.clear();
+	
+	// A color function may only make the whole color, anything else is a gray level
+	skipSpaces();
+	size_t start = m_position;
+	while (m_position < m_source.size() && isalpha(m_source[m_position])) m_position++;
+	string name = m_source.substr(start, m_position - start);
+	skipSpaces();
+	if ((name == "hsv" || name == "rgb") && accept('(')) {
+		vector<uint8_t> regs;
+		if (! parseArguments(regs, 3)) return false;
+		copy(regs.begin(), regs.end(), m_outputs);
+		m_isHsv = name == "hsv";
+	} else {
+		m_position = start;
+		uint8_t reg;
+		if (! parseExpression(reg)) return false;
+		fill(m_outputs, m_outputs + 3, reg);
+		m_isHsv = false;
+	}
+	skipSpaces();
+	if (m_position < m_source.size()) return fail("Unexpected '" + string(1, m_source[m_position]) + "'");
+	return true;
+}
+
+string Shader::getError() {
+	return m_error;
+}
+
+size_t Shader::getInstructionCount() {
+	return m_program.size();
+}
+
+size_t Shader::getRegisterCount() {
+	return m_registers.size();
+}
+
+bool Shader::isDriven(uint8_t index) {
+	return index < keyCount && m_isPlaced[index];
+}
+
+
+bool Shader::fail(const string &error) {
+	if (m_error.empty()) m_error = error + " at " + to_string(m_position + 1);
+	m_program.clear();
+	m_registers.resize(inputCount);
+	fill(m_outputs, m_outputs + 3, inputIndex);
+	m_isHsv = false;
+	return false;
+}
+
+void Shader::skipSpaces() {
+	while (m_position < m_source.size() && isspace(m_source[m_position])) m_position++;
+}
+
+bool Shader::accept(char c) {
+	skipSpaces();
+	if (m_position >= m_source.size() || m_source[m_position] != c) return false;
+	m_position++;
+	return true;
+}
+
+bool Shader::expect(char c) {
+	if (accept(c)) return true;
+	return fail("Expected '" + string(1, c) + "'");
+}
+
+bool Shader::allocate(uint8_t &reg) {
+	for (size_t i = inputCount; i < m_registers.size(); i++) {
+		if (! m_isFree[i]) continue;
+		m_isFree[i] = false;
+		reg = i;
+		return true;
+	}
+	if (m_registers.size() >= maxRegisters) return fail("Expression too long");
+	reg = m_registers.size();
+	m_registers.push_back(Register());
+	m_isTemporary.push_back(true);
+	m_isFree.push_back(false);
+	return true;
+}
+
+void Shader::release(uint8_t reg) {
+	if (m_isTemporary[reg]) m_isFree[reg] = true;
+}
+
+// The target is taken before the operands are released, so that it never is
+// one of them and each instruction loops over distinct arrays
+bool Shader::emit(Op op, uint8_t &target, uint8_t a, uint8_t b, uint8_t c) {
+	if (! allocate(target)) return false;
+	m_program.push_back({ op, target, a, b, c });
+	release(a);
+	release(b);
+	release(c);
+	return true;
+}
+
+bool Shader::parseExpression(uint8_t &reg) {
+	if (! parseTerm(reg)) return false;
+	while (true) {
+		Op op;
+		if (accept('+')) op = Op::add;
+		else if (accept('-')) op = Op::subtract;
+		else return true;
+		uint8_t other;
+		if (! parseTerm(other) || ! emit(op, reg, reg, other)) return false;
+	}
+}
+
+bool Shader::parseTerm(uint8_t &reg) {
+	if (! parseFactor(reg)) return false;
+	while (true) {
+		Op op;
+		if (accept('*')) op = Op::multiply;
+		else if (accept('/')) op = Op::divide;
+		else if (accept('%')) op = Op::modulo;
+		else return true;
+		uint8_t other;
+		if (! parseFactor(other) || ! emit(op, reg, reg, other)) return false;
+	}
+}
+
+bool Shader::parseFactor(uint8_t &reg) {
+	if (m_depth == maxDepth) return fail("Expression too deep");
+	m_depth++;
+	bool isParsed = parseValue(reg);
+	m_depth--;
+	return isParsed;
+}
+
+bool Shader::parseValue(uint8_t &reg) {
+	skipSpaces();
+	if (m_position >= m_source.size()) return fail("Expected a value");
+	char c = m_source[m_position];
+	
+	if (accept('-')) {
+		uint8_t value;
+		return parseFactor(value) && emit(Op::negate, reg, value);
+	}
+	if (accept('(')) return parseExpression(reg) && expect(')');
+	
+	if (isdigit(c) || c == '.') {
+		// Constants get a register of their own, filled once here
+		char *end;
+		float value = strtof(m_source.c_str() + m_position, &end);
+		if (end == m_source.c_str() + m_position) return fail("Expected a value");
+		m_position = end - m_source.c_str();
+		if (! allocate(reg)) return false;
+		m_isTemporary[reg] = false;
+		fill(m_registers[reg].values, m_registers[reg].values + keyCount, value);
+		return true;
+	}
+	
+	if (! isalpha(c)) return fail("Expected a value");
+	size_t start = m_position;
+	while (m_position < m_source.size() && isalnum(m_source[m_position])) m_position++;
+	string name = m_source.substr(start, m_position - start);
+	
+	if (! accept('(')) {
+		if (name == "x") reg = inputX;
+		else if (name == "y") reg = inputY;
+		else if (name == "i") reg = inputIndex;
+		else if (name == "t") reg = inputTime;
+		else if (name == "pi") {
+			if (! allocate(reg)) return false;
+			m_isTemporary[reg] = false;
+			fill(m_registers[reg].values, m_registers[reg].values + keyCount, static_cast<float>(M_PI));
+		} else {
+			m_position = start;
+			return fail("Unknown variable " + name);
+		}
+		return true;
+	}
+	
+	struct Function {
+		const char *name;
+		Op op;
+		size_t arity;
+	};
+	static const Function functions[] = {
+		{ "sin", Op::sin, 1 }, { "cos", Op::cos, 1 }, { "abs", Op::abs, 1 }, { "floor", Op::floor, 1 },
+		{ "fract", Op::fract, 1 }, { "sqrt", Op::sqrt, 1 }, { "min", Op::min, 2 }, { "max", Op::max, 2 },
+		{ "pow", Op::pow, 2 }, { "step", Op::step, 2 }, { "clamp", Op::clamp, 3 }, { "mix", Op::mix, 3 }
+	};
+	for (const Function &function : functions) {
+		if (name != function.name) continue;
+		vector<uint8_t> args;
+		if (! parseArguments(args, function.arity)) return false;
+		args.resize(3, inputX);
+		return emit(function.op, reg, args[0], args[1], args[2]);
+	}
+	m_position = start;
+	if (name == "hsv" || name == "rgb") return fail(name + " can only make the whole color");
+	return fail("Unknown function " + name);
+}
+
+// After the opening parenthesis, up to and with the closing one
+bool Shader::parseArguments(vector<uint8_t> &regs, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		uint8_t reg;
+		if (i > 0 && ! expect(',')) return false;
+		if (! parseExpression(reg)) return false;
+		regs.push_back(reg);
+	}
+	return expect(')');
+}
+
+
+void Shader::run() {
+	for (const Instruction &instruction : m_program) {
+		float *__restrict__ target = m_registers[instruction.target].values;
+		const float *__restrict__ a = m_registers[instruction.a].values;
+		const float *__restrict__ b = m_registers[instruction.b].values;
+		const float *__restrict__ c = m_registers[instruction.c].values;
+		switch (instruction.op) {
+			case Op::add: for (uint8_t i = 0; i < keyCount; i++) target[i] = a[i] + b[i]; break;
+			case Op::subtract: for (uint8_t i = 0; i < keyCount; i++) target[i] = a[i] - b[i]; break;
+			case Op::multiply: for (uint8_t i = 0; i < keyCount; i++) target[i] = a[i] * b[i]; break;
+			case Op::divide: for (uint8_t i = 0; i < keyCount; i++) target[i] = a[i] / b[i]; break;
+			// As in GLSL, the sign of the divisor
+			case Op::modulo: for (uint8_t i = 0; i < keyCount; i++) target[i] = a[i] - b[i] * floor(a[i] / b[i]); break;
+			case Op::negate: for (uint8_t i = 0; i < keyCount; i++) target[i] = -a[i]; break;
+			case Op::sin: for (uint8_t i = 0; i < keyCount; i++) target[i] = sin(a[i]); break;
+			case Op::cos: for (uint8_t i = 0; i < keyCount; i++) target[i] = cos(a[i]); break;
+			case Op::abs: for (uint8_t i = 0; i < keyCount; i++) target[i] = fabs(a[i]); break;
+			case Op::floor: for (uint8_t i = 0; i < keyCount; i++) target[i] = floor(a[i]); break;
+			case Op::fract: for (uint8_t i = 0; i < keyCount; i++) target[i] = fractional(a[i]); break;
+			case Op::sqrt: for (uint8_t i = 0; i < keyCount; i++) target[i] = sqrt(max(0.0f, a[i])); break;
+			case Op::min: for (uint8_t i = 0; i < keyCount; i++) target[i] = min(a[i], b[i]); break;
+			case Op::max: for (uint8_t i = 0; i < keyCount; i++) target[i] = max(a[i], b[i]); break;
+			case Op::pow: for (uint8_t i = 0; i < keyCount; i++) target[i] = pow(a[i], b[i]); break;
+			case Op::step: for (uint8_t i = 0; i < keyCount; i++) target[i] = b[i] < a[i] ? 0.0f : 1.0f; break;
+			case Op::clamp: for (uint8_t i = 0; i < keyCount; i++) target[i] = min(c[i], max(b[i], a[i])); break;
+			case Op::mix: for (uint8_t i = 0; i < keyCount; i++) target[i] = a[i] + (b[i] - a[i]) * c[i]; break;
+		}
+	}
+}
+
+void Shader::render(chrono::steady_clock::duration time, LedKeyboard::Color *colors) {
+	float seconds = chrono::duration<float>(time).count();
+	fill(m_registers[inputTime].values, m_registers[inputTime].values + keyCount, seconds);
+	run();
+	
+	const float *first = m_registers[m_outputs[0]].values;
+	const float *second = m_registers[m_outputs[1]].values;
+	const float *third = m_registers[m_outputs[2]].values;
+	for (uint8_t i = 0; i < keyCount; i++) {
+		float red = first[i], green = second[i], blue = third[i];
+		if (m_isHsv) {
+			// Branchless, the hue picks how much of each channel
+			float hue = fractional(first[i]) * 6.0f, saturation = clampUnit(second[i]), value = clampUnit(third[i]);
+			red = value * (1.0f - saturation + saturation * clampUnit(fabs(hue - 3.0f) - 1.0f));
+			green = value * (1.0f - saturation + saturation * clampUnit(2.0f - fabs(hue - 2.0f)));
+			blue = value * (1.0f - saturation + saturation * clampUnit(2.0f - fabs(hue - 4.0f)));
+		}
+		colors[i] = {
+			static_cast<uint8_t>(clampUnit(red) * 255.0f + 0.5f),
+			static_cast<uint8_t>(clampUnit(green) * 255.0f + 0.5f),
+			static_cast<uint8_t>(clampUnit(blue) * 255.0f + 0.5f)
+		};
+	}
+}
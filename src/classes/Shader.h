@@ -0,0 +1,112 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHADER_CLASS
+#define SHADER_CLASS
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Keyboard.h"
+
+
+// Per key color expressions, such as "hsv(x * 0.05 + t / 4, 1, 1)". An
+// expression is compiled once into register bytecode, every register
+// holding one value per key, so that each instruction is a single loop over
+// all the keys of a frame.
+//
+// Values are numbers, x and y (the middle of the key in key units, from the
+// top left of esc), i (the key index), t (seconds since the start) and pi.
+// Operators are + - * / % and unary -, functions are sin, cos, abs, floor,
+// fract, sqrt, min, max, pow, step, clamp and mix. The whole expression is
+// either hsv(h, s, v) or rgb(r, g, b) with components from 0 to 1 (h wraps
+// around), or a single value for a gray level.
+class Shader {
+
+
+	public:
+
+		Shader(LedKeyboard::KeyboardModel model);
+
+		bool compile(const std::string &source);
+		std::string getError(); // Of the last compile
+
+		size_t getInstructionCount();
+		size_t getRegisterCount();
+		// Keys the model has, the others are left as they are
+		bool isDriven(uint8_t index);
+
+		void render(std::chrono::steady_clock::duration time, LedKeyboard::Color *colors);
+
+
+	private:
+
+		enum class Op : uint8_t {
+			add, subtract, multiply, divide, modulo, negate,
+			sin, cos, abs, floor, fract, sqrt,
+			min, max, pow, step,
+			clamp, mix
+		};
+		struct Instruction {
+			Op op;
+			uint8_t target;
+			uint8_t a;
+			uint8_t b;
+			uint8_t c;
+		};
+		struct Register {
+			float values[LedKeyboard::keyCount];
+		};
+
+		// Inputs come first, constants and temporaries follow as they are needed
+		enum Input : uint8_t { inputX, inputY, inputIndex, inputTime, inputCount };
+		static const size_t maxRegisters = 255;
+		static const size_t maxDepth = 64; // Of nested values, each one a recursion of the parser
+
+		const bool *m_isPlaced;
+		std::vector<Instruction> m_program;
+		std::vector<Register> m_registers;
+		std::vector<bool> m_isTemporary;
+		std::vector<bool> m_isFree;
+		uint8_t m_outputs[3] = {};
+		bool m_isHsv = false;
+
+		// Compiler state
+		std::string m_source;
+		size_t m_position = 0;
+		size_t m_depth = 0;
+		std::string m_error;
+
+		bool fail(const std::string &error);
+		void skipSpaces();
+		bool accept(char c);
+		bool expect(char c);
+		bool allocate(uint8_t &reg);
+		void release(uint8_t reg);
+		bool emit(Op op, uint8_t &target, uint8_t a, uint8_t b = 0, uint8_t c = 0);
+		bool parseExpression(uint8_t &reg);
+		bool parseTerm(uint8_t &reg);
+		bool parseFactor(uint8_t &reg);
+		bool parseValue(uint8_t &reg);
+		bool parseArguments(std::vector<uint8_t> &regs, size_t count);
+
+		void run();
+
+};
+
+#endif
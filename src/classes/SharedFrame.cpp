@@ -0,0 +1,214 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SharedFrame.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "The sequence is shared between processes, it must not take a lock");
+static_assert(sizeof(SharedFrame::Layout) == 16 + LedKeyboard::keyCount * 3, "Producers rely on the documented layout");
+
+
+namespace {
+
+	const char magic[4] = { 'G', '8', '1', '0' };
+	const uint16_t version = 1;
+	// Well above a scheduling hiccup, a producer that is only preempted keeps its frame
+	const chrono::milliseconds staleTime(100);
+
+	// Not FUTEX_PRIVATE_FLAG, the word is shared with other processes
+	long futex(atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout) {
+		return syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), op, value, timeout, NULL, 0);
+	}
+
+}
+
+
+const char *SharedFrame::defaultName = "/g810-led";
+
+
+SharedFrame::~SharedFrame() {
+	close();
+}
+
+
+bool SharedFrame::create(const string &name) {
+	close();
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd < 0) return false;
+	if (ftruncate(fd, sizeof(Layout)) < 0 || ! map(fd)) {
+		int error = errno;
+		::close(fd);
+		shm_unlink(name.c_str());
+		errno = error;
+		return false;
+	}
+	::close(fd);
+
+	// ftruncate zero filled it, every key starts off
+	m_layout->version = version;
+	m_layout->keyCount = LedKeyboard::keyCount;
+	atomic_thread_fence(memory_order_release);
+	memcpy(m_layout->magic, magic, sizeof(magic));
+
+	m_name = name;
+	m_isCreator = true;
+	return true;
+}
+
+bool SharedFrame::open(const string &name) {
+	close();
+	int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+	if (fd < 0) return false;
+	struct stat info;
+	bool isMapped = false;
+	int error = EPROTO; // Too small to be a frame
+	if (fstat(fd, &info) < 0) error = errno;
+	else if (info.st_size >= (off_t)sizeof(Layout) && ! (isMapped = map(fd))) error = errno;
+	::close(fd);
+	if (! isMapped) {
+		errno = error;
+		return false;
+	}
+
+	if (memcmp(m_layout->magic, magic, sizeof(magic)) != 0 || m_layout->version != version ||
+	    m_layout->keyCount != LedKeyboard::keyCount) {
+		close();
+		errno = EPROTO;
+		return false;
+	}
+
+	m_name = name;
+	m_isCreator = false;
+	return true;
+}
+
+bool SharedFrame::map(int fd) {
+	void *address = mmap(NULL, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (address == MAP_FAILED) return false;
+	m_layout = static_cast<Layout*>(address);
+	return true;
+}
+
+void SharedFrame::close() {
+	if (m_layout == NULL) return;
+	munmap(m_layout, sizeof(Layout));
+	m_layout = NULL;
+	if (m_isCreator) shm_unlink(m_name.c_str());
+	m_isCreator = false;
+	m_name.clear();
+}
+
+bool SharedFrame::isOpen() {
+	return m_layout != NULL;
+}
+
+
+LedKeyboard::Color *SharedFrame::beginFrame(chrono::milliseconds timeout) {
+	// An odd sequence tells the reader a frame is half written, and other
+	// producers to wait their turn
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout;
+	uint32_t sequence = m_layout->sequence.load(memory_order_relaxed);
+	while (true) {
+		if (sequence & 1) {
+			// The producer of that frame may have died, the reader takes it back then
+			chrono::nanoseconds remaining = deadline - chrono::steady_clock::now();
+			if (remaining.count() <= 0) {
+				errno = EBUSY;
+				return NULL;
+			}
+			waitSequence(sequence, remaining);
+			sequence = m_layout->sequence.load(memory_order_relaxed);
+			continue;
+		}
+		if (m_layout->sequence.compare_exchange_weak(sequence, sequence + 1, memory_order_acquire)) break;
+	}
+	atomic_thread_fence(memory_order_release);
+	m_frameSequence = sequence + 1;
+	return m_layout->colors;
+}
+
+bool SharedFrame::endFrame() {
+	// Only from the odd value beginFrame set, the reader may have taken the
+	// frame back and another producer started one since.
+	// Ordered against the reader adding itself to waiters before it sleeps.
+	uint32_t sequence = m_frameSequence;
+	if (! m_layout->sequence.compare_exchange_strong(sequence, m_frameSequence + 1, memory_order_seq_cst)) {
+		errno = ESTALE;
+		return false;
+	}
+	if (m_layout->waiters.load(memory_order_seq_cst) != 0)
+		futex(&m_layout->sequence, FUTEX_WAKE, INT_MAX, NULL);
+	return true;
+}
+
+bool SharedFrame::waitFrame(LedKeyboard::Color *colors, uint32_t &sequence, chrono::milliseconds timeout) {
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + timeout;
+	while (true) {
+		uint32_t current = m_layout->sequence.load(memory_order_acquire);
+		if (! (current & 1) && current != sequence) {
+			memcpy(colors, m_layout->colors, sizeof(m_layout->colors));
+			atomic_thread_fence(memory_order_acquire);
+			// Torn when a producer started over it meanwhile, take the next one
+			if (m_layout->sequence.load(memory_order_relaxed) == current) {
+				sequence = current;
+				return true;
+			}
+			continue;
+		}
+
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		chrono::nanoseconds remaining = deadline - now;
+		if (remaining.count() <= 0) return false;
+		if (current & 1) {
+			// A producer is in the middle of a frame, or died there
+			if (current != m_oddSequence) {
+				m_oddSequence = current;
+				m_oddSince = now;
+			} else if (now - m_oddSince > staleTime) {
+				if (m_layout->sequence.compare_exchange_strong(current, current + 1, memory_order_acq_rel))
+					sequence = current + 1; // Half written, so it counts as seen
+				continue;
+			}
+			// Sleep until the frame is done, or until it is stale
+			remaining = min(remaining, chrono::duration_cast<chrono::nanoseconds>(m_oddSince + staleTime - now));
+			if (remaining.count() <= 0) continue;
+		}
+		waitSequence(current, remaining);
+	}
+}
+
+void SharedFrame::waitSequence(uint32_t sequence, chrono::nanoseconds timeout) {
+	// Producers only make the wake up call while someone is waiting
+	timespec wait = { (time_t)(timeout.count() / 1000000000), (long)(timeout.count() % 1000000000) };
+	m_layout->waiters.fetch_add(1, memory_order_seq_cst);
+	futex(&m_layout->sequence, FUTEX_WAIT, sequence, &wait);
+	m_layout->waiters.fetch_sub(1, memory_order_seq_cst);
+}
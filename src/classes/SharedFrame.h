@@ -0,0 +1,101 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SHAREDFRAME_CLASS
+#define SHAREDFRAME_CLASS
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "Keyboard.h"
+
+
+// A color for every key index in shared memory (/dev/shm), written by effect
+// producers in other processes and read by the process driving the keyboard.
+// Producers only store to memory. The reader takes the newest complete frame,
+// so a slow keyboard never holds a producer up.
+//
+// Layout, for producers that map the file without this class:
+//   0   magic "G810"
+//   4   version (uint16_t, 1) and key count (uint16_t, 128)
+//   8   sequence (uint32_t), odd while a producer writes, +2 per frame
+//   12  waiters (uint32_t), non-zero when the reader sleeps on sequence
+//   16  red, green, blue for each key index
+// A producer that can not use this class bumps sequence to odd, writes the
+// colors, bumps it to even again and, when waiters is not zero, makes a
+// FUTEX_WAKE call on it. Without the call the reader notices on its next poll.
+// A sequence left odd by a producer that died in the middle of a frame is
+// taken back by the reader once it stayed odd for 100ms, and that frame is
+// dropped. A producer ends its frame with a compare and swap from the odd
+// value it set, so a frame taken back that way is never published.
+class SharedFrame {
+
+
+	public:
+
+		static const char *defaultName;
+
+		struct Layout {
+			char magic[4];
+			uint16_t version;
+			uint16_t keyCount;
+			std::atomic<uint32_t> sequence;
+			std::atomic<uint32_t> waiters;
+			LedKeyboard::Color colors[LedKeyboard::keyCount];
+		};
+
+
+		~SharedFrame();
+
+		// Reader side, replaces what a reader that died may have left
+		bool create(const std::string &name = defaultName);
+		// Producer side
+		bool open(const std::string &name = defaultName);
+		// Also removes the name when this side created it
+		void close();
+		bool isOpen();
+
+		// The colors are plain stores until endFrame publishes them. NULL with
+		// errno EBUSY when another producer kept its frame open for timeout.
+		LedKeyboard::Color *beginFrame(std::chrono::milliseconds timeout = std::chrono::milliseconds(100));
+		// False with errno ESTALE when the reader took the frame back as stale,
+		// it is dropped then
+		bool endFrame();
+
+		// Copies the newest complete frame newer than sequence, false when none
+		// came within timeout
+		bool waitFrame(LedKeyboard::Color *colors, uint32_t &sequence, std::chrono::milliseconds timeout);
+
+
+	private:
+
+		Layout *m_layout = NULL;
+		std::string m_name;
+		bool m_isCreator = false;
+		uint32_t m_frameSequence = 0; // Odd value of the frame this producer writes
+		
+		uint32_t m_oddSequence = 0; // Last odd sequence seen by waitFrame, and since when
+		std::chrono::steady_clock::time_point m_oddSince;
+
+		bool map(int fd);
+		// Sleeps while the sequence is still at sequence, for at most timeout
+		void waitSequence(uint32_t sequence, std::chrono::nanoseconds timeout);
+
+};
+
+#endif
@@ -0,0 +1,144 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SoftwareEffect.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace {
+	
+	const float pi = 3.14159265f;
+	
+	chrono::milliseconds getDefaultPeriod(SoftwareEffect::Effect effect) {
+		switch (effect) {
+			case SoftwareEffect::Effect::k2000: return chrono::milliseconds(1200);
+			case SoftwareEffect::Effect::scanner: return chrono::milliseconds(2000);
+			case SoftwareEffect::Effect::wave: return chrono::milliseconds(2000);
+			case SoftwareEffect::Effect::ripple: return chrono::milliseconds(1500);
+			case SoftwareEffect::Effect::breathe: return chrono::milliseconds(4000);
+		}
+		return chrono::milliseconds(1000);
+	}
+	
+	// 0 to 1 and back to 0 over a phase of 0 to 1
+	float bounce(float phase) {
+		return phase < 0.5f ? phase * 2 : 2 - phase * 2;
+	}
+	
+	const LedKeyboard::Key fKeys[] = {
+		LedKeyboard::Key::f1, LedKeyboard::Key::f2, LedKeyboard::Key::f3, LedKeyboard::Key::f4,
+		LedKeyboard::Key::f5, LedKeyboard::Key::f6, LedKeyboard::Key::f7, LedKeyboard::Key::f8,
+		LedKeyboard::Key::f9, LedKeyboard::Key::f10, LedKeyboard::Key::f11, LedKeyboard::Key::f12
+	};
+	const uint8_t fKeyCount = sizeof(fKeys) / sizeof(fKeys[0]);
+	
+}
+
+
+SoftwareEffect::SoftwareEffect(LedKeyboard::KeyboardModel model, Effect effect, LedKeyboard::Color color,
+			       LedKeyboard::Color background, chrono::milliseconds period) :
+	m_effect(effect), m_color(color), m_background(background), m_period(period),
+	m_geometry(layout::getGeometry(model)) {
+	if (m_period.count() <= 0) m_period = getDefaultPeriod(effect);
+	
+	// k2000 runs along the F-keys, as in the sample scripts, the others over the whole board
+	if (effect == Effect::k2000)
+		for (uint8_t i = 0; i < fKeyCount; i++) m_isDriven[LedKeyboard::getKeyIndex(fKeys[i])] = true;
+	else fill(m_isDriven, m_isDriven + LedKeyboard::keyCount, true);
+	
+	bool isFirst = true;
+	float top = 0, bottom = 0;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+		m_isDriven[i] = m_isDriven[i] && m_geometry.isPlaced[i];
+		if (! m_isDriven[i]) continue;
+		if (isFirst || m_geometry.x[i] < m_left) m_left = m_geometry.x[i];
+		if (isFirst || m_geometry.x[i] > m_right) m_right = m_geometry.x[i];
+		if (isFirst || m_geometry.y[i] < top) top = m_geometry.y[i];
+		if (isFirst || m_geometry.y[i] > bottom) bottom = m_geometry.y[i];
+		isFirst = false;
+	}
+	m_middleX = (m_left + m_right) / 2;
+	m_middleY = (top + bottom) / 2;
+	m_radius = hypot(m_right - m_middleX, bottom - m_middleY);
+}
+
+
+chrono::milliseconds SoftwareEffect::getPeriod() {
+	return m_period;
+}
+
+bool SoftwareEffect::isDriven(uint8_t index) {
+	return index < LedKeyboard::keyCount && m_isDriven[index];
+}
+
+
+void SoftwareEffect::render(chrono::steady_clock::duration time, LedKeyboard::Color *colors) {
+	float periods = chrono::duration<float>(time).count() / chrono::duration<float>(m_period).count();
+	float phase = periods - floor(periods);
+	float levels[LedKeyboard::keyCount];
+	
+	switch (m_effect) {
+		case Effect::k2000: {
+			// The head bounces between both ends, the tail trails behind it
+			const float head = m_left + bounce(phase) * (m_right - m_left);
+			const float direction = phase < 0.5f ? 1 : -1;
+			const float tail = 3.0f;
+			layout::evaluate(m_geometry, [=](float x, float) {
+				float behind = (head - x) * direction;
+				if (behind > -0.5f && behind < 0.5f) return 1.0f;
+				return behind >= 0.5f && behind < tail ? 1 - behind / tail : 0.0f;
+			}, levels);
+			break;
+		}
+		case Effect::scanner: {
+			const float bar = m_left + bounce(phase) * (m_right - m_left);
+			const float width = 1.5f;
+			layout::evaluate(m_geometry, [=](float x, float) {
+				return max(0.0f, 1 - fabs(x - bar) / width);
+			}, levels);
+			break;
+		}
+		case Effect::wave: {
+			const float length = 8.0f; // Key units from one band to the next
+			layout::evaluate(m_geometry, [=](float x, float) {
+				return 0.5f + 0.5f * sin(2 * pi * (x / length - phase));
+			}, levels);
+			break;
+		}
+		case Effect::ripple: {
+			const float radius = phase * m_radius;
+			const float width = 2.0f;
+			const float middleX = m_middleX, middleY = m_middleY;
+			layout::evaluate(m_geometry, [=](float x, float y) {
+				float distance = hypot(x - middleX, y - middleY);
+				return max(0.0f, 1 - fabs(distance - radius) / width) * (1 - phase);
+			}, levels);
+			break;
+		}
+		case Effect::breathe: {
+			const float level = 0.5f - 0.5f * cos(2 * pi * phase);
+			layout::evaluate(m_geometry, [=](float, float) { return level; }, levels);
+			break;
+		}
+	}
+	
+	layout::paint(levels, m_background, m_color, colors);
+}
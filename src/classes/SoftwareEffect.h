@@ -0,0 +1,73 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOFTWAREEFFECT_CLASS
+#define SOFTWAREEFFECT_CLASS
+
+#include <chrono>
+#include <cstdint>
+
+#include "Keyboard.h"
+#include "Layout.h"
+
+
+// Animations computed on the host, for models or effects the firmware does
+// not have. Each frame is a pure function of the time since the start, so
+// a late frame never drifts the animation.
+class SoftwareEffect {
+
+
+	public:
+
+		enum class Effect : uint8_t {
+			k2000, // A light with a fading tail going back and forth over the F-keys
+			scanner, // A bar sweeping back and forth over the whole board
+			wave, // Bands of color moving left to right
+			ripple, // Rings spreading from the middle of the board
+			breathe // Every key fading in and out
+		};
+
+
+		// A zero period picks the default of the effect
+		SoftwareEffect(LedKeyboard::KeyboardModel model, Effect effect, LedKeyboard::Color color,
+			       LedKeyboard::Color background, std::chrono::milliseconds period = std::chrono::milliseconds(0));
+
+		std::chrono::milliseconds getPeriod();
+
+		// Keys the effect sets, it leaves the others as they are
+		bool isDriven(uint8_t index);
+
+		void render(std::chrono::steady_clock::duration time, LedKeyboard::Color *colors);
+
+
+	private:
+
+		Effect m_effect;
+		LedKeyboard::Color m_color;
+		LedKeyboard::Color m_background;
+		std::chrono::milliseconds m_period;
+
+		const layout::Geometry &m_geometry;
+		bool m_isDriven[LedKeyboard::keyCount] = {};
+		float m_left = 0; // Extent of the driven keys
+		float m_right = 0;
+		float m_middleX = 0;
+		float m_middleY = 0;
+		float m_radius = 0; // From the middle to the farthest key
+
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+using namespace std;
+
+
+
+namespace {
+	
+	const float pi = 3.14159265358979f;
+	const float lowestFrequency = 50.0f;
+	const float highestFrequency = 12000.0f;
+	const float floorDecibels = -60.0f; // Level 0, full scale is level 1
+	const float fallPerSecond = 1.5f; // Of the full height
+	
+}
+
+
+Spectrum::Spectrum(LedKeyboard::KeyboardModel model, unsigned int sampleRate, LedKeyboard::Color color,
+		   LedKeyboard::Color background) :
+	m_color(color), m_background(background), m_geometry(layout::getGeometry(model)) {
+	
+	// Hann window, and the tables of an iterative radix-2 FFT
+	size_t bits = 0;
+	while ((size_t(1) << bits) < fftSize) bits++;
+	for (size_t i = 0; i < fftSize; i++) {
+		m_window[i] = 0.5f - 0.5f * cos(2 * pi * i / fftSize);
+		size_t reversed = 0;
+		for (size_t bit = 0; bit < bits; bit++) if (i & (size_t(1) << bit)) reversed |= size_t(1) << (bits - 1 - bit);
+		m_reversed[i] = reversed;
+	}
+	for (size_t i = 0; i < fftSize / 2; i++) {
+		m_cos[i] = cos(2 * pi * i / fftSize);
+		m_sin[i] = -sin(2 * pi * i / fftSize);
+	}
+	
+	// A column per key unit across the board, the rows make the height of a bar
+	m_columnCount = min(maxColumns, static_cast<size_t>(m_geometry.right - m_geometry.left + 0.5f) + 1);
+	m_rowCount = m_geometry.bottom - m_geometry.top + 1;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+		if (! m_geometry.isPlaced[i]) continue;
+		size_t column = m_geometry.x[i] - m_geometry.left + 0.5f;
+		m_column[i] = min(column, m_columnCount - 1);
+		m_row[i] = m_geometry.bottom - m_geometry.y[i];
+	}
+	
+	float highest = min(highestFrequency, sampleRate / 2.0f);
+	float binWidth = static_cast<float>(sampleRate) / fftSize;
+	for (size_t column = 0; column < m_columnCount; column++) {
+		float from = lowestFrequency * pow(highest / lowestFrequency, static_cast<float>(column) / m_columnCount);
+		float to = lowestFrequency * pow(highest / lowestFrequency, static_cast<float>(column + 1) / m_columnCount);
+		m_firstBin[column] = max<size_t>(1, from / binWidth);
+		m_lastBin[column] = min<size_t>(fftSize / 2 - 1, max<size_t>(m_firstBin[column], to / binWidth));
+	}
+}
+
+
+void Spectrum::push(const int16_t *samples, size_t frames, unsigned int channels) {
+	float scale = 1.0f / (32768.0f * channels);
+	for (size_t i = 0; i < frames; i++) {
+		int sum = 0;
+		for (unsigned int channel = 0; channel < channels; channel++) sum += samples[i * channels + channel];
+		m_samples[m_position] = sum * scale;
+		m_position = (m_position + 1) % fftSize;
+	}
+}
+
+void Spectrum::analyze() {
+	// Oldest sample first, in bit reversed order for the transform
+	for (size_t i = 0; i < fftSize; i++) {
+		size_t target = m_reversed[i];
+		m_real[target] = m_samples[(m_position + i) % fftSize] * m_window[i];
+		m_imaginary[target] = 0;
+	}
+	transform();
+	
+	// Amplitude of a full scale sine is 1, the window halves it
+	const float scale = 4.0f / fftSize;
+	for (size_t column = 0; column < m_columnCount; column++) {
+		float peak = 0;
+		for (size_t bin = m_firstBin[column]; bin <= m_lastBin[column]; bin++)
+			peak = max(peak, m_real[bin] * m_real[bin] + m_imaginary[bin] * m_imaginary[bin]);
+		float decibels = 10.0f * log10(peak * scale * scale + 1e-12f);
+		m_levels[column] = min(1.0f, max(0.0f, 1.0f - decibels / floorDecibels));
+	}
+}
+
+void Spectrum::transform() {
+	for (size_t length = 2; length <= fftSize; length <<= 1) {
+		size_t half = length >> 1;
+		size_t step = fftSize / length;
+		for (size_t start = 0; start < fftSize; start += length) {
+			for (size_t i = 0; i < half; i++) {
+				float c = m_cos[i * step], s = m_sin[i * step];
+				size_t a = start + i, b = a + half;
+				float real = m_real[b] * c - m_imaginary[b] * s;
+				float imaginary = m_real[b] * s + m_imaginary[b] * c;
+				m_real[b] = m_real[a] - real;
+				m_imaginary[b] = m_imaginary[a] - imaginary;
+				m_real[a] += real;
+				m_imaginary[a] += imaginary;
+			}
+		}
+	}
+}
+
+
+bool Spectrum::isDriven(uint8_t index) {
+	return index < LedKeyboard::keyCount && m_geometry.isPlaced[index];
+}
+
+void Spectrum::render(chrono::steady_clock::duration time, LedKeyboard::Color *colors) {
+	float elapsed = chrono::duration<float>(time - m_lastTime).count();
+	m_lastTime = time;
+	for (size_t column = 0; column < m_columnCount; column++)
+		m_shown[column] = max(m_levels[column], m_shown[column] - fallPerSecond * max(elapsed, 0.0f));
+	
+	// The top key of a bar is partly lit
+	float levels[LedKeyboard::keyCount];
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++)
+		levels[i] = m_geometry.isPlaced[i] ? min(1.0f, max(0.0f, m_shown[m_column[i]] * m_rowCount - m_row[i])) : 0.0f;
+	layout::paint(levels, m_background, m_color, colors);
+}
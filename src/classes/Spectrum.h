@@ -0,0 +1,83 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPECTRUM_CLASS
+#define SPECTRUM_CLASS
+
+#include <chrono>
+#include <cstdint>
+
+#include "Keyboard.h"
+#include "Layout.h"
+
+
+// Spectrum bars of an audio stream, one band per column of keys. The bands
+// come from a fixed size FFT of the latest samples, spaced logarithmically
+// so that each octave gets about as many columns.
+class Spectrum {
+
+
+	public:
+
+		static const size_t fftSize = 1024;
+
+
+		Spectrum(LedKeyboard::KeyboardModel model, unsigned int sampleRate, LedKeyboard::Color color,
+			 LedKeyboard::Color background);
+
+		// Interleaved 16 bit samples, the channels are mixed down
+		void push(const int16_t *samples, size_t frames, unsigned int channels);
+		// Levels of the bands from the latest fftSize samples
+		void analyze();
+
+		bool isDriven(uint8_t index);
+		// Bars follow the levels up at once and fall back slowly
+		void render(std::chrono::steady_clock::duration time, LedKeyboard::Color *colors);
+
+
+	private:
+
+		static const size_t maxColumns = 32;
+
+		LedKeyboard::Color m_color;
+		LedKeyboard::Color m_background;
+		const layout::Geometry &m_geometry;
+
+		float m_samples[fftSize] = {}; // Ring of the latest samples
+		size_t m_position = 0;
+		float m_window[fftSize];
+		float m_cos[fftSize / 2];
+		float m_sin[fftSize / 2];
+		uint16_t m_reversed[fftSize];
+		float m_real[fftSize];
+		float m_imaginary[fftSize];
+
+		size_t m_columnCount;
+		uint16_t m_firstBin[maxColumns];
+		uint16_t m_lastBin[maxColumns];
+		float m_levels[maxColumns] = {};
+		float m_shown[maxColumns] = {};
+		std::chrono::steady_clock::duration m_lastTime = std::chrono::steady_clock::duration::zero();
+
+		uint8_t m_column[LedKeyboard::keyCount] = {};
+		float m_row[LedKeyboard::keyCount] = {}; // From the bottom row, 0 upwards
+		float m_rowCount;
+
+		void transform();
+
+};
+
+#endif
@@ -0,0 +1,798 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Transport.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+
+#if defined(hidapi)
+	#include <locale>
+	#include "hidapi/hidapi.h"
+#elif defined(libusb)
+	#include <cstring>
+	#include <fcntl.h>
+	#include "libusb-1.0/libusb.h"
+#elif defined(hidraw)
+	#include <cstring>
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <poll.h>
+#endif
+
+#if defined(hidapi) || defined(hidraw)
+	#include <fstream>
+	#include <climits>
+	#include <sys/stat.h>
+	#include <sys/sysmacros.h>
+#endif
+
+
+using namespace std;
+
+
+#if defined(hidapi) || defined(hidraw)
+
+namespace {
+
+	string readSysfsLine(const string &path) {
+		ifstream file(path);
+		string line;
+		if (file.is_open()) getline(file, line);
+		return line;
+	}
+
+	// hidapi on its hidraw backend and the hidraw transport both open
+	// /dev/hidrawN, which sysfs can confirm without walking the bus
+	bool validateHidrawNode(const LedTransport::Device &device) {
+		if (device.path.compare(0, 11, "/dev/hidraw") != 0) return false;
+
+		struct stat st;
+		if (stat(device.path.c_str(), &st) != 0 || ! S_ISCHR(st.st_mode)) return false;
+
+		// The node must be the one sysfs describes, not a leftover of a replugged device
+		string sysfsPath = "/sys/class/hidraw/" + device.path.substr(5) + "/";
+		unsigned int nodeMajor = 0, nodeMinor = 0;
+		if (sscanf(readSysfsLine(sysfsPath + "dev").c_str(), "%u:%u", &nodeMajor, &nodeMinor) != 2) return false;
+		if (nodeMajor != major(st.st_rdev) || nodeMinor != minor(st.st_rdev)) return false;
+
+		ifstream uevent(sysfsPath + "device/uevent");
+		if (! uevent.is_open()) return false;
+		unsigned int bus = 0, vendorID = 0, productID = 0;
+		string serial, line;
+		while (getline(uevent, line)) {
+			if (line.compare(0, 7, "HID_ID=") == 0) sscanf(line.c_str() + 7, "%x:%x:%x", &bus, &vendorID, &productID);
+			else if (line.compare(0, 9, "HID_UNIQ=") == 0) serial = line.substr(9);
+		}
+		if (vendorID != device.vendorID || productID != device.productID) return false;
+		if (! serial.empty() && ! device.serialNumber.empty() && serial != device.serialNumber) return false;
+
+		if (device.interfaceNumber != LedTransport::anyInterface) {
+			char realPath[PATH_MAX];
+			if (realpath((sysfsPath + "device/").c_str(), realPath) == NULL) return false;
+			string interfaceNumber = readSysfsLine(string(realPath) + "/../bInterfaceNumber");
+			if (interfaceNumber.empty() || stoul(interfaceNumber, nullptr, 16) != device.interfaceNumber) return false;
+		}
+
+		return true;
+	}
+
+}
+
+#endif
+
+
+
+size_t LedTransport::writeBatch(const Report *reports, size_t count) {
+	for (size_t i = 0; i < count; i++)
+		if (! write(reports[i].data, reports[i].size)) return i;
+	return count;
+}
+
+string LedTransport::getError() {
+	return "";
+}
+
+bool LedTransport::setQueueDepth(unsigned int depth) {
+	return depth <= 1;
+}
+
+void LedTransport::setAckReading(bool enabled) {
+	(void)enabled;
+}
+
+bool LedTransport::validate(const Device &device) {
+	(void)device;
+	return false;
+}
+
+
+
+string MemoryTransport::getName() {
+	return "mem";
+}
+
+vector<LedTransport::Device> MemoryTransport::enumerate(const vector<vector<uint16_t>> &deviceIds) {
+	// Pretend one keyboard of every requested kind is plugged in
+	vector<Device> deviceList;
+	for (size_t i = 0; i < deviceIds.size(); i++) {
+		Device device;
+		device.vendorID = deviceIds[i][0];
+		device.productID = deviceIds[i][1];
+		device.interfaceNumber = deviceIds[i][2];
+		device.manufacturer = "g810-led";
+		device.product = "Memory transport";
+		device.serialNumber = "mem" + to_string(i);
+		device.path = "mem:" + to_string(i);
+		deviceList.push_back(device);
+	}
+	return deviceList;
+}
+
+bool MemoryTransport::open(const Device &device) {
+	(void)device;
+	m_isOpen = true;
+	return true;
+}
+
+bool MemoryTransport::close() {
+	m_isOpen = false;
+	return true;
+}
+
+bool MemoryTransport::write(const unsigned char *data, size_t size) {
+	if (! m_isOpen) return false;
+	if (size > maxReportSize) return false;
+	Packet packet;
+	packet.time = chrono::steady_clock::now();
+	packet.size = size;
+	copy(data, data + size, packet.data);
+	m_packets.push_back(packet);
+
+	// Acknowledge HID++ reports like a keyboard would, by echoing the header
+	if (m_isAckReading && size >= 4 && data[0] >= 0x10 && data[0] <= 0x12) {
+		vector<unsigned char> ack(20, 0x00);
+		ack[0] = 0x11;
+		ack[1] = data[1];
+		ack[2] = data[2];
+		ack[3] = data[3];
+		if (m_acks.size() >= 64) m_acks.pop_front();
+		m_acks.push_back(ack);
+	}
+	return true;
+}
+
+int MemoryTransport::read(unsigned char *data, size_t size, int timeoutMs) {
+	(void)timeoutMs;
+	if (! m_isOpen) return -1;
+
+	deque<vector<unsigned char>> &queue = m_replies.empty() ? m_acks : m_replies;
+	if (queue.empty()) return 0;
+	size_t len = min(size, queue.front().size());
+	copy(queue.front().begin(), queue.front().begin() + len, data);
+	queue.pop_front();
+	return len;
+}
+
+const vector<MemoryTransport::Packet> &MemoryTransport::getPackets() {
+	return m_packets;
+}
+
+void MemoryTransport::clearPackets() {
+	m_packets.clear();
+}
+
+void MemoryTransport::setAckReading(bool enabled) {
+	m_isAckReading = enabled;
+	if (! enabled) m_acks.clear();
+}
+
+void MemoryTransport::pushReply(const vector<unsigned char> &reply) {
+	m_replies.push_back(reply);
+}
+
+
+
+#if defined(hidapi)
+
+HidapiTransport::~HidapiTransport() {
+	close();
+}
+
+string HidapiTransport::getName() {
+	return "hidapi";
+}
+
+vector<LedTransport::Device> HidapiTransport::enumerate(const vector<vector<uint16_t>> &deviceIds) {
+	vector<Device> deviceList;
+	if (deviceIds.empty()) return deviceList;
+	if (hid_init() < 0) return deviceList;
+
+	// Let hidapi filter when every row shares the same IDs
+	uint16_t vendorID = deviceIds[0][0];
+	uint16_t productID = deviceIds[0][1];
+	for (size_t i = 1; i < deviceIds.size(); i++) {
+		if (deviceIds[i][0] != vendorID) vendorID = 0x0;
+		if (deviceIds[i][1] != productID) productID = 0x0;
+	}
+
+	struct hid_device_info *devs, *dev;
+	devs = hid_enumerate(vendorID, productID);
+	for (dev = devs; dev != NULL; dev = dev->next) {
+		for (size_t i = 0; i < deviceIds.size(); i++) {
+			if (dev->vendor_id != deviceIds[i][0] || dev->product_id != deviceIds[i][1]) continue;
+			if (dev->interface_number != deviceIds[i][2]) continue;
+
+			Device device;
+			device.vendorID = dev->vendor_id;
+			device.productID = dev->product_id;
+			device.interfaceNumber = dev->interface_number;
+			device.path = dev->path;
+
+			if (dev->serial_number != NULL) {
+				char buf[256];
+				wcstombs(buf, dev->serial_number, 256);
+				device.serialNumber = string(buf);
+			}
+
+			if (dev->manufacturer_string != NULL)
+			{
+				char buf[256];
+				wcstombs(buf, dev->manufacturer_string, 256);
+				device.manufacturer = string(buf);
+			}
+
+			if (dev->product_string != NULL)
+			{
+				char buf[256];
+				wcstombs(buf, dev->product_string, 256);
+				device.product = string(buf);
+			}
+
+			deviceList.push_back(device);
+			break;
+		}
+	}
+	hid_free_enumeration(devs);
+
+	if (m_hidHandle == NULL) hid_exit();
+
+	return deviceList;
+}
+
+bool HidapiTransport::open(const Device &device) {
+	if (m_hidHandle != NULL) close();
+	if (hid_init() < 0) return false;
+
+	m_hidHandle = hid_open_path(device.path.c_str());
+
+	if(m_hidHandle == NULL) {
+		hid_exit();
+		errno = EACCES;
+		return false;
+	}
+
+	return true;
+}
+
+bool HidapiTransport::validate(const Device &device) {
+	return validateHidrawNode(device);
+}
+
+bool HidapiTransport::close() {
+	if (m_hidHandle == NULL) return true;
+	hid_close(m_hidHandle);
+	m_hidHandle = NULL;
+	hid_exit();
+	return true;
+}
+
+bool HidapiTransport::write(const unsigned char *data, size_t size) {
+	if (m_hidHandle == NULL) return false;
+	return hid_write(m_hidHandle, data, size) >= 0;
+}
+
+string HidapiTransport::getError() {
+	string reason;
+	const wchar_t *error = m_hidHandle != NULL ? hid_error(m_hidHandle) : NULL;
+	if (error != NULL) {
+		char buf[256];
+		if (wcstombs(buf, error, 256) != (size_t)-1) reason = " (" + string(buf) + ")";
+	}
+	return "Can not write to hidraw" + reason + ", try with the libusb version";
+}
+
+int HidapiTransport::read(unsigned char *data, size_t size, int timeoutMs) {
+	if (m_hidHandle == NULL) return -1;
+	return hid_read_timeout(m_hidHandle, data, size, timeoutMs);
+}
+
+#elif defined(libusb)
+
+LibusbTransport::~LibusbTransport() {
+	close();
+}
+
+string LibusbTransport::getName() {
+	return "libusb";
+}
+
+vector<LedTransport::Device> LibusbTransport::enumerate(const vector<vector<uint16_t>> &deviceIds) {
+	vector<Device> deviceList;
+
+	libusb_context *ctx = NULL;
+	if (libusb_init(&ctx) < 0) return deviceList;
+
+	libusb_device **devs;
+	ssize_t cnt = libusb_get_device_list(ctx, &devs);
+	for (ssize_t i = 0; i < cnt; i++) {
+		libusb_device *dev = devs[i];
+		libusb_device_descriptor desc;
+		libusb_get_device_descriptor(dev, &desc);
+		for (size_t j = 0; j < deviceIds.size(); j++) {
+			if (desc.idVendor != deviceIds[j][0] || desc.idProduct != deviceIds[j][1]) continue;
+
+			// libusb works on whole devices, the interface is picked when claiming it
+			Device device;
+			device.vendorID = desc.idVendor;
+			device.productID = desc.idProduct;
+
+			char path[16];
+			snprintf(path, sizeof(path), "%03u:%03u", libusb_get_bus_number(dev), libusb_get_device_address(dev));
+			device.path = path;
+
+			libusb_device_handle *handle;
+			if (libusb_open(dev, &handle) == 0) {
+				unsigned char buf[256];
+				if (libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, buf, 256) >= 1) device.serialNumber = string((char*)buf);
+				if (libusb_get_string_descriptor_ascii(handle, desc.iManufacturer, buf, 256) >= 1) device.manufacturer = string((char*)buf);
+				if (libusb_get_string_descriptor_ascii(handle, desc.iProduct, buf, 256) >= 1) device.product = string((char*)buf);
+				libusb_close(handle);
+			}
+
+			deviceList.push_back(device);
+			break;
+		}
+	}
+	if (cnt >= 0) libusb_free_device_list(devs, 1);
+
+	libusb_exit(ctx);
+
+	return deviceList;
+}
+
+bool LibusbTransport::open(const Device &device) {
+	if (m_hidHandle != NULL) close();
+	if (libusb_init(&m_ctx) < 0) return false;
+
+	libusb_device **devs;
+	ssize_t cnt = libusb_get_device_list(m_ctx, &devs);
+	for (ssize_t i = 0; i < cnt; i++) {
+		char path[16];
+		snprintf(path, sizeof(path), "%03u:%03u", libusb_get_bus_number(devs[i]), libusb_get_device_address(devs[i]));
+		if (device.path == path) {
+			if (libusb_open(devs[i], &m_hidHandle) != 0) m_hidHandle = NULL;
+			break;
+		}
+	}
+	if (cnt >= 0) libusb_free_device_list(devs, 1);
+
+	if (m_hidHandle == NULL) m_hidHandle = libusb_open_device_with_vid_pid(m_ctx, device.vendorID, device.productID);
+
+	if(m_hidHandle == NULL) {
+		libusb_exit(m_ctx);
+		errno = EACCES;
+		m_ctx = NULL;
+		return false;
+	}
+
+	m_interfaceNumber = device.interfaceNumber == anyInterface ? 1 : device.interfaceNumber;
+
+	if(libusb_kernel_driver_active(m_hidHandle, m_interfaceNumber) == 1) {
+		if(libusb_detach_kernel_driver(m_hidHandle, m_interfaceNumber) != 0) {
+			libusb_close(m_hidHandle);
+			m_hidHandle = NULL;
+			libusb_exit(m_ctx);
+			errno = EACCES;
+			m_ctx = NULL;
+			return false;
+		}
+		m_isKernellDetached = true;
+	}
+
+	if(libusb_claim_interface(m_hidHandle, m_interfaceNumber) < 0) {
+		if(m_isKernellDetached==true) {
+			libusb_attach_kernel_driver(m_hidHandle, m_interfaceNumber);
+			m_isKernellDetached = false;
+		}
+		libusb_close(m_hidHandle);
+		m_hidHandle = NULL;
+		libusb_exit(m_ctx);
+		errno = EACCES;
+		m_ctx = NULL;
+		return false;
+	}
+
+	if (m_queueDepth > 1 && ! startAsync()) {
+		close();
+		errno = EIO;
+		return false;
+	}
+
+	return true;
+}
+
+bool LibusbTransport::validate(const Device &device) {
+	// Paths are bus:address, and usbfs hands out the device descriptor of
+	// /dev/bus/usb/BBB/AAA on a plain read
+	unsigned int bus = 0, address = 0;
+	if (sscanf(device.path.c_str(), "%u:%u", &bus, &address) != 2) return false;
+	char nodePath[32];
+	snprintf(nodePath, sizeof(nodePath), "/dev/bus/usb/%03u/%03u", bus, address);
+
+	int fd = ::open(nodePath, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return false;
+	unsigned char descriptor[18];
+	ssize_t len = ::read(fd, descriptor, sizeof(descriptor));
+	::close(fd);
+	if (len != sizeof(descriptor) || descriptor[1] != 0x01) return false;
+
+	uint16_t vendorID = descriptor[8] | descriptor[9] << 8;
+	uint16_t productID = descriptor[10] | descriptor[11] << 8;
+	return vendorID == device.vendorID && productID == device.productID;
+}
+
+bool LibusbTransport::close() {
+	if (m_hidHandle == NULL) return true;
+	stopAsync();
+	libusb_release_interface(m_hidHandle, m_interfaceNumber);
+	if(m_isKernellDetached==true) {
+		libusb_attach_kernel_driver(m_hidHandle, m_interfaceNumber);
+		m_isKernellDetached = false;
+	}
+	libusb_close(m_hidHandle);
+	m_hidHandle = NULL;
+	libusb_exit(m_ctx);
+	m_ctx = NULL;
+	return true;
+}
+
+bool LibusbTransport::write(const unsigned char *data, size_t size) {
+	if (m_hidHandle == NULL) {
+		m_lastError = LIBUSB_ERROR_NO_DEVICE;
+		return false;
+	}
+	uint16_t report_value = size > 20 ? 0x0212 : 0x0211;
+
+	if (! m_isAsync) {
+		int result = libusb_control_transfer(m_hidHandle, 0x21, 0x09, report_value, m_interfaceNumber,
+			const_cast<unsigned char*>(data), size, 2000);
+		if (result < 0) {
+			m_lastError = result;
+			return false;
+		}
+		if (m_isAckReading) return true;
+		usleep(1000);
+		unsigned char buffer[64];
+		read(buffer, sizeof(buffer), 1);
+		return true;
+	}
+
+	if (size > 64) {
+		m_lastError = LIBUSB_ERROR_INVALID_PARAM;
+		return false;
+	}
+
+	// Wait for a free slot instead of sleeping after every report
+	unique_lock<mutex> lock(m_mutex);
+	m_condition.wait(lock, [this] { return ! m_freeTransfers.empty() || m_transferFailed; });
+	if (m_transferFailed) {
+		m_lastError = LIBUSB_ERROR_IO;
+		return false;
+	}
+
+	libusb_transfer *transfer = m_freeTransfers.back();
+	m_freeTransfers.pop_back();
+	libusb_fill_control_setup(transfer->buffer, 0x21, 0x09, report_value, m_interfaceNumber, size);
+	memcpy(transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE, data, size);
+	libusb_fill_control_transfer(transfer, m_hidHandle, transfer->buffer, onWriteDone, this, 2000);
+
+	int result = libusb_submit_transfer(transfer);
+	if (result < 0) {
+		m_freeTransfers.push_back(transfer);
+		m_lastError = result;
+		return false;
+	}
+	m_inFlight++;
+	return true;
+}
+
+size_t LibusbTransport::writeBatch(const Report *reports, size_t count) {
+	if (! m_isAsync) return LedTransport::writeBatch(reports, count);
+
+	// Keep up to m_queueDepth reports of the frame in flight, then wait for
+	// the device to have taken all of them before reporting success
+	size_t submitted = 0;
+	while (submitted < count && write(reports[submitted].data, reports[submitted].size)) submitted++;
+	if (! drain(2000)) {
+		m_lastError = LIBUSB_ERROR_IO;
+		return 0;
+	}
+	return submitted;
+}
+
+string LibusbTransport::getError() {
+	return string("Can not write to the keyboard: ") + libusb_error_name(m_lastError);
+}
+
+int LibusbTransport::read(unsigned char *data, size_t size, int timeoutMs) {
+	if (m_hidHandle == NULL) return -1;
+
+	if (m_isAsync) {
+		// The event thread keeps the interrupt endpoint drained, hand out what it got
+		unique_lock<mutex> lock(m_mutex);
+		if (! m_condition.wait_for(lock, chrono::milliseconds(timeoutMs), [this] { return m_ackCount > 0; }))
+			return 0;
+		const Report &ack = m_acks[m_ackHead];
+		size_t len = min(size, ack.size);
+		memcpy(data, ack.data, len);
+		m_ackHead = (m_ackHead + 1) % maxAcks;
+		m_ackCount--;
+		return len;
+	}
+
+	int len = 0;
+	// Replies come back on the interrupt IN endpoint of the claimed interface
+	int result = libusb_interrupt_transfer(m_hidHandle, 0x81 + m_interfaceNumber, data, size, &len, timeoutMs);
+	if (result == LIBUSB_ERROR_TIMEOUT) return 0;
+	if (result < 0) return -1;
+	return len;
+}
+
+void LibusbTransport::setAckReading(bool enabled) {
+	m_isAckReading = enabled;
+}
+
+bool LibusbTransport::setQueueDepth(unsigned int depth) {
+	if (depth < 1) return false;
+	m_queueDepth = depth;
+	if (m_hidHandle == NULL) return true;
+	stopAsync();
+	return depth == 1 || startAsync();
+}
+
+bool LibusbTransport::startAsync() {
+	m_transferFailed = false;
+	m_inFlight = 0;
+	m_ackHead = 0;
+	m_ackCount = 0;
+
+	m_transferBuffers.assign(m_queueDepth, vector<unsigned char>(LIBUSB_CONTROL_SETUP_SIZE + 64));
+	for (unsigned int i = 0; i < m_queueDepth; i++) {
+		libusb_transfer *transfer = libusb_alloc_transfer(0);
+		if (transfer == NULL) {
+			stopAsync();
+			return false;
+		}
+		transfer->buffer = m_transferBuffers[i].data();
+		m_transfers.push_back(transfer);
+		m_freeTransfers.push_back(transfer);
+	}
+
+	m_ackTransfer = libusb_alloc_transfer(0);
+	if (m_ackTransfer == NULL) {
+		stopAsync();
+		return false;
+	}
+	libusb_fill_interrupt_transfer(m_ackTransfer, m_hidHandle, 0x81 + m_interfaceNumber,
+		m_ackBuffer, sizeof(m_ackBuffer), onAckReceived, this, 0);
+	if (libusb_submit_transfer(m_ackTransfer) < 0) {
+		stopAsync();
+		return false;
+	}
+
+	m_isAckPending = true;
+	m_isRunning = true;
+	m_isAsync = true;
+	m_eventThread = thread(&LibusbTransport::handleEvents, this);
+	return true;
+}
+
+void LibusbTransport::stopAsync() {
+	if (m_isAsync) {
+		drain(2000);
+		{
+			lock_guard<mutex> lock(m_mutex);
+			m_isRunning = false;
+			if (m_isAckPending) libusb_cancel_transfer(m_ackTransfer);
+		}
+		m_eventThread.join();
+		m_isAsync = false;
+	}
+
+	for (size_t i = 0; i < m_transfers.size(); i++) libusb_free_transfer(m_transfers[i]);
+	m_transfers.clear();
+	m_freeTransfers.clear();
+	m_transferBuffers.clear();
+	if (m_ackTransfer != NULL) libusb_free_transfer(m_ackTransfer);
+	m_ackTransfer = NULL;
+	m_ackHead = 0;
+	m_ackCount = 0;
+}
+
+bool LibusbTransport::drain(int timeoutMs) {
+	unique_lock<mutex> lock(m_mutex);
+	m_condition.wait_for(lock, chrono::milliseconds(timeoutMs), [this] { return m_inFlight == 0; });
+	return m_inFlight == 0 && ! m_transferFailed;
+}
+
+void LibusbTransport::handleEvents() {
+	// Runs until closing, and until the cancelled and in-flight transfers came back
+	while (true) {
+		{
+			lock_guard<mutex> lock(m_mutex);
+			if (! m_isRunning && ! m_isAckPending && m_inFlight == 0) break;
+		}
+		struct timeval timeout = { 0, 50000 };
+		libusb_handle_events_timeout_completed(m_ctx, &timeout, NULL);
+	}
+}
+
+void LibusbTransport::onWriteDone(libusb_transfer *transfer) {
+	LibusbTransport *self = static_cast<LibusbTransport*>(transfer->user_data);
+	lock_guard<mutex> lock(self->m_mutex);
+	if (transfer->status != LIBUSB_TRANSFER_COMPLETED) self->m_transferFailed = true;
+	self->m_freeTransfers.push_back(transfer);
+	self->m_inFlight--;
+	self->m_condition.notify_all();
+}
+
+void LibusbTransport::onAckReceived(libusb_transfer *transfer) {
+	LibusbTransport *self = static_cast<LibusbTransport*>(transfer->user_data);
+	lock_guard<mutex> lock(self->m_mutex);
+	if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		// Only keep the latest replies, nobody may be reading them
+		if (self->m_ackCount == maxAcks) {
+			self->m_ackHead = (self->m_ackHead + 1) % maxAcks;
+			self->m_ackCount--;
+		}
+		Report &ack = self->m_acks[(self->m_ackHead + self->m_ackCount) % maxAcks];
+		ack.size = min((size_t)transfer->actual_length, sizeof(ack.data));
+		memcpy(ack.data, transfer->buffer, ack.size);
+		self->m_ackCount++;
+		self->m_condition.notify_all();
+	}
+	if (self->m_isRunning && (transfer->status == LIBUSB_TRANSFER_COMPLETED || transfer->status == LIBUSB_TRANSFER_TIMED_OUT)) {
+		if (libusb_submit_transfer(transfer) == 0) return;
+	}
+	self->m_isAckPending = false;
+	self->m_condition.notify_all();
+}
+
+#elif defined(hidraw)
+
+HidrawTransport::~HidrawTransport() {
+	close();
+}
+
+string HidrawTransport::getName() {
+	return "hidraw";
+}
+
+vector<LedTransport::Device> HidrawTransport::enumerate(const vector<vector<uint16_t>> &deviceIds) {
+	vector<Device> deviceList;
+
+	DIR *dir = opendir("/sys/class/hidraw");
+	if (dir == NULL) return deviceList;
+
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		string node = entry->d_name;
+		if (node.compare(0, 6, "hidraw") != 0) continue;
+
+		// HID_ID=0003:0000046D:0000C337
+		string sysfsPath = "/sys/class/hidraw/" + node + "/device/";
+		ifstream uevent(sysfsPath + "uevent");
+		if (! uevent.is_open()) continue;
+		unsigned int bus = 0, vendorID = 0, productID = 0;
+		string serial, line;
+		while (getline(uevent, line)) {
+			if (line.compare(0, 7, "HID_ID=") == 0) sscanf(line.c_str() + 7, "%x:%x:%x", &bus, &vendorID, &productID);
+			else if (line.compare(0, 9, "HID_UNIQ=") == 0) serial = line.substr(9);
+		}
+
+		for (size_t i = 0; i < deviceIds.size(); i++) {
+			if (vendorID != deviceIds[i][0] || productID != deviceIds[i][1]) continue;
+
+			// The HID device sits below its USB interface, which sits below the USB device
+			char realPath[PATH_MAX];
+			if (realpath(sysfsPath.c_str(), realPath) == NULL) break;
+			string usbInterface = string(realPath) + "/../";
+			string interfaceNumber = readSysfsLine(usbInterface + "bInterfaceNumber");
+			if (interfaceNumber.empty() || stoul(interfaceNumber, nullptr, 16) != deviceIds[i][2]) continue;
+
+			Device device;
+			device.vendorID = vendorID;
+			device.productID = productID;
+			device.interfaceNumber = deviceIds[i][2];
+			device.manufacturer = readSysfsLine(usbInterface + "../manufacturer");
+			device.product = readSysfsLine(usbInterface + "../product");
+			device.serialNumber = serial.empty() ? readSysfsLine(usbInterface + "../serial") : serial;
+			device.path = "/dev/" + node;
+			deviceList.push_back(device);
+			break;
+		}
+	}
+	closedir(dir);
+
+	return deviceList;
+}
+
+bool HidrawTransport::open(const Device &device) {
+	if (m_fd >= 0) close();
+
+	m_fd = ::open(device.path.c_str(), O_RDWR | O_CLOEXEC);
+	if (m_fd < 0) {
+		errno = EACCES;
+		return false;
+	}
+
+	return true;
+}
+
+bool HidrawTransport::validate(const Device &device) {
+	return validateHidrawNode(device);
+}
+
+bool HidrawTransport::close() {
+	if (m_fd < 0) return true;
+	::close(m_fd);
+	m_fd = -1;
+	return true;
+}
+
+bool HidrawTransport::write(const unsigned char *data, size_t size) {
+	if (m_fd < 0) {
+		m_lastErrno = ENODEV;
+		return false;
+	}
+	// hidraw takes exactly one report per write() call
+	ssize_t written;
+	do written = ::write(m_fd, data, size);
+	while (written < 0 && errno == EINTR);
+	if (written == (ssize_t)size) return true;
+	m_lastErrno = written < 0 ? errno : EIO;
+	return false;
+}
+
+string HidrawTransport::getError() {
+	return string("Can not write to the keyboard: ") + strerror(m_lastErrno);
+}
+
+int HidrawTransport::read(unsigned char *data, size_t size, int timeoutMs) {
+	if (m_fd < 0) return -1;
+	struct pollfd pfd = { m_fd, POLLIN, 0 };
+	int ready = poll(&pfd, 1, timeoutMs);
+	if (ready == 0) return 0;
+	if (ready < 0) return -1;
+	ssize_t len = ::read(m_fd, data, size);
+	return len < 0 ? -1 : (int)len;
+}
+
+#endif
@@ -0,0 +1,267 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRANSPORT_CLASS
+#define TRANSPORT_CLASS
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#if defined(hidapi)
+	struct hid_device_;
+#elif defined(libusb)
+	#include <condition_variable>
+	#include <mutex>
+	#include <thread>
+	struct libusb_context;
+	struct libusb_device_handle;
+	struct libusb_transfer;
+#endif
+
+
+// Moves raw HID reports between LedKeyboard and a device. LedKeyboard only
+// encodes reports and picks the device, everything below that is up to the
+// transport.
+class LedTransport {
+
+
+	public:
+
+		// Interface number of a device that can be claimed on any interface
+		static const uint16_t anyInterface = 0xffff;
+		// Long HID++ reports are the largest a keyboard takes
+		static const size_t maxReportSize = 64;
+
+		typedef struct {
+			uint16_t vendorID = 0x0;
+			uint16_t productID = 0x0;
+			uint16_t interfaceNumber = anyInterface;
+			std::string manufacturer = "";
+			std::string product = "";
+			std::string serialNumber = "";
+			std::string path = "";
+		} Device;
+
+		// A report in a fixed buffer, so that a frame can be queued without allocating
+		typedef struct {
+			size_t size = 0;
+			unsigned char data[maxReportSize];
+		} Report;
+
+
+		virtual ~LedTransport() {}
+
+		virtual std::string getName() = 0;
+
+		// List the devices matching one of the { vendorID, productID, interface } rows
+		virtual std::vector<Device> enumerate(const std::vector<std::vector<uint16_t>> &deviceIds) = 0;
+
+		virtual bool open(const Device &device) = 0;
+		virtual bool close() = 0;
+		// Cheap check that a device found by an earlier enumeration is still at
+		// the same path, false when the transport can not tell without enumerating
+		virtual bool validate(const Device &device);
+
+		virtual bool write(const unsigned char *data, size_t size) = 0;
+		// Sends the reports of a whole frame in order, returns how many made it
+		virtual size_t writeBatch(const Report *reports, size_t count);
+		// Why the last write failed, empty when the transport has nothing to add
+		virtual std::string getError();
+		// Returns the size of the report read, 0 on timeout and -1 on error
+		virtual int read(unsigned char *data, size_t size, int timeoutMs) = 0;
+
+		// How many reports may be in flight at once, 1 sends them one by one
+		virtual bool setQueueDepth(unsigned int depth);
+		// When enabled the caller reads every reply itself, so the transport
+		// must neither pace writes nor swallow replies on its own
+		virtual void setAckReading(bool enabled);
+
+};
+
+
+// Keeps every report in memory instead of sending it, to measure and check
+// the encoder on a machine without a keyboard.
+class MemoryTransport : public LedTransport {
+
+
+	public:
+
+		struct Packet {
+			std::chrono::steady_clock::time_point time;
+			size_t size;
+			unsigned char data[maxReportSize];
+		};
+
+
+		std::string getName();
+
+		std::vector<Device> enumerate(const std::vector<std::vector<uint16_t>> &deviceIds);
+
+		bool open(const Device &device);
+		bool close();
+
+		bool write(const unsigned char *data, size_t size);
+		int read(unsigned char *data, size_t size, int timeoutMs);
+
+		void setAckReading(bool enabled);
+
+		const std::vector<Packet> &getPackets();
+		void clearPackets();
+
+		// Replies are served before the acknowledgements made up for each report
+		void pushReply(const std::vector<unsigned char> &reply);
+
+
+	private:
+
+		bool m_isOpen = false;
+		bool m_isAckReading = false;
+		std::vector<Packet> m_packets;
+		std::deque<std::vector<unsigned char>> m_replies;
+		std::deque<std::vector<unsigned char>> m_acks;
+
+};
+
+
+#if defined(hidapi)
+
+class HidapiTransport : public LedTransport {
+
+
+	public:
+
+		~HidapiTransport();
+
+		std::string getName();
+
+		std::vector<Device> enumerate(const std::vector<std::vector<uint16_t>> &deviceIds);
+
+		bool open(const Device &device);
+		bool close();
+		bool validate(const Device &device);
+
+		bool write(const unsigned char *data, size_t size);
+		std::string getError();
+		int read(unsigned char *data, size_t size, int timeoutMs);
+
+
+	private:
+
+		struct hid_device_ *m_hidHandle = NULL;
+
+};
+
+#elif defined(libusb)
+
+class LibusbTransport : public LedTransport {
+
+
+	public:
+
+		~LibusbTransport();
+
+		std::string getName();
+
+		std::vector<Device> enumerate(const std::vector<std::vector<uint16_t>> &deviceIds);
+
+		bool open(const Device &device);
+		bool close();
+		bool validate(const Device &device);
+
+		bool write(const unsigned char *data, size_t size);
+		size_t writeBatch(const Report *reports, size_t count);
+		std::string getError();
+		int read(unsigned char *data, size_t size, int timeoutMs);
+
+		bool setQueueDepth(unsigned int depth);
+		void setAckReading(bool enabled);
+
+
+	private:
+
+		bool m_isKernellDetached = false;
+		bool m_isAckReading = false;
+		int m_interfaceNumber = 1;
+		int m_lastError = 0;
+		libusb_device_handle *m_hidHandle = NULL;
+		libusb_context *m_ctx = NULL;
+
+		// Asynchronous mode, used when more than one report may be in flight
+		unsigned int m_queueDepth = 1;
+		bool m_isAsync = false;
+		bool m_isRunning = false;
+		bool m_isAckPending = false;
+		bool m_transferFailed = false;
+		unsigned int m_inFlight = 0;
+		std::thread m_eventThread;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::vector<libusb_transfer*> m_transfers;
+		std::vector<libusb_transfer*> m_freeTransfers;
+		std::vector<std::vector<unsigned char>> m_transferBuffers;
+		libusb_transfer *m_ackTransfer = NULL;
+		unsigned char m_ackBuffer[64];
+		// Ring of the latest acknowledgements, filled by the event thread
+		static const size_t maxAcks = 64;
+		Report m_acks[maxAcks];
+		size_t m_ackHead = 0;
+		size_t m_ackCount = 0;
+
+		bool startAsync();
+		void stopAsync();
+		bool drain(int timeoutMs);
+		void handleEvents();
+		static void onWriteDone(libusb_transfer *transfer);
+		static void onAckReceived(libusb_transfer *transfer);
+
+};
+
+#elif defined(hidraw)
+
+// Writes reports straight to /dev/hidrawN, found through sysfs
+class HidrawTransport : public LedTransport {
+
+
+	public:
+
+		~HidrawTransport();
+
+		std::string getName();
+
+		std::vector<Device> enumerate(const std::vector<std::vector<uint16_t>> &deviceIds);
+
+		bool open(const Device &device);
+		bool close();
+		bool validate(const Device &device);
+
+		bool write(const unsigned char *data, size_t size);
+		std::string getError();
+		int read(unsigned char *data, size_t size, int timeoutMs);
+
+
+	private:
+
+		int m_fd = -1;
+		int m_lastErrno = 0;
+
+};
+
+#endif
+
+#endif
@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include "utils.h"
+#include "../classes/KeyTable.h"
 
 
 using namespace std;
@@ -87,6 +88,18 @@ namespace help {
 		cout<<endl;
 		cout<<"  < {profile}\t\t\t\tSet a profile from a file (use --help-samples for more detail)"<<endl;
 		cout<<"  |\t\t\t\t\tSet a profile from stdin (for scripting) (use --help-samples for more detail)"<<endl;
+		if((features | KeyboardFeatures::setkey) == features) {
+			cout<<"  -ps\t\t\t\t\tSet binary frames from stdin until it closes (use --help-stream for more detail)"<<endl;
+			cout<<"  --ppm-stream\t\t\t\tShow binary PPM (P6) images read from stdin, averaged over each key"<<endl;
+			cout<<"  --shared-frame {name}\t\t\tShow the frames other processes write to /dev/shm/{name}"<<endl;
+			cout<<"  --gradient {h|v} {color} {color}\tSet a gradient across (h) or down (v) the keyboard"<<endl;
+			cout<<"  --effect {effect} {color} [period] [background]\tRun a software effect (k2000, scanner, wave, ripple or breathe)"<<endl;
+			cout<<"  --shader {expression}\t\t\tRun a per key color expression, such as \"hsv(x * 0.05 + t, 1, 1)\""<<endl;
+			cout<<"  --reactive {mode} {color} [background]\tLight keys as they are typed (fade, heatmap or ripple)"<<endl;
+			cout<<"  --visualize-pcm {color} [background]\tSpectrum bars of 16 bit PCM or WAV read from stdin (or --input)"<<endl;
+			cout<<"  --play {file}\t\t\t\tPlay a .g810a keyframe animation"<<endl;
+			cout<<"  --compile {script} {file}\t\tCompile a script of profile lines into a .g810a animation (-dp ties it to a model)"<<endl;
+		}
 		cout<<endl;
 		if((features | KeyboardFeatures::poweronfx) == features) {
 			cout<<"  --startup-mode {startup mode}\t\tSet startup mode"<<endl;
@@ -97,12 +110,16 @@ namespace help {
 			cout<<endl;
 		}
 		cout<<"  --list-keyboards \t\t\tList connected keyboards"<<endl;
+		cout<<"  --benchmark\t\t\t\tTime the encoding of a full frame for each model (-dp picks one), the color kernels and a shader"<<endl;
 		cout<<"  --print-device\t\t\tPrint device information for the keyboard"<<endl;
+		cout<<"  --daemon\t\t\t\tKeep the keyboards open and take commands from a socket (as g810-ledd)"<<endl;
 		cout<<endl;
 		cout<<"  --help\t\t\t\tThis help"<<endl;
 		cout<<"  --help-keys\t\t\t\tHelp for keys in groups"<<endl;
 		cout<<"  --help-effects\t\t\tHelp for native effects"<<endl;
 		cout<<"  --help-samples\t\t\tUsage samples"<<endl;
+		if((features | KeyboardFeatures::setkey) == features)
+			cout<<"  --help-stream\t\t\t\tFrame format and key indexes of -ps"<<endl;
 		cout<<endl;
 		cout<<"Options:"<<endl;
 		cout<<"  -dv\t\t\t\t\tDevice vendor ID, such as 046d for Logitech. Can be omitted to match any vendor ID"<<endl;
@@ -110,10 +127,32 @@ namespace help {
 		cout<<"  -ds\t\t\t\t\tDevice serial number, Can be omitted to match the first device found"<<endl;
 		cout<<"  -di\t\t\t\t\tDevice interface number. Can be used with -tuk argument to specify non-default device interface number"<<endl;
 		cout<<"  -tuk\t\t\t\t\tTest unsupported keyboard with one of supported protocol (1-5) -dv and -dp are required"<<endl;
+		cout<<"  --transport {transport}\t\tSend reports through hidapi, libusb, hidraw or mem (recorded in memory, use -dp to pick the model)"<<endl;
+		cout<<"  --queue-depth {value}\t\t\tReports kept in flight at once (libusb only, 01 waits for each report)"<<endl;
+		cout<<"  --ack-timeout {period}\t\tWait for the keyboard to acknowledge each report (100ms, 0 disables)"<<endl;
+		cout<<"  --no-cache\t\t\t\tEnumerate devices instead of reusing the path found last time"<<endl;
+		if((features | KeyboardFeatures::rgb) == features)
+			cout<<"  --calibration {file}\t\t\tGamma and white balance of each model, applied to every color sent"<<endl;
+		cout<<"  --stats\t\t\t\tPrint packet statistics (and recorded packets for mem) on exit"<<endl;
+		cout<<"  --fps {value}\t\t\t\tFrame rate, newer frames replace the waiting one (0 sends each)"<<endl;
+		cout<<"               \t\t\t\t-ps, --ppm-stream and --shared-frame: 0 by default"<<endl;
+		cout<<"               \t\t\t\t--effect, --shader and --visualize-pcm: 60 by default"<<endl;
+		cout<<"               \t\t\t\t--reactive: 60 by default, for the fading after a press"<<endl;
+		cout<<"               \t\t\t\t--play: the rate of the file by default"<<endl;
+		if((features | KeyboardFeatures::setkey) == features)
+			cout<<"  --layer {name} {priority}\t\tDraw into a layer of the daemon, above the ones with a lower priority (off removes it)"<<endl;
+		if((features | KeyboardFeatures::setkey) == features)
+			cout<<"  --input {path}\t\t\tEvent node --reactive reads (default the one of the keyboard), or PCM for --visualize-pcm"<<endl;
+		if((features | KeyboardFeatures::setkey) == features)
+			cout<<"  --pcm-format {rate} {channels}\tFormat of raw PCM for --visualize-pcm (default 44100 2, WAV has its own)"<<endl;
+		cout<<"  --socket {path}\t\t\tSocket of the daemon (default $XDG_RUNTIME_DIR/g810-led.sock)"<<endl;
+		cout<<"  --no-daemon\t\t\t\tOpen the keyboard here even when a daemon is running"<<endl;
 		cout<<endl;
 		cout<<"Values:"<<endl;
 		if((features | KeyboardFeatures::rgb) == features)
 			cout<<"  color formats :\t\t\tRRGGBB (hex value for red, green and blue)"<<endl;
+		if((features | KeyboardFeatures::rgb) == features)
+			cout<<"                 \t\t\tRRGGBBAA (with alpha, in a layer)"<<endl;
 		if((features | KeyboardFeatures::intensity) == features)
 			cout<<"  color formats :\t\t\tII (hex value for intensity)"<<endl;
 		if((features | KeyboardFeatures::setregion) == features)
@@ -376,4 +415,27 @@ namespace help {
 		cout<<""<<endl;
 	}
 	
+	void stream(char *arg0) {
+		string cmdName = utils::getCmdName(arg0);
+		cout<<cmdName<<" Stream"<<endl;
+		cout<<"---------------"<<endl;
+		cout<<endl;
+		cout<<"Each frame on stdin is a 4 byte header followed by its keys :"<<endl;
+		cout<<"  byte 0\t\t\t\t\t'F' (0x46)"<<endl;
+		cout<<"  byte 1\t\t\t\t\t's' for sparse or 'd' for dense keys"<<endl;
+		cout<<"  byte 2\t\t\t\t\tkey count, up to "<<(int)LedKeyboard::keyCount<<endl;
+		cout<<"  byte 3\t\t\t\t\tflags, 01 sets the keys without commit"<<endl;
+		cout<<endl;
+		cout<<"  sparse keys :\t\t\t\tindex, red, green, blue for each key"<<endl;
+		cout<<"  dense keys :\t\t\t\tred, green, blue for the indexes from 0 to count - 1"<<endl;
+		cout<<endl;
+		cout<<"Key indexes :"<<endl;
+		for (uint8_t i = 0; i < LedKeyboard::keyCount; i++)
+			cout<<"  "<<(int)i<<"\t"<<keytable::entries[i].name<<endl;
+		cout<<endl;
+		cout<<"Sample :"<<endl;
+		cout<<"printf 'Fs\\x02\\x00\\x2b\\xff\\x00\\x00\\x15\\x00\\x00\\xff' | "<<cmdName<<" -ps # Set w red and a blue"<<endl;
+		cout<<endl;
+	}
+	
 }
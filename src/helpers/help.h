@@ -66,6 +66,7 @@ namespace help {
 	void keys(char *arg0);
 	void effects(char *arg0);
 	void samples(char *arg0);
+	void stream(char *arg0);
 	
 }
 
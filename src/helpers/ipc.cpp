@@ -0,0 +1,178 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ipc.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+using namespace std;
+
+namespace ipc {
+	
+	namespace {
+		
+		// Requests are profiles, anything larger is not one
+		const size_t maxRequestSize = 1 << 20;
+		
+		volatile sig_atomic_t isStopping = 0;
+		
+		void onStop(int) {
+			isStopping = 1;
+		}
+		
+		bool makeAddress(const string &path, sockaddr_un &address) {
+			memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+				errno = ENAMETOOLONG;
+				return false;
+			}
+			memcpy(address.sun_path, path.c_str(), path.size());
+			return true;
+		}
+		
+		int connectTo(const string &path) {
+			sockaddr_un address;
+			if (! makeAddress(path, address)) return -1;
+			int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			if (fd < 0) return -1;
+			if (connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+				close(fd);
+				return -1;
+			}
+			return fd;
+		}
+		
+		bool writeAll(int fd, const string &data) {
+			size_t pos = 0;
+			while (pos < data.size()) {
+				ssize_t len = write(fd, data.data() + pos, data.size() - pos);
+				if (len < 0 && errno == EINTR) continue;
+				if (len <= 0) return false;
+				pos += len;
+			}
+			return true;
+		}
+		
+		// Reads until the other end shuts down its side
+		bool readAll(int fd, string &data) {
+			char buffer[4096];
+			while (true) {
+				ssize_t len = read(fd, buffer, sizeof(buffer));
+				if (len < 0 && errno == EINTR) continue;
+				if (len < 0) return false;
+				if (len == 0) return true;
+				if (data.size() + len > maxRequestSize) return false;
+				data.append(buffer, len);
+			}
+		}
+		
+	}
+	
+	
+	string getDefaultPath() {
+		const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+		if (runtimeDir != NULL && runtimeDir[0] != '\0') return string(runtimeDir) + "/g810-led.sock";
+		return "/run/g810-led.sock";
+	}
+	
+	
+	int serve(const string &path, Handler handler) {
+		sockaddr_un address;
+		if (! makeAddress(path, address)) {
+			cout<<"Invalid socket path "<<path<<endl;
+			return 1;
+		}
+		
+		// A socket nobody answers on is left over from a daemon that died
+		int fd = connectTo(path);
+		if (fd >= 0) {
+			close(fd);
+			cout<<"A daemon is already listening on "<<path<<endl;
+			return 1;
+		}
+		unlink(path.c_str());
+		
+		fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 16) < 0) {
+			cout<<"Can not listen on "<<path<<": "<<strerror(errno)<<endl;
+			if (fd >= 0) close(fd);
+			return 1;
+		}
+		
+		// No SA_RESTART, so that accept returns when asked to stop
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = onStop;
+		sigaction(SIGINT, &action, NULL);
+		sigaction(SIGTERM, &action, NULL);
+		signal(SIGPIPE, SIG_IGN);
+		cout<<"Listening on "<<path<<endl;
+		
+		while (! isStopping) {
+			int client = accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+			if (client < 0) {
+				if (errno == EINTR || errno == ECONNABORTED) continue;
+				cout<<"Can not accept clients: "<<strerror(errno)<<endl;
+				break;
+			}
+			
+			// A client that never finishes its request must not hold up the others
+			timeval timeout = { 5, 0 };
+			setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			
+			string request;
+			if (readAll(client, request)) {
+				ostringstream output;
+				int retval = handler(request, output);
+				writeAll(client, to_string(retval) + "\n" + output.str());
+			}
+			close(client);
+		}
+		
+		close(fd);
+		unlink(path.c_str());
+		return 0;
+	}
+	
+	bool send(const string &path, const string &request, int &retval, string &output) {
+		int fd = connectTo(path);
+		if (fd < 0) return false;
+		
+		string reply;
+		bool isAnswered = writeAll(fd, request) && shutdown(fd, SHUT_WR) == 0 && readAll(fd, reply);
+		close(fd);
+		
+		size_t end = reply.find('\n');
+		if (! isAnswered || end == string::npos) {
+			retval = 1;
+			output = "No reply from the daemon on " + path + "\n";
+			return true;
+		}
+		retval = atoi(reply.substr(0, end).c_str());
+		output = reply.substr(end + 1);
+		return true;
+	}
+	
+}
@@ -0,0 +1,41 @@
+/*
+  This file is part of g810-led.
+
+  g810-led is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, version 3 of the License.
+
+  g810-led is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef IPC_HELPER
+#define IPC_HELPER
+
+#include <functional>
+#include <iostream>
+#include <string>
+
+// Unix socket between g810-ledd, which keeps the keyboards open, and the
+// g810-led client. A request is the text of a profile, the reply the exit
+// code on its own line followed by what the commands printed.
+namespace ipc {
+	
+	typedef std::function<int(const std::string &request, std::ostream &output)> Handler;
+	
+	// $XDG_RUNTIME_DIR/g810-led.sock, or /run/g810-led.sock without a user session
+	std::string getDefaultPath();
+	
+	// Answers clients one at a time until SIGINT or SIGTERM
+	int serve(const std::string &path, Handler handler);
+	// False when no daemon listens on path, so the caller can run the request itself
+	bool send(const std::string &path, const std::string &request, int &retval, std::string &output);
+	
+}
+
+#endif
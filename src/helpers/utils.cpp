@@ -30,6 +30,15 @@ namespace utils {
 
 
 
+	bool parseTransport(std::string val, LedKeyboard::TransportType &transportType) {
+		if (val == "hidapi") transportType = LedKeyboard::TransportType::hidApi;
+		else if (val == "libusb") transportType = LedKeyboard::TransportType::libUsb;
+		else if (val == "hidraw") transportType = LedKeyboard::TransportType::hidRaw;
+		else if (val == "mem" || val == "memory") transportType = LedKeyboard::TransportType::memory;
+		else return false;
+		return true;
+	}
+
 	bool parseStartupMode(std::string val, LedKeyboard::StartupMode &startupMode) {
 		if (val == "wave") startupMode = LedKeyboard::StartupMode::wave;
 		else if (val == "color") startupMode = LedKeyboard::StartupMode::color;
@@ -64,6 +73,24 @@ namespace utils {
 		return true;
 	}
 	
+	bool parseReactiveMode(std::string val, ReactiveEffect::Mode &mode) {
+		if (val == "fade") mode = ReactiveEffect::Mode::fade;
+		else if (val == "heatmap") mode = ReactiveEffect::Mode::heatmap;
+		else if (val == "ripple") mode = ReactiveEffect::Mode::ripple;
+		else return false;
+		return true;
+	}
+	
+	bool parseSoftwareEffect(std::string val, SoftwareEffect::Effect &effect) {
+		if (val == "k2000") effect = SoftwareEffect::Effect::k2000;
+		else if (val == "scanner") effect = SoftwareEffect::Effect::scanner;
+		else if (val == "wave") effect = SoftwareEffect::Effect::wave;
+		else if (val == "ripple") effect = SoftwareEffect::Effect::ripple;
+		else if (val == "breathe") effect = SoftwareEffect::Effect::breathe;
+		else return false;
+		return true;
+	}
+	
 	bool parseKey(std::string val, LedKeyboard::Key &key) {
 		std::transform(val.begin(), val.end(), val.begin(), ::tolower);
 		if (val == "logo") key = LedKeyboard::Key::logo;
@@ -227,6 +254,15 @@ namespace utils {
 		return true;
 	}
 	
+	bool parseColor(std::string val, LedKeyboard::Color &color, uint8_t &alpha) {
+		alpha = 0xff;
+		if (val.length() == 8) {
+			if (! parseUInt8(val.substr(6), alpha)) return false;
+			val = val.substr(0, 6);
+		}
+		return parseColor(val, color);
+	}
+	
 	bool parsePeriod(std::string val, std::chrono::duration<uint16_t, std::milli> &period) {
 		if (!val.empty() && val.back() == 's') {
 			if ((val.length() >= 2) && (val[val.length()-2] == 'm'))
@@ -241,6 +277,21 @@ namespace utils {
 		return true;
 	}
 	
+	bool parseFrameRate(std::string val, unsigned int &frameRate) {
+		if (val.empty() || val.size() > 4 || val.find_first_not_of("0123456789") != std::string::npos) return false;
+		frameRate = std::stoul(val, nullptr, 10);
+		return frameRate <= 1000;
+	}
+	
+	// Decimal sample rate (8000 to 192000) and channel count (1 to 8)
+	bool parsePcmFormat(std::string rateVal, std::string channelsVal, unsigned int &rate, unsigned int &channels) {
+		if (rateVal.empty() || rateVal.size() > 6 || rateVal.find_first_not_of("0123456789") != std::string::npos) return false;
+		if (channelsVal.size() != 1 || channelsVal.find_first_not_of("0123456789") != std::string::npos) return false;
+		rate = std::stoul(rateVal, nullptr, 10);
+		channels = std::stoul(channelsVal, nullptr, 10);
+		return rate >= 8000 && rate <= 192000 && channels >= 1 && channels <= 8;
+	}
+	
 	bool parseUInt8(std::string val, uint8_t &uint8) {
 		if (val.length() == 1) val = "0" + val;
 		if (val.length() != 2) return false;
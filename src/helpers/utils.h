@@ -20,19 +20,27 @@
 #include <chrono>
 #include <iostream>
 #include "../classes/Keyboard.h"
+#include "../classes/ReactiveEffect.h"
+#include "../classes/SoftwareEffect.h"
 
 namespace utils {
 	
 	std::string getCmdName(std::string cmd);
 
+	bool parseTransport(std::string val, LedKeyboard::TransportType &transportType);
 	bool parseStartupMode(std::string val, LedKeyboard::StartupMode &startupMode);
 	bool parseOnBoardMode(std::string val, LedKeyboard::OnBoardMode &onBoardMode);
 	bool parseNativeEffect(std::string val, LedKeyboard::NativeEffect &nativeEffect);
 	bool parseNativeEffectPart(std::string val, LedKeyboard::NativeEffectPart &nativeEffectPart);
+	bool parseReactiveMode(std::string val, ReactiveEffect::Mode &mode);
+	bool parseSoftwareEffect(std::string val, SoftwareEffect::Effect &effect);
 	bool parseKey(std::string val, LedKeyboard::Key &key);
 	bool parseKeyGroup(std::string val, LedKeyboard::KeyGroup &keyGroup);
 	bool parseColor(std::string val, LedKeyboard::Color &color);
+	bool parseColor(std::string val, LedKeyboard::Color &color, uint8_t &alpha); // rrggbb or rrggbbaa
 	bool parsePeriod(std::string val, std::chrono::duration<uint16_t, std::milli> &period);
+	bool parseFrameRate(std::string val, unsigned int &frameRate);
+	bool parsePcmFormat(std::string rateVal, std::string channelsVal, unsigned int &rate, unsigned int &channels);
 	bool parseUInt8(std::string val, uint8_t &uint8);
 	bool parseUInt16(std::string val, uint16_t &uint16);
 	
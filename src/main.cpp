@@ -14,15 +14,63 @@
   along with g810-led.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
 #include <iomanip>
 #include <iostream>
 #include <unistd.h>
 #include <fstream>
 #include <map>
+#include <memory>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sstream>
 
 #include "helpers/help.h"
+#include "helpers/ipc.h"
 #include "helpers/utils.h"
+#include "classes/Animation.h"
+#include "classes/Calibration.h"
+#include "classes/ColorKernels.h"
+#include "classes/Compositor.h"
+#include "classes/FrameScheduler.h"
+#include "classes/ImageSampler.h"
+#include "classes/KeyInput.h"
 #include "classes/Keyboard.h"
+#include "classes/Layout.h"
+#include "classes/ReactiveEffect.h"
+#include "classes/Shader.h"
+#include "classes/SharedFrame.h"
+#include "classes/SoftwareEffect.h"
+#include "classes/Spectrum.h"
+
+#if defined(COUNT_ALLOCATIONS)
+	#include "benchmark/allocations.h"
+#endif
+
+
+// What the options set up, so the daemon can set up every keyboard it opens alike
+struct Settings {
+	bool isTransportSet = false;
+	LedKeyboard::TransportType transportType = LedKeyboard::TransportType::memory;
+	uint8_t queueDepth = 1;
+	std::chrono::milliseconds ackTimeout = std::chrono::milliseconds(0);
+	bool useDeviceCache = true;
+	std::shared_ptr<const Calibration> calibration; // NULL sends colors as given
+	std::vector<std::vector<uint16_t>> supportedKeyboards;
+	std::string layer; // Profile line picking the layer the command draws into
+	unsigned int frameRate = 0; // -ps and --shared-frame, 0 sends each frame right away
+	std::string inputPath; // Event node of --reactive, found from the keyboard when empty, or PCM of --visualize-pcm
+	unsigned int pcmRate = 44100; // Of raw PCM, a WAV header gives its own
+	unsigned int pcmChannels = 2;
+	bool isPrintingStats = false;
+	
+	std::string socketPath = ipc::getDefaultPath();
+	bool useDaemon = true; // Off when an option only makes sense for this process
+};
 
 
 int commit(LedKeyboard &kbd) {
@@ -38,6 +86,198 @@ void printDeviceInfo(LedKeyboard::DeviceInfo device) {
 	std::cout<<"\tSerial Number: "<<device.serialNumber<<std::endl;
 }
 
+void printStats(LedKeyboard &kbd) {
+	LedKeyboard::Stats stats = kbd.getStats();
+	std::cout<<"Transport: "<<kbd.getTransport()->getName()<<std::endl;
+	std::cout<<"\tPackets: "<<std::dec<<stats.packets<<std::endl;
+	std::cout<<"\tBytes: "<<stats.bytes<<std::endl;
+	std::cout<<"\tErrors: "<<stats.errors<<std::endl;
+	std::cout<<"\tReconnects: "<<stats.reconnects<<std::endl;
+	std::cout<<"\tKeys sent: "<<stats.keysSent<<std::endl;
+	std::cout<<"\tKeys skipped: "<<stats.keysSkipped<<std::endl;
+	std::cout<<"\tKey reports: "<<stats.keyReports<<" (planned "<<stats.keyReportsPlanned<<")"<<std::endl;
+	std::cout<<"\tWrite time: "<<std::chrono::duration_cast<std::chrono::microseconds>(stats.writeTime).count()<<"us"<<std::endl;
+	if (stats.acks + stats.ackTimeouts + stats.ackErrors > 0) {
+		std::cout<<"\tAcks: "<<stats.acks<<std::endl;
+		std::cout<<"\tAck timeouts: "<<stats.ackTimeouts<<std::endl;
+		std::cout<<"\tAck errors: "<<stats.ackErrors;
+		if (stats.ackErrors > 0)
+			std::cout<<" (last error "<<std::hex<<std::setw(2)<<std::setfill('0')<<(int)kbd.getLastAckError()<<std::dec<<")";
+		std::cout<<std::endl;
+		if (stats.acks > 0)
+			std::cout<<"\tAck round trip: "<<std::chrono::duration_cast<std::chrono::microseconds>(stats.ackTime).count() / stats.acks<<"us"<<std::endl;
+	}
+	
+	MemoryTransport *memory = dynamic_cast<MemoryTransport*>(kbd.getTransport());
+	if (memory == NULL) return;
+	const std::vector<MemoryTransport::Packet> &packets = memory->getPackets();
+	for (size_t i = 0; i < packets.size(); i++) {
+		std::cout<<"\t"<<std::dec<<std::chrono::duration_cast<std::chrono::microseconds>(
+			packets[i].time - packets[0].time).count()<<"us\t";
+		for (size_t j = 0; j < packets[i].size; j++)
+			std::cout<<std::hex<<std::setw(2)<<std::setfill('0')<<(int)packets[i].data[j];
+		std::cout<<std::endl;
+	}
+}
+
+// Times the color kernels on every instruction set the CPU has, checking
+// that each one gives the same frame as the scalar version
+bool benchmarkKernels(int frames) {
+	kernels::Frame source, other, frame, out, expected[6];
+	uint8_t alpha[LedKeyboard::keyCount], lut[256];
+	for (size_t i = 0; i < LedKeyboard::keyCount; i++) {
+		source.red[i] = i * 2;
+		source.green[i] = 0xff - i;
+		source.blue[i] = i * 7;
+		other.red[i] = 0xff - i * 3;
+		other.green[i] = i;
+		other.blue[i] = i * 5;
+		alpha[i] = i * 11;
+	}
+	for (int i = 0; i < 256; i++) lut[i] = 255 * (i / 255.0) * (i / 255.0) + 0.5;
+	
+	const char *names[] = { "Brightness", "Gamma LUT", "Crossfade", "Additive", "Alpha blend", "Saturation" };
+	bool isMatching = true;
+	kernels::Isa best = kernels::getIsa();
+	for (uint8_t isa = 0; isa <= static_cast<uint8_t>(best); isa++) {
+		kernels::setIsa(static_cast<kernels::Isa>(isa));
+		std::cout<<"Color kernels ("<<kernels::getIsaName(kernels::getIsa())<<"):"<<std::endl;
+		for (int kernel = 0; kernel < 6; kernel++) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for (int i = 0; i < frames; i++) {
+				frame = source;
+				switch (kernel) {
+					case 0: kernels::scale(frame, 0x80 + (i & 0x7f)); break;
+					case 1: kernels::applyLut(frame, lut, lut, lut); break;
+					case 2: kernels::lerp(frame, other, i & 0xff, out); frame = out; break;
+					case 3: kernels::add(frame, other); break;
+					case 4: kernels::blend(frame, other, alpha); break;
+					case 5: kernels::saturate(frame, i & 0x1ff); break;
+				}
+			}
+			std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+			// The last frame, computed by the scalar kernels first
+			if (isa == 0) expected[kernel] = frame;
+			else if (memcmp(&expected[kernel], &frame, sizeof(frame)) != 0) isMatching = false;
+			std::cout<<"\t"<<names[kernel]<<": "<<elapsed.count() / frames<<"ns per frame"<<std::endl;
+		}
+	}
+	kernels::setIsa(best);
+	std::cout<<"\tMatches scalar: "<<(isMatching ? "yes" : "no")<<std::endl;
+	return isMatching;
+}
+
+int benchmark(LedKeyboard &kbd, uint16_t vendorID, uint16_t productID, std::string serial) {
+	const int frames = 10000;
+	
+	// Record into memory, so that only the encoder is measured
+	MemoryTransport *memory = new MemoryTransport();
+	kbd.setTransport(memory);
+	
+	LedKeyboard::KeyValueArray keyValues;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++)
+		keyValues.push_back({ LedKeyboard::getKey(i), { i, (uint8_t)(0xff - i), (uint8_t)(i * 2) } });
+	
+	std::vector<std::vector<uint16_t>> devices;
+	for (size_t i = 0; i < kbd.SupportedKeyboards.size(); i++) {
+		if (vendorID != 0x0 && kbd.SupportedKeyboards[i][0] != vendorID) continue;
+		if (productID != 0x0 && kbd.SupportedKeyboards[i][1] != productID) continue;
+		bool isDuplicate = false;
+		for (size_t j = 0; j < devices.size(); j++)
+			if (devices[j][3] == kbd.SupportedKeyboards[i][3]) isDuplicate = true;
+		if (! isDuplicate) devices.push_back(kbd.SupportedKeyboards[i]);
+	}
+	if (devices.empty()) {
+		std::cout<<"Matching or compatible device not found"<<std::endl;
+		return 1;
+	}
+	
+	int retval = 0;
+	for (size_t i = 0; i < devices.size(); i++) {
+		if (! kbd.open(devices[i][0], devices[i][1], serial)) {
+			retval = 1;
+			continue;
+		}
+		
+		// One frame first, so that buffers reach their steady state size
+		kbd.setKeys(keyValues);
+		memory->clearPackets();
+		
+		kbd.resetStats();
+#if defined(COUNT_ALLOCATIONS)
+		uint64_t allocationCount = allocations::getCount();
+#endif
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++) {
+			kbd.invalidateShadow(); // Every frame is a full one
+			kbd.setKeys(keyValues);
+			memory->clearPackets();
+		}
+		std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+#if defined(COUNT_ALLOCATIONS)
+		allocationCount = allocations::getCount() - allocationCount;
+#endif
+		LedKeyboard::Stats stats = kbd.getStats();
+		
+		std::cout<<"Product ID: "<<std::hex<<std::setw(4)<<std::setfill('0')<<devices[i][1]<<std::dec<<std::endl;
+		std::cout<<"\tKeys per frame: "<<(int)LedKeyboard::keyCount<<std::endl;
+		std::cout<<"\tPackets per frame: "<<stats.packets / frames<<" (planned "<<stats.keyReportsPlanned / frames<<")"<<std::endl;
+		std::cout<<"\tEncode time: "<<elapsed.count() / frames<<"ns per frame"<<std::endl;
+#if defined(COUNT_ALLOCATIONS)
+		std::cout<<"\tAllocations: "<<allocationCount<<" in "<<frames<<" frames"<<std::endl;
+		if (allocationCount > 0) retval = 1;
+#endif
+		
+		// A software effect frame, computed from the geometry of the model
+		SoftwareEffect effect(kbd.getKeyboardModel(), SoftwareEffect::Effect::wave, { 0xff, 0, 0 }, { 0, 0, 0xff });
+		LedKeyboard::Color colors[LedKeyboard::keyCount];
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++) effect.render(std::chrono::milliseconds(frame), colors);
+		elapsed = std::chrono::steady_clock::now() - start;
+		std::cout<<"\tRender time: "<<elapsed.count() / frames<<"ns per frame (wave)"<<std::endl;
+		
+		// A wave with a hue scrolling under it, as the interpreter runs a profile shader
+		Shader shader(kbd.getKeyboardModel());
+		shader.compile("hsv(x * 0.05 + t * 0.2, 1, sin(x * 0.5 - t * 6.28) * 0.5 + 0.5)");
+		start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; frame++) shader.render(std::chrono::milliseconds(frame), colors);
+		elapsed = std::chrono::steady_clock::now() - start;
+		std::cout<<"\tShader time: "<<elapsed.count() / frames<<"ns per frame ("<<shader.getInstructionCount()
+			 <<" instructions, "<<shader.getRegisterCount()<<" registers)"<<std::endl;
+		kbd.close();
+	}
+	
+	if (! benchmarkKernels(frames)) retval = 1;
+	
+	return retval;
+}
+
+void printFrameStats(FrameScheduler &scheduler) {
+	FrameScheduler::Stats stats = scheduler.getStats();
+	std::cout<<"Frames: "<<std::dec<<stats.frames<<std::endl;
+	std::cout<<"\tFrame rate: "<<std::fixed<<std::setprecision(1)<<scheduler.getFramesPerSecond()<<" fps";
+	if (scheduler.getFrameRate() > 0) std::cout<<" (target "<<scheduler.getFrameRate()<<")";
+	std::cout<<std::endl;
+	std::cout<<"\tDropped: "<<stats.dropped<<std::endl;
+	std::cout<<"\tLate ticks: "<<stats.lateTicks<<std::endl;
+	std::cout<<"\tErrors: "<<stats.errors<<std::endl;
+	std::cout<<"\tJitter: "<<std::chrono::duration_cast<std::chrono::microseconds>(scheduler.getJitter()).count()
+		<<"us (max "<<std::chrono::duration_cast<std::chrono::microseconds>(stats.jitterMax).count()<<"us)"<<std::endl;
+}
+
+void printCpuUsage(const rusage &startUsage, std::chrono::steady_clock::time_point start) {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	std::chrono::microseconds cpu =
+		std::chrono::seconds(usage.ru_utime.tv_sec - startUsage.ru_utime.tv_sec) +
+		std::chrono::microseconds(usage.ru_utime.tv_usec - startUsage.ru_utime.tv_usec) +
+		std::chrono::seconds(usage.ru_stime.tv_sec - startUsage.ru_stime.tv_sec) +
+		std::chrono::microseconds(usage.ru_stime.tv_usec - startUsage.ru_stime.tv_usec);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout<<"\tCPU: "<<std::fixed<<std::setprecision(2)
+		<<100 * std::chrono::duration<double>(cpu).count() / elapsed.count()<<"% of a core"<<std::endl;
+}
+
 int listKeyboards(LedKeyboard &kbd) {
 	std::vector<LedKeyboard::DeviceInfo> deviceList = kbd.listKeyboards();
 	if (deviceList.empty()) {
@@ -183,10 +423,272 @@ int setOnBoardMode(LedKeyboard &kbd, std::string arg2) {
 }
 
 
-int parseProfile(LedKeyboard &kbd, std::istream &stream) {
+volatile sig_atomic_t isStopping = 0;
+
+void onStop(int) {
+	isStopping = 1;
+}
+
+// The loops that run until SIGINT or SIGTERM check isStopping, waits return EINTR
+void catchStop() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = onStop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+}
+
+// Hands the keys a renderer drives to the scheduler, the shadow of the
+// keyboard leaves out those that kept their color
+template <typename Driven>
+void setFrameKeys(FrameScheduler &scheduler, const LedKeyboard::Color *colors, Driven isDriven) {
+	LedKeyboard::KeyValue keyValues[LedKeyboard::keyCount];
+	uint8_t count = 0;
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++)
+		if (isDriven(i)) keyValues[count++] = { LedKeyboard::getKey(i), colors[i] };
+	scheduler.setKeys(keyValues, count);
+}
+
+// Renders a frame for each tick until SIGINT, SIGTERM or render returning false.
+// render(time, colors) renders for the time the frame goes out, isDriven(index)
+// tells the keys it sets.
+template <typename Render, typename Driven>
+void runFrames(FrameScheduler &scheduler, Render render, Driven isDriven) {
+	LedKeyboard::Color colors[LedKeyboard::keyCount];
+	bool isRunning = true;
+	while (! isStopping && isRunning) {
+		// Rendered for when the frame goes out, not for when it is computed
+		isRunning = render(std::max(scheduler.getDeadline(), std::chrono::steady_clock::now()), colors);
+		setFrameKeys(scheduler, colors, isDriven);
+		scheduler.endFrame();
+		scheduler.waitAndFlush();
+	}
+}
+
+// Runs a software effect until SIGINT or SIGTERM
+int runEffect(LedKeyboard &kbd, std::string arg2, std::string arg3, std::string arg4, std::string arg5,
+	      const Settings &settings) {
+	SoftwareEffect::Effect effectType;
+	LedKeyboard::Color color;
+	std::chrono::duration<uint16_t, std::milli> period(0);
+	LedKeyboard::Color background = { 0, 0, 0 };
+	if (! utils::parseSoftwareEffect(arg2, effectType)) return 1;
+	if (! utils::parseColor(arg3, color)) return 1;
+	if (! arg4.empty() && ! utils::parsePeriod(arg4, period)) return 1;
+	if (! arg5.empty() && ! utils::parseColor(arg5, background)) return 1;
+	if (! kbd.open()) return 1;
+	
+	catchStop();
+	SoftwareEffect effect(kbd.getKeyboardModel(), effectType, color, background,
+			      std::chrono::milliseconds(period.count()));
+	FrameScheduler scheduler(kbd, settings.frameRate > 0 ? settings.frameRate : 60);
+	
+	rusage startUsage;
+	getrusage(RUSAGE_SELF, &startUsage);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	runFrames(scheduler, [&](std::chrono::steady_clock::time_point time, LedKeyboard::Color *colors) {
+		effect.render(time - start, colors);
+		return true;
+	}, [&](uint8_t index) { return effect.isDriven(index); });
+	
+	if (settings.isPrintingStats) {
+		printFrameStats(scheduler);
+		printCpuUsage(startUsage, start);
+	}
+	return scheduler.getStats().errors > 0 ? 1 : 0;
+}
+
+// Runs a shader expression until SIGINT or SIGTERM
+int runShader(LedKeyboard &kbd, const std::string &source, const Settings &settings) {
+	// Compiled against any model first, so that a typo fails before the keyboard is touched
+	Shader check(LedKeyboard::KeyboardModel::unknown);
+	if (! check.compile(source)) {
+		std::cout<<"Shader error: "<<check.getError()<<std::endl;
+		return 1;
+	}
+	if (! kbd.open()) return 1;
+	
+	catchStop();
+	Shader shader(kbd.getKeyboardModel());
+	shader.compile(source);
+	FrameScheduler scheduler(kbd, settings.frameRate > 0 ? settings.frameRate : 60);
+	
+	rusage startUsage;
+	getrusage(RUSAGE_SELF, &startUsage);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	runFrames(scheduler, [&](std::chrono::steady_clock::time_point time, LedKeyboard::Color *colors) {
+		shader.render(time - start, colors);
+		return true;
+	}, [&](uint8_t index) { return shader.isDriven(index); });
+	
+	if (settings.isPrintingStats) {
+		printFrameStats(scheduler);
+		printCpuUsage(startUsage, start);
+	}
+	return scheduler.getStats().errors > 0 ? 1 : 0;
+}
+
+int compileAnimation(LedKeyboard &kbd, const std::string &scriptPath, const std::string &path, uint16_t productID) {
+	std::ifstream script(scriptPath);
+	if (! script.is_open()) {
+		std::cout<<"Could not read "<<scriptPath<<std::endl;
+		return 1;
+	}
+	
+	// -dp ties the animation to a model, it plays on any otherwise
+	LedKeyboard::KeyboardModel model = LedKeyboard::KeyboardModel::unknown;
+	for (size_t i = 0; i < kbd.SupportedKeyboards.size() && productID != 0x0; i++)
+		if (kbd.SupportedKeyboards[i][1] == productID) model = (LedKeyboard::KeyboardModel)kbd.SupportedKeyboards[i][3];
+	
+	// Each c line ends a keyframe holding every color set so far
+	unsigned int frameRate = 30;
+	bool isLooping = false;
+	std::vector<Animation::Keyframe> keyframes;
+	std::vector<uint32_t> durations; // ms of each keyframe, 0 for a single tick
+	Animation::Keyframe keyframe;
+	bool isChanged = false;
+	std::map<std::string, std::string> vars;
+	std::string line;
+	for (size_t lineNumber = 1; getline(script, line); lineNumber++) {
+		std::istringstream words(line);
+		std::vector<std::string> args;
+		std::string word;
+		while (words>>word) {
+			if (word[0] == '#') break;
+			if (word[0] == '$') word = vars[word.substr(1)];
+			args.push_back(word);
+		}
+		if (args.empty()) continue;
+		
+		bool isValid = true;
+		LedKeyboard::Color color;
+		std::chrono::duration<uint16_t, std::milli> period;
+		if (args[0] == "var" && args.size() > 2) vars[args[1]] = args[2];
+		else if (args[0] == "fps" && args.size() > 1)
+			isValid = utils::parseFrameRate(args[1], frameRate) && frameRate > 0;
+		else if (args[0] == "loop") isLooping = true;
+		else if (args[0] == "a" && args.size() > 1 && utils::parseColor(args[1], color)) {
+			for (uint8_t i = 0; i < LedKeyboard::keyCount; i++) {
+				keyframe.colors[i] = color;
+				keyframe.isSet[i] = true;
+			}
+			isChanged = true;
+		} else if (args[0] == "g" && args.size() > 2) {
+			LedKeyboard::KeyGroup keyGroup;
+			const LedKeyboard::KeyArray *groupKeys = NULL;
+			if (utils::parseKeyGroup(args[1], keyGroup)) groupKeys = kbd.getGroupKeys(keyGroup);
+			isValid = groupKeys != NULL && utils::parseColor(args[2], color);
+			for (size_t i = 0; isValid && i < groupKeys->size(); i++) {
+				uint8_t index = LedKeyboard::getKeyIndex((*groupKeys)[i]);
+				keyframe.colors[index] = color;
+				keyframe.isSet[index] = true;
+			}
+			isChanged = true;
+		} else if (args[0] == "k" && args.size() > 2) {
+			LedKeyboard::Key key;
+			isValid = utils::parseKey(args[1], key) && utils::parseColor(args[2], color);
+			if (isValid) {
+				uint8_t index = LedKeyboard::getKeyIndex(key);
+				keyframe.colors[index] = color;
+				keyframe.isSet[index] = true;
+			}
+			isChanged = true;
+		} else if (args[0] == "c") {
+			keyframes.push_back(keyframe);
+			durations.push_back(0);
+			isChanged = false;
+		} else if ((args[0] == "wait" || args[0] == "fade") && args.size() > 1 && ! keyframes.empty()) {
+			// How long the last keyframe lasts, fading into the next one or not
+			isValid = utils::parsePeriod(args[1], period);
+			durations.back() = period.count();
+			keyframes.back().interpolation = args[0] == "fade" ? Animation::Interpolation::linear :
+									     Animation::Interpolation::step;
+		} else isValid = false;
+		
+		if (! isValid) {
+			std::cout<<"Invalid line "<<lineNumber<<" of "<<scriptPath<<std::endl;
+			return 1;
+		}
+	}
+	// Colors set without a c line still make a last keyframe, as in a profile
+	if (isChanged || keyframes.empty()) {
+		keyframes.push_back(keyframe);
+		durations.push_back(0);
+	}
+	
+	for (size_t i = 0; i < keyframes.size(); i++) {
+		uint64_t ticks = (static_cast<uint64_t>(durations[i]) * frameRate + 500) / 1000;
+		keyframes[i].ticks = std::min<uint64_t>(std::max<uint64_t>(ticks, 1), 0xffff);
+	}
+	if (! Animation::save(path, model, frameRate, isLooping, keyframes)) {
+		std::cout<<"Could not write "<<path<<std::endl;
+		return 1;
+	}
+	return 0;
+}
+
+int playAnimation(LedKeyboard &kbd, const std::string &path, const Settings &settings) {
+	Animation animation;
+	if (! animation.open(path)) {
+		std::cout<<"Could not read animation "<<path<<std::endl;
+		return 1;
+	}
+	if (! kbd.open()) return 1;
+	if (animation.getModel() != LedKeyboard::KeyboardModel::unknown && animation.getModel() != kbd.getKeyboardModel()) {
+		std::cout<<"Animation "<<path<<" was made for another model"<<std::endl;
+		return 1;
+	}
+	
+	catchStop();
+	// Frames are rendered for the time they go out, so --fps may differ from the file
+	FrameScheduler scheduler(kbd, settings.frameRate > 0 ? settings.frameRate : animation.getFrameRate());
+	
+	rusage startUsage;
+	getrusage(RUSAGE_SELF, &startUsage);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	runFrames(scheduler, [&](std::chrono::steady_clock::time_point time, LedKeyboard::Color *colors) {
+		return animation.render(time - start, colors);
+	}, [&](uint8_t index) { return animation.isDriven(index); });
+	
+	if (settings.isPrintingStats) {
+		printFrameStats(scheduler);
+		printCpuUsage(startUsage, start);
+	}
+	return scheduler.getStats().errors > 0 ? 1 : 0;
+}
+
+
+// The colors of a gradient over the keys the model has, across (h) or down (v) the board
+bool renderGradient(LedKeyboard &kbd, std::string arg2, std::string arg3, std::string arg4,
+		    LedKeyboard::KeyValueArray &keyValues) {
+	LedKeyboard::Color from, to;
+	if (arg2 != "h" && arg2 != "v") return false;
+	if (! utils::parseColor(arg3, from) || ! utils::parseColor(arg4, to)) return false;
+	
+	const layout::Geometry &geometry = layout::getGeometry(kbd.getKeyboardModel());
+	float levels[LedKeyboard::keyCount];
+	LedKeyboard::Color colors[LedKeyboard::keyCount];
+	if (arg2 == "h") {
+		const float left = geometry.left, width = std::max(geometry.right - geometry.left, 1.0f);
+		layout::evaluate(geometry, [=](float x, float) { return (x - left) / width; }, levels);
+	} else {
+		const float top = geometry.top, height = std::max(geometry.bottom - geometry.top, 1.0f);
+		layout::evaluate(geometry, [=](float, float y) { return (y - top) / height; }, levels);
+	}
+	layout::paint(levels, from, to, colors);
+	
+	keyValues.clear();
+	for (uint8_t i = 0; i < LedKeyboard::keyCount; i++)
+		if (geometry.isPlaced[i]) keyValues.push_back({ LedKeyboard::getKey(i), colors[i] });
+	return true;
+}
+
+int parseProfile(LedKeyboard &kbd, std::istream &stream, Compositor &compositor, const Settings *settings) {
 	std::string line;
 	std::map<std::string, std::string> vars;
 	LedKeyboard::KeyValueArray keys = {};
+	Compositor::Layer *layer = NULL; // Once a layer line picked one, colors are drawn into it
+	bool isComposed = false;
 	int retval = 0;
 	while (!stream.eof()) {
 		getline(stream, line);
@@ -200,26 +702,82 @@ int parseProfile(LedKeyboard &kbd, std::istream &stream) {
 				if (line.substr(0, ind) == line) line.clear();
 				else line = line.substr(ind + 1);
 			}
+			// Plain colors are the base under the layers, they only go to the
+			// keyboard straight away while there are no layers on top
+			LedKeyboard::Color color;
+			uint8_t alpha;
 			if (args[0] == "var" && args.size() > 2) {
 				vars[args[1]] = args[2];
+			} else if (args[0] == "layer" && args.size() > 2) {
+				uint8_t priority;
+				if (args[2] == "off") {
+					if (compositor.removeLayer(args[1])) isComposed = true;
+					layer = NULL;
+				} else if (utils::parseUInt8(args[2], priority)) {
+					layer = compositor.getLayer(args[1], priority);
+					isComposed = true;
+				} else retval = 1;
 			} else if (args[0] == "c") {
 				if (kbd.open()) {
 					if (keys.size() > 0) {
 						if (! kbd.setKeys(keys)) retval = 1;
 						keys.clear();
 					}
-					if(! kbd.commit()) retval = 1;
+					if (isComposed) {
+						if (! compositor.apply()) retval = 1;
+						isComposed = false;
+					} else if(! kbd.commit()) retval = 1;
 				} else retval = 1;
+			} else if (args[0] == "resync") {
+				if (! kbd.open() || ! kbd.resync()) retval = 1;
+			} else if (args[0] == "a" && args.size() > 1 && layer != NULL) {
+				if (utils::parseColor(args[1], color, alpha)) Compositor::setAllKeys(*layer, color, alpha);
+				else retval = 1;
+				isComposed = true;
 			} else if (args[0] == "a" && args.size() > 1) {
-				if (setAllKeys(kbd, args[1], false) == 1) retval = 1;
+				if (compositor.getLayerCount() > 0) isComposed = true;
+				else if (setAllKeys(kbd, args[1], false) == 1) retval = 1;
+				if (utils::parseColor(args[1], color)) compositor.setBase(color);
 			} else if (args[0] == "g" && args.size() > 2) {
-				if (setGroupKeys(kbd, args[1], args[2], false) == 1) retval = 1;
+				LedKeyboard::KeyGroup keyGroup;
+				const LedKeyboard::KeyArray *groupKeys = NULL;
+				if (utils::parseKeyGroup(args[1], keyGroup)) groupKeys = kbd.getGroupKeys(keyGroup);
+				if (layer != NULL) {
+					if (groupKeys != NULL && utils::parseColor(args[2], color, alpha))
+						Compositor::setKeys(*layer, *groupKeys, color, alpha);
+					else retval = 1;
+					isComposed = true;
+				} else {
+					if (compositor.getLayerCount() > 0) isComposed = true;
+					else if (setGroupKeys(kbd, args[1], args[2], false) == 1) retval = 1;
+					if (groupKeys != NULL && utils::parseColor(args[2], color))
+						compositor.setBase(*groupKeys, color);
+				}
+			} else if (args[0] == "gradient" && args.size() > 3) {
+				LedKeyboard::KeyValueArray gradient;
+				// The model decides where the keys are
+				if (! kbd.open() || ! renderGradient(kbd, args[1], args[2], args[3], gradient)) retval = 1;
+				else if (layer != NULL) {
+					for (size_t i = 0; i < gradient.size(); i++)
+						Compositor::setKey(*layer, gradient[i].key, gradient[i].color);
+					isComposed = true;
+				} else {
+					if (compositor.getLayerCount() > 0) isComposed = true;
+					else keys.insert(keys.end(), gradient.begin(), gradient.end());
+					for (size_t i = 0; i < gradient.size(); i++) compositor.setBase(gradient[i].key, gradient[i].color);
+				}
 			} else if (args[0] == "k" && args.size() > 2) {
 				LedKeyboard::Key key;
-				LedKeyboard::Color color;
-				if (utils::parseKey(args[1], key))
-					if (utils::parseColor(args[2], color))
-						keys.push_back({ key, color });
+				if (! utils::parseKey(args[1], key)) retval = 1;
+				else if (layer != NULL) {
+					if (utils::parseColor(args[2], color, alpha)) Compositor::setKey(*layer, key, color, alpha);
+					else retval = 1;
+					isComposed = true;
+				} else if (utils::parseColor(args[2], color)) {
+					if (compositor.getLayerCount() > 0) isComposed = true;
+					else keys.push_back({ key, color });
+					compositor.setBase(key, color);
+				} else retval = 1;
 			} else if (args[0] == "r" && args.size() > 2) {
 				if (setRegion(kbd, args[1], args[2]) == 1) retval = 1;
 			} else if (args[0] == "mr" && args.size() > 1) {
@@ -232,6 +790,35 @@ int parseProfile(LedKeyboard &kbd, std::istream &stream) {
 				if (setStartupMode(kbd, args[1]) == 1) retval = 1;
 			} else if (args[0] == "obm" && args.size() > 1) {
 				if (setOnBoardMode(kbd, args[1]) == 1) retval = 1;
+			} else if (args[0] == "effect" && args.size() > 2) {
+				// Runs until stopped, so only where a process of its own runs the profile
+				if (settings == NULL) {
+					std::cout<<"Effects do not run in the daemon"<<std::endl;
+					retval = 1;
+					continue;
+				}
+				if (keys.size() > 0) {
+					if (! kbd.open() || ! kbd.setKeys(keys)) retval = 1;
+					keys.clear();
+				}
+				args.resize(5);
+				if (runEffect(kbd, args[1], args[2], args[3], args[4], *settings) == 1) retval = 1;
+			} else if (args[0] == "shader" && args.size() > 1) {
+				if (settings == NULL) {
+					std::cout<<"Shaders do not run in the daemon"<<std::endl;
+					retval = 1;
+					continue;
+				}
+				if (keys.size() > 0) {
+					if (! kbd.open() || ! kbd.setKeys(keys)) retval = 1;
+					keys.clear();
+				}
+				// The expression may hold spaces, quoted or not
+				std::string source = args[1];
+				for (size_t i = 2; i < args.size(); i++) source += " " + args[i];
+				if (source.size() > 1 && source.front() == '"' && source.back() == '"')
+					source = source.substr(1, source.size() - 2);
+				if (runShader(kbd, source, *settings) == 1) retval = 1;
 			} else if (args[0] == "fx" && args.size() > 4) {
 				if (setFX(kbd, args[1], args[2], args[3], args[4]) == 1) retval = 1;
 			} else if (args[0] == "fx" && args.size() > 3) {
@@ -239,39 +826,707 @@ int parseProfile(LedKeyboard &kbd, std::istream &stream) {
 			}
 		}
 	}
+	// Keys set without a commit still go out, as with -kn
+	if (keys.size() > 0 && (! kbd.open() || ! kbd.setKeys(keys))) retval = 1;
+	if (isComposed && (! kbd.open() || ! compositor.apply(false))) retval = 1;
 	return retval;
 }
+
+int parseProfile(LedKeyboard &kbd, std::istream &stream, const Settings &settings) {
+	// Layers only last for this profile, the daemon keeps them between requests
+	Compositor compositor(kbd);
+	return parseProfile(kbd, stream, compositor, &settings);
+}
 	
-int loadProfile(LedKeyboard &kbd, char *arg2) {
+int loadProfile(LedKeyboard &kbd, char *arg2, const Settings &settings) {
 	std::ifstream file;
 	file.open(arg2);
 	if (file.is_open()) {
 		int retval = 0;
-		retval = parseProfile(kbd, file);
+		retval = parseProfile(kbd, file, settings);
 		file.close();
 		return retval;
 	}
 	return 1;
 }
 
-int pipeProfile(LedKeyboard &kbd) {
+int pipeProfile(LedKeyboard &kbd, const Settings &settings) {
 	if (isatty(fileno(stdin))) return 1;
-	return parseProfile(kbd, std::cin);
+	return parseProfile(kbd, std::cin, settings);
 }
 
+// Fills data unless the stream ends first, returns how much was read
+size_t readFully(int fd, unsigned char *data, size_t size) {
+	size_t pos = 0;
+	while (pos < size) {
+		ssize_t len = read(fd, data + pos, size - pos);
+		if (len < 0 && errno == EINTR) continue;
+		if (len <= 0) break;
+		pos += len;
+	}
+	return pos;
+}
 
+size_t readStdin(unsigned char *data, size_t size) {
+	return readFully(STDIN_FILENO, data, size);
+}
 
-int main(int argc, char **argv) {
-	if (argc < 2) {
-		help::usage(argv[0]);
+// Reads one binary frame into the scheduler, see help::stream for the format.
+// Returns 0 at the end of the stream, 1 on a malformed frame, 2 otherwise.
+int readFrame(FrameScheduler &scheduler) {
+	const uint8_t noCommit = 0x01;
+	unsigned char header[4];
+	unsigned char data[LedKeyboard::keyCount * 4];
+	LedKeyboard::KeyValue keyValues[LedKeyboard::keyCount];
+	
+	size_t len = readStdin(header, sizeof(header));
+	if (len == 0) return 0; // Closed between frames
+	if (len < sizeof(header) || header[0] != 'F' || header[2] > LedKeyboard::keyCount) return 1;
+	
+	const bool isSparse = header[1] == 's';
+	if (! isSparse && header[1] != 'd') return 1;
+	const uint8_t count = header[2];
+	const size_t size = count * (isSparse ? 4 : 3);
+	if (readStdin(data, size) < size) return 1;
+	
+	const unsigned char *pos = data;
+	for (uint8_t i = 0; i < count; i++) {
+		uint8_t index = isSparse ? *pos++ : i;
+		if (index >= LedKeyboard::keyCount) return 1;
+		keyValues[i].key = LedKeyboard::getKey(index);
+		keyValues[i].color.red = *pos++;
+		keyValues[i].color.green = *pos++;
+		keyValues[i].color.blue = *pos++;
+	}
+	
+	scheduler.setKeys(keyValues, count);
+	if (! (header[3] & noCommit)) scheduler.endFrame();
+	return 2;
+}
+
+int pipeStream(LedKeyboard &kbd, const Settings &settings) {
+	if (isatty(fileno(stdin))) return 1;
+	
+	FrameScheduler scheduler(kbd, settings.frameRate);
+	int retval = 0;
+	while (true) {
+		// Frames that come in before the tick replace the one waiting for it
+		if (scheduler.isFrameWaiting()) {
+			std::chrono::nanoseconds remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				scheduler.getDeadline() - std::chrono::steady_clock::now());
+			if (remaining.count() < 0) remaining = std::chrono::nanoseconds::zero();
+			timespec timeout = { (time_t)(remaining.count() / 1000000000), (long)(remaining.count() % 1000000000) };
+			pollfd input = { STDIN_FILENO, POLLIN, 0 };
+			if (ppoll(&input, 1, &timeout, NULL) == 0) {
+				scheduler.flushIfDue();
+				continue;
+			}
+		}
+		
+		int status = readFrame(scheduler);
+		if (status != 2) {
+			if (status == 1) retval = 1;
+			break;
+		}
+		scheduler.flushIfDue();
+	}
+	
+	// The last frame is shown whatever came before it
+	scheduler.waitAndFlush();
+	// A write error may be a keyboard unplugged for a moment, the stream carried on
+	if (scheduler.getStats().errors > 0) retval = 1;
+	if (settings.isPrintingStats) printFrameStats(scheduler);
+	return retval;
+}
+
+
+// Reads the header of a binary PPM (P6) frame. Returns 0 at the end of the
+// stream, 1 on a malformed header, 2 otherwise.
+int readPpmHeader(uint32_t &width, uint32_t &height, uint16_t &maxValue) {
+	// Magic, width, height and maximum value, separated by whitespace and
+	// comments, then a single whitespace before the samples
+	unsigned char c;
+	std::string fields[4];
+	for (int field = 0; field < 4; field++) {
+		while (true) {
+			if (readStdin(&c, 1) < 1) return field == 0 && fields[0].empty() ? 0 : 1;
+			if (c == '#') {
+				while (c != '\n') if (readStdin(&c, 1) < 1) return 1;
+			} else if (! isspace(c)) break;
+		}
+		do {
+			fields[field] += c;
+			if (fields[field].size() > 6) return 1;
+			if (readStdin(&c, 1) < 1) return 1;
+		} while (! isspace(c));
+	}
+	if (fields[0] != "P6") return 1;
+	for (int field = 1; field < 4; field++)
+		if (fields[field].find_first_not_of("0123456789") != std::string::npos) return 1;
+	width = std::stoul(fields[1]);
+	height = std::stoul(fields[2]);
+	unsigned long value = std::stoul(fields[3]);
+	// Two byte samples are not worth it for a few LEDs
+	if (width == 0 || height == 0 || value == 0 || value > 255 ||
+	    static_cast<uint64_t>(width) * height > 16384 * 16384 / 3) return 1;
+	maxValue = value;
+	return 2;
+}
+
+int pipePpm(LedKeyboard &kbd, const Settings &settings) {
+	if (isatty(fileno(stdin)) || ! kbd.open()) return 1;
+	
+	FrameScheduler scheduler(kbd, settings.frameRate);
+	std::unique_ptr<ImageSampler> sampler; // For the resolution of the stream, rebuilt if it changes
+	std::vector<uint8_t> pixels;
+	LedKeyboard::Color colors[LedKeyboard::keyCount];
+	uint64_t inputFrames = 0;
+	std::chrono::steady_clock::duration sampleTime = std::chrono::steady_clock::duration::zero();
+	int retval = 0;
+	while (true) {
+		// Frames that come in before the tick replace the one waiting for it
+		if (scheduler.isFrameWaiting()) {
+			std::chrono::nanoseconds remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				scheduler.getDeadline() - std::chrono::steady_clock::now());
+			if (remaining.count() < 0) remaining = std::chrono::nanoseconds::zero();
+			timespec timeout = { (time_t)(remaining.count() / 1000000000), (long)(remaining.count() % 1000000000) };
+			pollfd input = { STDIN_FILENO, POLLIN, 0 };
+			if (ppoll(&input, 1, &timeout, NULL) == 0) {
+				scheduler.flushIfDue();
+				continue;
+			}
+		}
+		
+		uint32_t width, height;
+		uint16_t maxValue;
+		int status = readPpmHeader(width, height, maxValue);
+		if (status != 2) {
+			if (status == 1) retval = 1;
+			break;
+		}
+		if (! sampler || sampler->getWidth() != width || sampler->getHeight() != height) {
+			sampler.reset(new ImageSampler(kbd.getKeyboardModel(), width, height));
+			pixels.resize(static_cast<size_t>(width) * height * 3);
+		}
+		if (readStdin(pixels.data(), pixels.size()) < pixels.size()) {
+			retval = 1;
+			break;
+		}
+		inputFrames++;
+		
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		sampler->sample(pixels.data(), maxValue, colors);
+		sampleTime += std::chrono::steady_clock::now() - start;
+		
+		setFrameKeys(scheduler, colors, [&](uint8_t index) { return sampler->isDriven(index); });
+		scheduler.endFrame();
+		scheduler.flushIfDue();
+	}
+	
+	scheduler.waitAndFlush();
+	if (scheduler.getStats().errors > 0) retval = 1;
+	if (settings.isPrintingStats) {
+		printFrameStats(scheduler);
+		std::cout<<"\tInput frames: "<<inputFrames;
+		if (sampler) std::cout<<" ("<<sampler->getWidth()<<"x"<<sampler->getHeight()<<")";
+		std::cout<<std::endl;
+		if (inputFrames > 0)
+			std::cout<<"\tDownsample time: "<<std::chrono::duration_cast<std::chrono::microseconds>(sampleTime).count() /
+				inputFrames<<"us per frame"<<std::endl;
+	}
+	return retval;
+}
+
+// Shows what producers write to the shared frame until SIGINT or SIGTERM
+int showSharedFrame(LedKeyboard &kbd, const std::string &name, const Settings &settings) {
+	SharedFrame frame;
+	if (! frame.create(name)) {
+		std::cout<<"Can not create the shared frame "<<name<<": "<<strerror(errno)<<std::endl;
 		return 1;
 	}
+	
+	catchStop();
+	
+	LedKeyboard::Color colors[LedKeyboard::keyCount];
+	bool isShown = false;
+	uint32_t sequence = 0;
+	FrameScheduler scheduler(kbd, settings.frameRate);
+	
+	while (! isStopping) {
+		// Wakes up now and then to notice a signal, or a producer that can not wake it
+		uint32_t previous = sequence;
+		if (! frame.waitFrame(colors, sequence, std::chrono::milliseconds(20))) continue;
 		
-	LedKeyboard kbd;
+		// Frames skipped meanwhile do not matter, only the newest is shown
+		uint32_t frames = isShown ? (sequence - previous) / 2 : 1;
+		isShown = true;
+		
+		// Sleeps until the tick, producers carry on meanwhile
+		setFrameKeys(scheduler, colors, [](uint8_t) { return true; });
+		scheduler.endFrame(frames);
+		scheduler.waitAndFlush();
+	}
+	
+	if (settings.isPrintingStats) printFrameStats(scheduler);
+	return scheduler.getStats().errors > 0 ? 1 : 0;
+}
+
+
+// Lights keys as they are typed until SIGINT or SIGTERM
+int runReactive(LedKeyboard &kbd, std::string arg2, std::string arg3, std::string arg4, const Settings &settings) {
+	ReactiveEffect::Mode mode;
+	LedKeyboard::Color color;
+	LedKeyboard::Color background = { 0, 0, 0 };
+	if (! utils::parseReactiveMode(arg2, mode)) return 1;
+	if (! utils::parseColor(arg3, color)) return 1;
+	if (! arg4.empty() && ! utils::parseColor(arg4, background)) return 1;
+	
+	std::string path = settings.inputPath;
+	if (path.empty()) {
+		LedKeyboard::DeviceInfo device = kbd.getCurrentDevice();
+		path = KeyInput::find(device.vendorID, device.productID);
+		if (path.empty()) {
+			std::cout<<"No input device found for the keyboard, use --input"<<std::endl;
+			return 1;
+		}
+	}
+	KeyInput input;
+	if (! input.open(path)) {
+		std::cout<<"Can not open "<<path<<": "<<strerror(errno)<<std::endl;
+		return 1;
+	}
+	
+	catchStop();
+	
+	int epollFd = epoll_create1(EPOLL_CLOEXEC);
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	if (epollFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, input.getFd(), &event) < 0) {
+		std::cout<<"Can not wait on "<<path<<": "<<strerror(errno)<<std::endl;
+		if (epollFd >= 0) close(epollFd);
+		return 1;
+	}
+	
+	// Presses are shown at once, the animation after them moves at the frame rate
+	const unsigned int frameRate = settings.frameRate > 0 ? settings.frameRate : 60;
+	const std::chrono::microseconds budget(1000000 / frameRate);
+	std::chrono::steady_clock::time_point nextFrame;
+	ReactiveEffect effect(kbd.getKeyboardModel(), mode, color, background);
+	FrameScheduler scheduler(kbd, 0); // Paced by the presses and the budget instead
+	KeyInput::Press presses[64];
+	LedKeyboard::Color colors[LedKeyboard::keyCount];
+	bool isMoving = false;
+	
+	// Press to light latency, in 100us buckets up to 50ms
+	const size_t bucketCount = 500;
+	uint32_t latencies[bucketCount] = {};
+	uint64_t pressCount = 0, frameCount = 0, overBudget = 0;
+	std::chrono::steady_clock::duration latencyTotal = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::duration latencyMax = std::chrono::steady_clock::duration::zero();
+	
+	int retval = 0;
+	while (! isStopping) {
+		int timeout = -1;
+		if (isMoving) {
+			std::chrono::steady_clock::duration remaining = nextFrame - std::chrono::steady_clock::now();
+			timeout = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count());
+		}
+		int ready = epoll_wait(epollFd, &event, 1, timeout);
+		if (ready < 0 && errno != EINTR) {
+			retval = 1;
+			break;
+		}
+		
+		// A burst of presses makes a single write
+		int count = 0;
+		if (ready > 0) {
+			count = input.read(presses, sizeof(presses) / sizeof(presses[0]));
+			if (count < 0) break;
+			for (int i = 0; i < count; i++) effect.press(presses[i].key, presses[i].time);
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (count == 0 && (! isMoving || now < nextFrame)) continue;
+		
+		isMoving = effect.render(now, colors);
+		nextFrame = now + budget;
+		setFrameKeys(scheduler, colors, [](uint8_t) { return true; });
+		scheduler.endFrame();
+		frameCount++;
+		
+		std::chrono::steady_clock::time_point lit = std::chrono::steady_clock::now();
+		for (int i = 0; i < count; i++) {
+			std::chrono::steady_clock::duration latency = lit - presses[i].time;
+			if (latency < std::chrono::steady_clock::duration::zero()) continue; // Clock of a replayed event
+			size_t bucket = std::chrono::duration_cast<std::chrono::microseconds>(latency).count() / 100;
+			latencies[std::min(bucket, bucketCount - 1)]++;
+			latencyTotal += latency;
+			if (latency > latencyMax) latencyMax = latency;
+			if (latency > budget) overBudget++;
+			pressCount++;
+		}
+	}
+	close(epollFd);
+	if (scheduler.getStats().errors > 0) retval = 1;
+	
+	if (settings.isPrintingStats) {
+		std::cout<<"Presses: "<<std::dec<<pressCount<<std::endl;
+		std::cout<<"\tFrames: "<<frameCount<<std::endl;
+		if (pressCount > 0) {
+			uint64_t below = 0;
+			size_t p99 = 0;
+			while (p99 < bucketCount - 1 && (below += latencies[p99]) * 100 < pressCount * 99) p99++;
+			std::cout<<"\tLatency: "<<std::chrono::duration_cast<std::chrono::microseconds>(latencyTotal).count() / pressCount
+				<<"us average, "<<(p99 + 1) * 100<<"us p99, "
+				<<std::chrono::duration_cast<std::chrono::microseconds>(latencyMax).count()<<"us max"<<std::endl;
+			std::cout<<"\tOver "<<budget.count()<<"us: "<<overBudget<<std::endl;
+		}
+	}
+	return retval;
+}
+
+// Takes the format from the header of a WAV stream and skips to its samples.
+// What a raw stream started with is left in data, size bytes of it.
+bool readWavHeader(int fd, unsigned int &rate, unsigned int &channels, unsigned char *data, size_t &size) {
+	size = readFully(fd, data, 12);
+	if (size < 12 || memcmp(data, "RIFF", 4) != 0 || memcmp(data + 8, "WAVE", 4) != 0) return true;
+	size = 0;
+	
+	bool isFormatRead = false;
+	unsigned char chunk[8];
+	while (readFully(fd, chunk, sizeof(chunk)) == sizeof(chunk)) {
+		uint32_t chunkSize = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24;
+		if (memcmp(chunk, "data", 4) == 0) return isFormatRead;
+		
+		uint64_t remaining = chunkSize + (chunkSize & 1); // Chunks are padded to an even size
+		unsigned char body[256];
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (chunkSize < 16 || readFully(fd, body, 16) < 16) return false;
+			remaining -= 16;
+			uint16_t format = body[0] | body[1] << 8;
+			channels = body[2] | body[3] << 8;
+			rate = body[4] | body[5] << 8 | body[6] << 16 | (uint32_t)body[7] << 24;
+			uint16_t bits = body[14] | body[15] << 8;
+			// Extensible is still PCM as long as the samples are 16 bit
+			if ((format != 0x0001 && format != 0xfffe) || bits != 16 || channels < 1 || channels > 8 ||
+			    rate < 8000 || rate > 192000) {
+				std::cout<<"Only 16 bit PCM WAV is supported"<<std::endl;
+				return false;
+			}
+			isFormatRead = true;
+		}
+		while (remaining > 0) {
+			size_t length = std::min<uint64_t>(remaining, sizeof(body));
+			if (readFully(fd, body, length) < length) return false;
+			remaining -= length;
+		}
+	}
+	return false;
+}
+
+int runVisualizer(LedKeyboard &kbd, std::string arg2, std::string arg3, const Settings &settings) {
+	LedKeyboard::Color color;
+	LedKeyboard::Color background = { 0, 0, 0 };
+	if (! utils::parseColor(arg2, color)) return 1;
+	if (! arg3.empty() && ! utils::parseColor(arg3, background)) return 1;
+	
+	int fd = STDIN_FILENO;
+	if (! settings.inputPath.empty()) {
+		// Opening a FIFO waits for its writer
+		fd = open(settings.inputPath.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			std::cout<<"Could not open "<<settings.inputPath<<std::endl;
+			return 1;
+		}
+	} else if (isatty(fd)) return 1;
+	
+	// Reads of a few ms, so that the bars never run far behind the audio
+	const size_t chunkFrames = 256;
+	unsigned int rate = settings.pcmRate;
+	unsigned int channels = settings.pcmChannels;
+	int16_t samples[chunkFrames * 8 + 8];
+	unsigned char *bytes = reinterpret_cast<unsigned char*>(samples);
+	size_t buffered = 0; // Bytes of a frame not complete yet
+	if (! readWavHeader(fd, rate, channels, bytes, buffered) || ! kbd.open()) {
+		if (fd != STDIN_FILENO) close(fd);
+		return 1;
+	}
+	
+	catchStop();
+	Spectrum spectrum(kbd.getKeyboardModel(), rate, color, background);
+	FrameScheduler scheduler(kbd, settings.frameRate > 0 ? settings.frameRate : 60);
+	
+	const size_t frameBytes = 2 * channels;
+	uint64_t audioFrames = 0;
+	bool isEnded = false;
+	bool isNewAudio = false;
+	std::chrono::steady_clock::time_point lastRead;
+	uint64_t analyses = 0, latencySamples = 0;
+	std::chrono::steady_clock::duration fftTotal = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::duration fftMax = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::duration latencyTotal = std::chrono::steady_clock::duration::zero();
+	std::chrono::steady_clock::duration latencyMax = std::chrono::steady_clock::duration::zero();
+	// From the newest samples read to the frame that shows them written
+	auto addLatency = [&]() {
+		if (! isNewAudio) return;
+		std::chrono::steady_clock::duration latency = std::chrono::steady_clock::now() - lastRead;
+		latencyTotal += latency;
+		latencyMax = std::max(latencyMax, latency);
+		latencySamples++;
+		isNewAudio = false;
+	};
+	
+	rusage startUsage;
+	getrusage(RUSAGE_SELF, &startUsage);
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	runFrames(scheduler, [&](std::chrono::steady_clock::time_point deadline, LedKeyboard::Color *colors) {
+		addLatency(); // Of the frame that just went out
+		
+		// Read until the tick, but never ahead of the audio clock, so that a
+		// file plays at its own pace while a live source is read as it comes
+		while (! isStopping && ! isEnded) {
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (now >= deadline) break;
+			std::chrono::steady_clock::time_point audioTime = start +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>(static_cast<double>(audioFrames) / rate));
+			bool isAhead = audioTime > now;
+			std::chrono::nanoseconds remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				(isAhead ? std::min(deadline, audioTime) : deadline) - now);
+			timespec timeout = { (time_t)(remaining.count() / 1000000000), (long)(remaining.count() % 1000000000) };
+			pollfd input = { fd, POLLIN, 0 };
+			if (ppoll(&input, isAhead ? 0 : 1, &timeout, NULL) <= 0 || isAhead) continue;
+			
+			ssize_t length = read(fd, bytes + buffered, chunkFrames * frameBytes - buffered);
+			if (length < 0 && errno == EINTR) continue;
+			if (length <= 0) {
+				isEnded = true;
+				break;
+			}
+			lastRead = std::chrono::steady_clock::now();
+			buffered += length;
+			size_t frames = buffered / frameBytes;
+			spectrum.push(samples, frames, channels);
+			audioFrames += frames;
+			buffered -= frames * frameBytes;
+			memmove(bytes, bytes + frames * frameBytes, buffered);
+			isNewAudio = isNewAudio || frames > 0;
+		}
+		
+		if (isNewAudio) {
+			std::chrono::steady_clock::time_point fftStart = std::chrono::steady_clock::now();
+			spectrum.analyze();
+			std::chrono::steady_clock::duration fftTime = std::chrono::steady_clock::now() - fftStart;
+			fftTotal += fftTime;
+			fftMax = std::max(fftMax, fftTime);
+			analyses++;
+		}
+		spectrum.render(std::max(deadline, std::chrono::steady_clock::now()) - start, colors);
+		return ! isEnded;
+	}, [&](uint8_t index) { return spectrum.isDriven(index); });
+	addLatency();
+	if (fd != STDIN_FILENO) close(fd);
+	
+	if (settings.isPrintingStats) {
+		printFrameStats(scheduler);
+		std::cout<<"\tAudio: "<<std::setprecision(1)<<static_cast<double>(audioFrames) / rate<<"s at "<<rate<<"Hz, "
+			<<channels<<" channels"<<std::endl;
+		if (analyses > 0)
+			std::cout<<"\tFFT ("<<Spectrum::fftSize<<" points): "
+				<<std::chrono::duration_cast<std::chrono::nanoseconds>(fftTotal).count() / analyses<<"ns average, "
+				<<std::chrono::duration_cast<std::chrono::nanoseconds>(fftMax).count()<<"ns max"<<std::endl;
+		if (latencySamples > 0)
+			std::cout<<"\tAudio to light: "
+				<<std::chrono::duration_cast<std::chrono::microseconds>(latencyTotal).count() / latencySamples
+				<<"us average, "<<std::chrono::duration_cast<std::chrono::microseconds>(latencyMax).count()
+				<<"us max"<<std::endl;
+		printCpuUsage(startUsage, start);
+	}
+	return scheduler.getStats().errors > 0 ? 1 : 0;
+}
+
+int openKeyboard(LedKeyboard &kbd, uint16_t vendorID, uint16_t productID, std::string serial) {
+	if (kbd.open(vendorID, productID, serial)) return 0;
+	switch (errno)
+	{
+		case ENODEV:
+			std::cout << "Matching or compatible device not found" << std::endl;
+			break;
+		case EACCES:
+			std::cout << "Access denied: Check device access permissions or run as a privileged user (root/sudo)" << std::endl;
+			break;
+		default:
+			std::cout << "Unknown error: errno=" << errno << std::endl;
+	}
+	return 2;
+}
+
+// The profile lines doing what the command does, false for commands the daemon can not take
+bool commandToProfile(int argc, char **argv, int argIndex, std::string &profile) {
+	std::string arg = argv[argIndex];
+	std::vector<std::string> args(argv + argIndex + 1, argv + argc);
+	for (size_t i = 0; i < args.size(); i++)
+		if (args[i].empty() || args[i][0] == '$' || args[i].find_first_of(" \n") != std::string::npos) return false;
+	
+	if (arg == "-c") profile = "c\n";
+	else if (args.size() > 0 && arg == "-a") profile = "a " + args[0] + "\nc\n";
+	else if (args.size() > 0 && arg == "-an") profile = "a " + args[0] + "\n";
+	else if (args.size() > 1 && arg == "-g") profile = "g " + args[0] + " " + args[1] + "\nc\n";
+	else if (args.size() > 1 && arg == "-gn") profile = "g " + args[0] + " " + args[1] + "\n";
+	else if (args.size() > 1 && arg == "-k") profile = "k " + args[0] + " " + args[1] + "\nc\n";
+	else if (args.size() > 2 && arg == "--gradient")
+		profile = "gradient " + args[0] + " " + args[1] + " " + args[2] + "\nc\n";
+	else if (args.size() > 1 && arg == "-kn") profile = "k " + args[0] + " " + args[1] + "\n";
+	else if (args.size() > 1 && arg == "-r") profile = "r " + args[0] + " " + args[1] + "\n";
+	else if (args.size() > 0 && arg == "-mr") profile = "mr " + args[0] + "\n";
+	else if (args.size() > 0 && arg == "-mn") profile = "mn " + args[0] + "\n";
+	else if (args.size() > 0 && arg == "-gkm") profile = "gkm " + args[0] + "\n";
+	else if (args.size() > 3 && arg == "-fx")
+		profile = "fx " + args[0] + " " + args[1] + " " + args[2] + " " + args[3] + "\n";
+	else if (args.size() > 2 && arg == "-fx") profile = "fx " + args[0] + " " + args[1] + " " + args[2] + "\n";
+	else if (args.size() > 0 && arg == "--startup-mode") profile = "sm " + args[0] + "\n";
+	else if (args.size() > 0 && arg == "--on-board-mode") profile = "obm " + args[0] + "\n";
+	else if (args.size() > 0 && arg == "-p") {
+		// Read here, the daemon may not be allowed to
+		std::ifstream file(args[0]);
+		if (! file.is_open()) return false;
+		std::stringstream stream;
+		stream<<file.rdbuf();
+		profile = stream.str();
+	} else if (arg == "-pp") {
+		// Only a file is known to end, a pipe may keep feeding lines until stopped
+		struct stat info;
+		if (fstat(fileno(stdin), &info) != 0 || ! S_ISREG(info.st_mode)) return false;
+		// pread leaves stdin where it was, for running the profile here after all
+		off_t offset = lseek(fileno(stdin), 0, SEEK_CUR);
+		if (offset < 0) return false;
+		profile.clear();
+		char buffer[4096];
+		ssize_t size;
+		while ((size = pread(fileno(stdin), buffer, sizeof(buffer), offset + profile.size())) > 0)
+			profile.append(buffer, size);
+		if (size < 0) return false;
+	} else return false;
+	// Effects and shaders run until stopped, which the daemon can not wait for
+	if (profile.compare(0, 7, "effect ") == 0 || profile.find("\neffect ") != std::string::npos) return false;
+	if (profile.compare(0, 7, "shader ") == 0 || profile.find("\nshader ") != std::string::npos) return false;
+	return true;
+}
+
+// Keyboard selection lines, the daemon reads them ahead of the profile
+std::string deviceToProfile(uint16_t vendorID, uint16_t productID, const std::string &serial) {
+	std::ostringstream stream;
+	stream<<std::hex<<std::setfill('0');
+	if (vendorID != 0x0) stream<<"dv "<<std::setw(4)<<vendorID<<"\n";
+	if (productID != 0x0) stream<<"dp "<<std::setw(4)<<productID<<"\n";
+	if (! serial.empty()) stream<<"ds "<<serial<<"\n";
+	return stream.str();
+}
+
+// A keyboard the daemon keeps open, with the layers its clients drew on it
+struct Session {
+	LedKeyboard keyboard;
+	Compositor compositor{keyboard};
+};
+
+// Sessions by the path of their device, so that every selection naming the
+// same keyboard draws on the same shadow and compositor
+struct Sessions {
+	std::map<std::string, std::unique_ptr<Session>> byDevice;
+	std::map<std::string, Session*> bySelection;
+};
+
+std::string deviceKey(const LedKeyboard::DeviceInfo &device) {
+	return device.path.empty() ? device.serialNumber : device.path;
+}
+
+// The open session a selection would pick, NULL when it needs a new one
+Session *findSession(Sessions &sessions, uint16_t vendorID, uint16_t productID, const std::string &serial) {
+	for (auto &entry : sessions.byDevice) {
+		LedKeyboard::DeviceInfo device = entry.second->keyboard.getCurrentDevice();
+		if (vendorID != 0x0 && device.vendorID != vendorID) continue;
+		if (productID != 0x0 && device.productID != productID) continue;
+		if (! serial.empty() && ! device.serialNumber.empty() && device.serialNumber != serial) continue;
+		return entry.second.get();
+	}
+	return NULL;
+}
+
+int serveRequest(Sessions &sessions, const Settings &settings, const std::string &request) {
+	std::istringstream stream(request);
+	uint16_t vendorID = 0x0;
+	uint16_t productID = 0x0;
+	std::string serial;
+	
+	std::string line;
+	std::streampos start = stream.tellg();
+	while (getline(stream, line)) {
+		if (line.compare(0, 3, "dv ") == 0) {
+			if (! utils::parseUInt16(line.substr(3), vendorID)) return 1;
+		} else if (line.compare(0, 3, "dp ") == 0) {
+			if (! utils::parseUInt16(line.substr(3), productID)) return 1;
+		} else if (line.compare(0, 3, "ds ") == 0) {
+			serial = line.substr(3);
+		} else break;
+		start = stream.tellg();
+	}
+	stream.clear();
+	stream.seekg(start);
+	
+	// Each selection is resolved to its keyboard once, the keyboard then stays
+	// open from the first request on
+	std::string selection = deviceToProfile(vendorID, productID, serial);
+	Session *&session = sessions.bySelection[selection];
+	if (session == NULL) session = findSession(sessions, vendorID, productID, serial);
+	if (session == NULL) {
+		std::unique_ptr<Session> opened(new Session());
+		LedKeyboard *kbd = &opened->keyboard;
+		if (settings.isTransportSet) kbd->setTransport(settings.transportType);
+		kbd->setAckTimeout(settings.ackTimeout);
+		kbd->setDeviceCache(settings.useDeviceCache);
+		kbd->setCalibration(settings.calibration);
+		kbd->SupportedKeyboards = settings.supportedKeyboards;
+		int retval = 1;
+		if (kbd->getTransport()->setQueueDepth(settings.queueDepth))
+			retval = openKeyboard(*kbd, vendorID, productID, serial);
+		if (retval != 0) {
+			sessions.bySelection.erase(selection);
+			return retval;
+		}
+		std::unique_ptr<Session> &device = sessions.byDevice[deviceKey(kbd->getCurrentDevice())];
+		if (! device) device = std::move(opened);
+		session = device.get();
+	}
+	return parseProfile(session->keyboard, stream, session->compositor, NULL);
+}
+
+int runDaemon(const Settings &settings) {
+	Sessions sessions;
+	
+	return ipc::serve(settings.socketPath, [&](const std::string &request, std::ostream &output) {
+		// Messages of the commands go back to the client
+		std::streambuf *stdoutBuffer = std::cout.rdbuf(output.rdbuf());
+		int retval;
+		try {
+			retval = serveRequest(sessions, settings, request);
+		} catch (const std::exception &e) {
+			// A malformed value must not take the daemon down with it
+			std::cout<<"Invalid request: "<<e.what()<<std::endl;
+			retval = 1;
+		}
+		std::cout.rdbuf(stdoutBuffer);
+		return retval;
+	});
+}
+
+
+
+int runCommand(LedKeyboard &kbd, int argc, char **argv) {
 	std::string serial;
 	uint16_t vendorID = 0x0;
 	uint16_t productID = 0x0;
 	uint8_t interfaceNumber = 0xff;
+	Settings settings;
+	std::string profile;
 
 	int argIndex = 1;
 	while (argIndex < argc)
@@ -279,7 +1534,80 @@ int main(int argc, char **argv) {
 		std::string arg = argv[argIndex];
 
 		// Non-Command arguments
-		if (argc > (argIndex + 1) && arg == "-ds") {
+		if (argc > (argIndex + 1) && arg == "--transport") {
+			LedKeyboard::TransportType transportType;
+			if (! utils::parseTransport(argv[argIndex + 1], transportType)) return 1;
+			if (! kbd.setTransport(transportType)) {
+				std::cout<<"Transport "<<argv[argIndex + 1]<<" is not built in"<<std::endl;
+				return 1;
+			}
+			settings.isTransportSet = true;
+			settings.transportType = transportType;
+			settings.useDaemon = false;
+			argIndex += 2;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "--queue-depth") {
+			if (! utils::parseUInt8(argv[argIndex + 1], settings.queueDepth) || settings.queueDepth < 1) return 1;
+			settings.useDaemon = false;
+			argIndex += 2;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "--ack-timeout") {
+			std::chrono::duration<uint16_t, std::milli> ackTimeout;
+			if (! utils::parsePeriod(argv[argIndex + 1], ackTimeout)) return 1;
+			settings.ackTimeout = std::chrono::milliseconds(ackTimeout.count());
+			kbd.setAckTimeout(settings.ackTimeout);
+			settings.useDaemon = false;
+			argIndex += 2;
+			continue;
+		} else if (arg == "--no-cache") {
+			kbd.setDeviceCache(false);
+			settings.useDeviceCache = false;
+			settings.useDaemon = false;
+			argIndex += 1;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "--calibration") {
+			std::shared_ptr<Calibration> calibration = std::make_shared<Calibration>();
+			if (! calibration->load(argv[argIndex + 1])) {
+				std::cout<<"Could not load calibration "<<argv[argIndex + 1];
+				if (calibration->getErrorLine() > 0) std::cout<<" (line "<<calibration->getErrorLine()<<")";
+				std::cout<<std::endl;
+				return 1;
+			}
+			settings.calibration = calibration;
+			kbd.setCalibration(calibration);
+			settings.useDaemon = false;
+			argIndex += 2;
+			continue;
+		} else if (arg == "--stats" || arg == "--no-daemon") {
+			if (arg == "--stats") settings.isPrintingStats = true;
+			settings.useDaemon = false;
+			argIndex += 1;
+			continue;
+		} else if (argc > (argIndex + 2) && arg == "--layer") {
+			std::string name = argv[argIndex + 1];
+			std::string priority = argv[argIndex + 2];
+			if (name.empty() || name.find_first_of(" \n") != std::string::npos) return 1;
+			settings.layer = "layer " + name + " " + priority + "\n";
+			argIndex += 3;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "--fps") {
+			if (! utils::parseFrameRate(argv[argIndex + 1], settings.frameRate)) return 1;
+			argIndex += 2;
+			continue;
+		} else if (argc > (argIndex + 2) && arg == "--pcm-format") {
+			if (! utils::parsePcmFormat(argv[argIndex + 1], argv[argIndex + 2], settings.pcmRate, settings.pcmChannels))
+				return 1;
+			argIndex += 3;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "--input") {
+			settings.inputPath = argv[argIndex + 1];
+			argIndex += 2;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "--socket") {
+			settings.socketPath = argv[argIndex + 1];
+			argIndex += 2;
+			continue;
+		} else if (argc > (argIndex + 1) && arg == "-ds") {
 			serial = argv[argIndex + 1];
 			argIndex += 2;
 			continue;
@@ -293,6 +1621,7 @@ int main(int argc, char **argv) {
 			continue;
 		} else if (argc > (argIndex + 1) && arg == "-di") {
 			if (!utils::parseUInt8(argv[argIndex + 1], interfaceNumber)) return 1;
+			settings.useDaemon = false;
 			argIndex += 2;
 			continue;
 		} else if (argc > (argIndex + 1) && arg == "-tuk"){
@@ -329,6 +1658,7 @@ int main(int argc, char **argv) {
 				if (interfaceNumber != 0xff) ifNum = interfaceNumber;
 				kbd.SupportedKeyboards = { { vendorID, productID, ifNum, (uint16_t)model } };
 			}
+			settings.useDaemon = false;
 
 			argIndex += 2;
 			continue;
@@ -338,24 +1668,51 @@ int main(int argc, char **argv) {
 		//Commands that do not need to initialize a specific device
 		if (arg == "--help" || arg == "-h") {help::usage(argv[0]); return 0;}
 		else if (arg == "--list-keyboards") return listKeyboards(kbd);
+		else if (arg == "--benchmark") return benchmark(kbd, vendorID, productID, serial);
+		else if (argc > (argIndex + 2) && arg == "--compile")
+			return compileAnimation(kbd, argv[argIndex + 1], argv[argIndex + 2], productID);
+		else if (arg == "--daemon") {
+			settings.supportedKeyboards = kbd.SupportedKeyboards;
+			return runDaemon(settings);
+		}
 		else if (arg == "--help-keys") {help::keys(argv[0]); return 0;}
 		else if (arg == "--help-effects") {help::effects(argv[0]); return 0;}
 		else if (arg == "--help-samples") {help::samples(argv[0]); return 0;}
+		else if (arg == "--help-stream") {help::stream(argv[0]); return 0;}
 
+		// A running daemon has the keyboard open already, hand it the command
+		if (settings.useDaemon && serial.find('\n') == std::string::npos) {
+			int retval;
+			std::string output;
+			std::string selection = deviceToProfile(vendorID, productID, serial) + settings.layer;
+			if (commandToProfile(argc, argv, argIndex, profile) &&
+			    ipc::send(settings.socketPath, selection + profile, retval, output)) {
+				std::cout<<output;
+				return retval;
+			}
+		}
+		
 		//Initialize the device for use
-		if (!kbd.open(vendorID, productID, serial)) {
-			switch (errno)
-			{
-				case ENODEV:
-					std::cout << "Matching or compatible device not found" << std::endl;
-					break;
-				case EACCES:
-					std::cout << "Access denied: Check device access permissions or run as a privileged user (root/sudo)" << std::endl;
-					break;
-				default:
-					std::cout << "Unknown error: errno=" << errno << std::endl;
+		if (! kbd.getTransport()->setQueueDepth(settings.queueDepth)) {
+			std::cout<<"Transport "<<kbd.getTransport()->getName()<<" can not queue reports"<<std::endl;
+			return 1;
+		}
+		int retval = openKeyboard(kbd, vendorID, productID, serial);
+		if (retval != 0) return retval;
+		
+		// Without the daemon the layer only lasts for this command
+		if (! settings.layer.empty()) {
+			if (profile.empty() && arg == "-pp" && ! isatty(fileno(stdin))) {
+				std::stringstream stream;
+				stream<<std::cin.rdbuf();
+				profile = stream.str();
 			}
-			return 2;
+			if (profile.empty() && ! commandToProfile(argc, argv, argIndex, profile)) {
+				std::cout<<"Command "<<arg<<" can not draw into a layer"<<std::endl;
+				return 1;
+			}
+			std::istringstream stream(settings.layer + profile);
+			return parseProfile(kbd, stream, settings);
 		}
 		
 		// Command arguments, these will cause parsing to ignore anything beyond the command and its arguments
@@ -372,8 +1729,31 @@ int main(int argc, char **argv) {
 		else if (argc > (argIndex + 2) && arg == "-kn") return setKey(kbd, argv[argIndex + 1], argv[argIndex + 2], false);
 		else if (argc > (argIndex + 2) && arg == "-r") return setRegion(kbd, argv[argIndex + 1], argv[argIndex + 2]);
 		else if (argc > (argIndex + 1) && arg == "-gkm") return setGKeysMode(kbd, argv[argIndex + 1]);
-		else if (argc > (argIndex + 1) && arg == "-p") return loadProfile(kbd, argv[argIndex + 1]);
-		else if (arg == "-pp") return pipeProfile(kbd);
+		else if (argc > (argIndex + 1) && arg == "-p") return loadProfile(kbd, argv[argIndex + 1], settings);
+		else if (arg == "-pp") return pipeProfile(kbd, settings);
+		else if (arg == "-ps") return pipeStream(kbd, settings);
+		else if (arg == "--ppm-stream") return pipePpm(kbd, settings);
+		else if (argc > (argIndex + 1) && arg == "--play") return playAnimation(kbd, argv[argIndex + 1], settings);
+		else if (argc > (argIndex + 1) && arg == "--shared-frame") return showSharedFrame(kbd, argv[argIndex + 1], settings);
+		else if (argc > (argIndex + 3) && arg == "--gradient") {
+			std::istringstream stream("gradient " + std::string(argv[argIndex + 1]) + " " + argv[argIndex + 2] + " " +
+						  argv[argIndex + 3] + "\nc\n");
+			return parseProfile(kbd, stream, settings);
+		}
+		else if (argc > (argIndex + 4) && arg == "--effect")
+			return runEffect(kbd, argv[argIndex + 1], argv[argIndex + 2], argv[argIndex + 3], argv[argIndex + 4], settings);
+		else if (argc > (argIndex + 3) && arg == "--effect")
+			return runEffect(kbd, argv[argIndex + 1], argv[argIndex + 2], argv[argIndex + 3], "", settings);
+		else if (argc > (argIndex + 2) && arg == "--effect")
+			return runEffect(kbd, argv[argIndex + 1], argv[argIndex + 2], "", "", settings);
+		else if (argc > (argIndex + 1) && arg == "--shader") return runShader(kbd, argv[argIndex + 1], settings);
+		else if (argc > (argIndex + 2) && arg == "--visualize-pcm")
+			return runVisualizer(kbd, argv[argIndex + 1], argv[argIndex + 2], settings);
+		else if (argc > (argIndex + 1) && arg == "--visualize-pcm") return runVisualizer(kbd, argv[argIndex + 1], "", settings);
+		else if (argc > (argIndex + 3) && arg == "--reactive")
+			return runReactive(kbd, argv[argIndex + 1], argv[argIndex + 2], argv[argIndex + 3], settings);
+		else if (argc > (argIndex + 2) && arg == "--reactive")
+			return runReactive(kbd, argv[argIndex + 1], argv[argIndex + 2], "", settings);
 		else if (argc > (argIndex + 4) && arg == "-fx")
 			return setFX(kbd, argv[argIndex + 1], argv[argIndex + 2], argv[argIndex + 3], argv[argIndex + 4]);
 		else if (argc > (argIndex + 3) && arg == "-fx")
@@ -389,3 +1769,33 @@ int main(int argc, char **argv) {
 
 	return 0;
 }
+
+
+
+int main(int argc, char **argv) {
+	// Installed as a link named g810-ledd, the binary is the daemon
+	std::vector<char*> args(argv, argv + argc);
+	char daemonArg[] = "--daemon";
+	if (utils::getCmdName(argv[0]) == "g810-ledd") args.push_back(daemonArg);
+	argc = args.size();
+	args.push_back(NULL);
+	argv = args.data();
+	
+	if (argc < 2) {
+		help::usage(argv[0]);
+		return 1;
+	}
+		
+	LedKeyboard kbd;
+	
+	int retval = runCommand(kbd, argc, argv);
+	
+	for (int argIndex = 1; argIndex < argc; argIndex++) {
+		if (std::string(argv[argIndex]) == "--stats") {
+			printStats(kbd);
+			break;
+		}
+	}
+	
+	return retval;
+}